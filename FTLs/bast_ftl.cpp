@@ -29,6 +29,12 @@
  * 1000 mappings.
  *
  * Second notice. Victim mappings still need to be implemented.
+ *
+ * Log blocks are taken from a pool allocated at startup and found through a
+ * hash index on the logical block. The victim when the pool is exhausted is
+ * chosen by BAST_LOG_VICTIM. A victim that holds a sequential prefix of its
+ * logical block is partial merged: the tail is copied from the data block
+ * and the log block is switched in as the new data block.
  */
 
 #include <new>
@@ -37,6 +43,7 @@
 #include <math.h>
 #include <vector>
 #include <queue>
+#include <algorithm>
 #include "../ssd.h"
 
 using namespace ssd;
@@ -55,6 +62,15 @@ LogPageBlock::LogPageBlock()
 	numPages = 0;
 
 	next = NULL;
+
+	lba = -1;
+	prev = NULL;
+	sequential = true;
+	lastWrite = 0;
+
+	cost = -1;
+	costPrev = NULL;
+	costNext = NULL;
 }
 
 
@@ -64,6 +80,33 @@ LogPageBlock::~LogPageBlock()
 	delete [] aPages;
 }
 
+/* Clear the page mappings before the log block is reused. */
+void LogPageBlock::reset(void)
+{
+	for (uint i=0;i<BLOCK_SIZE;i++)
+	{
+		pages[i] = -1;
+		aPages[i] = -1;
+	}
+
+	numPages = 0;
+	lba = -1;
+	sequential = true;
+	lastWrite = 0;
+}
+
+/* Save or load the pages of the log block. The links are owned by the FTL. */
+void LogPageBlock::checkpoint(Checkpoint &cp)
+{
+	cp.array(pages, BLOCK_SIZE);
+	cp.array(aPages, BLOCK_SIZE);
+	cp.address(address);
+	cp.value(numPages);
+	cp.value(lba);
+	cp.value(sequential);
+	cp.value(lastWrite);
+}
+
 /* Comparison class for use by FTL to sort the LogPageBlock compared to the number of pages written. */
 bool LogPageBlock::operator() (const LogPageBlock& lhs, const LogPageBlock& rhs) const
 {
@@ -71,7 +114,8 @@ bool LogPageBlock::operator() (const LogPageBlock& lhs, const LogPageBlock& rhs)
 }
 
 FtlImpl_Bast::FtlImpl_Bast(Controller &controller):
-	FtlParent(controller)
+	FtlParent(controller),
+	log_index(BAST_LOG_BLOCK_LIMIT)
 {
 
 	// Detect required number of bits for logical address size
@@ -87,6 +131,29 @@ FtlImpl_Bast::FtlImpl_Bast(Controller &controller):
 	for (uint i=0;i<NUMBER_OF_ADDRESSABLE_BLOCKS;i++)
 		data_list[i] = -1;
 
+	// Chain the log block pool on the free list.
+	log_pool = new LogPageBlock[BAST_LOG_BLOCK_LIMIT];
+	log_free = NULL;
+	for (uint i=BAST_LOG_BLOCK_LIMIT;i>0;i--)
+	{
+		log_pool[i-1].next = log_free;
+		log_free = &log_pool[i-1];
+	}
+
+	log_head = NULL;
+	log_tail = NULL;
+	log_count = 0;
+
+	// A merge costs at most BLOCK_SIZE plus the live pages of the log and
+	// the data block.
+	if (BAST_LOG_VICTIM == 3)
+	{
+		cost_buckets.assign(3 * BLOCK_SIZE + 1, NULL);
+		cost_tails.assign(cost_buckets.size(), NULL);
+	}
+	cost_min = 0;
+	host_writes = 0;
+
 	printf("Total mapping table size: %luKB\n", NUMBER_OF_ADDRESSABLE_BLOCKS * sizeof(uint) / 1024);
 	printf("Using BAST FTL.\n");
 }
@@ -94,6 +161,196 @@ FtlImpl_Bast::FtlImpl_Bast(Controller &controller):
 FtlImpl_Bast::~FtlImpl_Bast(void)
 {
 	delete data_list;
+	delete [] log_pool;
+}
+
+/*
+ * Find the log block of a logical block. With LRU victim selection the
+ * log block becomes the most recently used.
+ */
+LogPageBlock *FtlImpl_Bast::find_logblock(long lba)
+{
+	long index = log_index.find(lba);
+	if (index == -1)
+		return NULL;
+
+	LogPageBlock *logBlock = &log_pool[index];
+
+	if (BAST_LOG_VICTIM == 1 && logBlock != log_tail)
+	{
+		unlink_logblock(logBlock);
+		append_logblock(logBlock);
+	}
+
+	return logBlock;
+}
+
+void FtlImpl_Bast::unlink_logblock(LogPageBlock *logBlock)
+{
+	if (logBlock->prev != NULL)
+		logBlock->prev->next = logBlock->next;
+	else
+		log_head = logBlock->next;
+
+	if (logBlock->next != NULL)
+		logBlock->next->prev = logBlock->prev;
+	else
+		log_tail = logBlock->prev;
+
+	logBlock->prev = NULL;
+	logBlock->next = NULL;
+}
+
+void FtlImpl_Bast::append_logblock(LogPageBlock *logBlock)
+{
+	logBlock->prev = log_tail;
+	logBlock->next = NULL;
+
+	if (log_tail != NULL)
+		log_tail->next = logBlock;
+	else
+		log_head = logBlock;
+
+	log_tail = logBlock;
+}
+
+/*
+ * The pool is exhausted when a victim is needed, so a random victim is any
+ * pool entry. LRU and FIFO both take the head of the victim order. The
+ * cheapest merge takes the least recently written log block of the
+ * cheapest bucket, passing over sequential log blocks that are still being
+ * filled: merged now they would only be partial merged, and the rest of
+ * their stream would land in a log block that needs a full merge.
+ */
+LogPageBlock *FtlImpl_Bast::select_victim()
+{
+	if (BAST_LOG_VICTIM == 0)
+		return &log_pool[random() % BAST_LOG_BLOCK_LIMIT];
+
+	if (BAST_LOG_VICTIM != 3)
+		return log_head;
+
+	while (cost_buckets[cost_min] == NULL)
+		cost_min++;
+
+	controller.stats.numMemoryRead++;
+	for (uint cost=cost_min;cost<cost_buckets.size();cost++)
+		for (LogPageBlock *logBlock=cost_buckets[cost];logBlock!=NULL;logBlock=logBlock->costNext)
+			if (!is_filling(logBlock))
+				return logBlock;
+
+	return cost_buckets[cost_min];
+}
+
+/*
+ * A sequential log block short of a switch that was written within the
+ * last BLOCK_SIZE host writes.
+ */
+bool FtlImpl_Bast::is_filling(LogPageBlock *logBlock) const
+{
+	return logBlock->sequential && logBlock->cost != 0 && host_writes - logBlock->lastWrite < BLOCK_SIZE;
+}
+
+/*
+ * Move a log block to the bucket of its current merge cost, behind the
+ * log blocks already in it. The cost only changes when its logical block
+ * is written or trimmed, so that is where this is called.
+ */
+void FtlImpl_Bast::update_cost(LogPageBlock *logBlock)
+{
+	if (BAST_LOG_VICTIM != 3)
+		return;
+
+	remove_cost(logBlock);
+
+	uint cost = merge_cost(logBlock);
+	assert(cost < cost_buckets.size());
+
+	logBlock->cost = cost;
+	logBlock->costPrev = cost_tails[cost];
+	logBlock->costNext = NULL;
+	if (logBlock->costPrev != NULL)
+		logBlock->costPrev->costNext = logBlock;
+	else
+		cost_buckets[cost] = logBlock;
+	cost_tails[cost] = logBlock;
+
+	if (cost < cost_min)
+		cost_min = cost;
+}
+
+void FtlImpl_Bast::remove_cost(LogPageBlock *logBlock)
+{
+	if (logBlock->cost == -1u)
+		return;
+
+	if (logBlock->costPrev != NULL)
+		logBlock->costPrev->costNext = logBlock->costNext;
+	else
+		cost_buckets[logBlock->cost] = logBlock->costNext;
+
+	if (logBlock->costNext != NULL)
+		logBlock->costNext->costPrev = logBlock->costPrev;
+	else
+		cost_tails[logBlock->cost] = logBlock->costPrev;
+
+	logBlock->cost = -1;
+	logBlock->costPrev = NULL;
+	logBlock->costNext = NULL;
+}
+
+static bool written_before(const LogPageBlock *lhs, const LogPageBlock *rhs)
+{
+	return lhs->lastWrite < rhs->lastWrite;
+}
+
+/* Bucket the log blocks in use again, e.g. after a checkpoint is loaded. */
+void FtlImpl_Bast::rebuild_costs(void)
+{
+	if (BAST_LOG_VICTIM != 3)
+		return;
+
+	cost_buckets.assign(cost_buckets.size(), NULL);
+	cost_tails.assign(cost_tails.size(), NULL);
+	cost_min = 0;
+
+	for (uint i=0;i<BAST_LOG_BLOCK_LIMIT;i++)
+	{
+		log_pool[i].cost = -1;
+		log_pool[i].costPrev = NULL;
+		log_pool[i].costNext = NULL;
+	}
+
+	// Least recently written first, as update_cost left them.
+	std::vector<LogPageBlock*> used;
+	for (LogPageBlock *lpb = log_head;lpb != NULL;lpb = lpb->next)
+		used.push_back(lpb);
+	std::stable_sort(used.begin(), used.end(), written_before);
+
+	for (uint i=0;i<used.size();i++)
+		update_cost(used[i]);
+}
+
+/*
+ * Rank of the merge a log block needs. Switches rank first, then partial
+ * merges by the pages copied from the data block, then full merges by the
+ * live pages of the log and data block.
+ */
+ulong FtlImpl_Bast::merge_cost(LogPageBlock *logBlock)
+{
+	uint written = controller.get_num_valid(&logBlock->address);
+
+	if (logBlock->sequential)
+		return (written == BLOCK_SIZE) ? 0 : BLOCK_SIZE - written;
+
+	ulong live = logBlock->numPages;
+	if (data_list[logBlock->lba] != -1)
+	{
+		Block *dataBlock = controller.get_block_pointer(Address(data_list[logBlock->lba], PAGE));
+		live += dataBlock->get_pages_valid() - dataBlock->get_pages_invalid();
+	}
+
+	return BLOCK_SIZE + live;
 }
 
 enum status FtlImpl_Bast::read(Event &event)
@@ -102,9 +359,7 @@ enum status FtlImpl_Bast::read(Event &event)
 	long lookupBlock = (event.get_logical_address() >> addressShift);
 	Address eventAddress = Address(event.get_logical_address(), PAGE);
 
-	LogPageBlock *logBlock = NULL;
-	if (log_map.find(lookupBlock) != log_map.end())
-		logBlock = log_map[lookupBlock];
+	LogPageBlock *logBlock = find_logblock(lookupBlock);
 
 	controller.stats.numMemoryRead++;
 
@@ -139,13 +394,15 @@ enum status FtlImpl_Bast::write(Event &event)
 
 	Address eventAddress = Address(event.get_logical_address(), PAGE);
 
-	if (log_map.find(lba) == log_map.end())
+	logBlock = find_logblock(lba);
+	if (logBlock == NULL)
+	{
 		allocate_new_logblock(logBlock, lba, event);
+		logBlock = log_tail;
+	}
 
 	controller.stats.numMemoryRead++;
 
-	logBlock = log_map[lba];
-
 	// Can it fit inside the existing log block. Issue the request.
  	uint numValid = controller.get_num_valid(&logBlock->address);
 	if (numValid < BLOCK_SIZE)
@@ -155,6 +412,11 @@ enum status FtlImpl_Bast::write(Event &event)
 			Address replace_address = Address(logBlock->address.get_linear_address()+logBlock->pages[eventAddress.page], PAGE);
 			event.set_replace_address(replace_address);
 		}
+		else
+			logBlock->numPages++;
+
+		if (eventAddress.page != numValid)
+			logBlock->sequential = false;
 
 		logBlock->pages[eventAddress.page] = numValid;
 
@@ -167,9 +429,11 @@ enum status FtlImpl_Bast::write(Event &event)
 			random_merge(logBlock, lba, event);
 
 		allocate_new_logblock(logBlock, lba, event);
-		logBlock = log_map[lba];
+		logBlock = log_tail;
 		// Write the current io to a new block.
 		logBlock->pages[eventAddress.page] = 0;
+		logBlock->numPages = 1;
+		logBlock->sequential = (eventAddress.page == 0);
 		Address dataPage = logBlock->address;
 		dataPage.valid = PAGE;
 		event.set_address(dataPage);
@@ -188,7 +452,10 @@ enum status FtlImpl_Bast::write(Event &event)
 	// Statistics
 	controller.stats.numFTLWrite++;
 
-	return controller.issue(event);
+	logBlock->lastWrite = ++host_writes;
+	enum status result = controller.issue(event);
+	update_cost(logBlock);
+	return result;
 }
 
 enum status FtlImpl_Bast::trim(Event &event)
@@ -197,9 +464,7 @@ enum status FtlImpl_Bast::trim(Event &event)
 	long lookupBlock = (event.get_logical_address() >> addressShift);
 	Address eventAddress = Address(event.get_logical_address(), PAGE);
 
-	LogPageBlock *logBlock = NULL;
-	if (log_map.find(lookupBlock) != log_map.end())
-		logBlock = log_map[lookupBlock];
+	LogPageBlock *logBlock = find_logblock(lookupBlock);
 
 	controller.stats.numMemoryRead++;
 
@@ -212,11 +477,14 @@ enum status FtlImpl_Bast::trim(Event &event)
 		lBlock->invalidate_page(returnAddress.page);
 
 		logBlock->pages[eventAddress.page] = -1; // Reset the mapping
+		logBlock->numPages--;
+		logBlock->sequential = false;
 
 		if (lBlock->get_state() == INACTIVE) // All pages invalid, force an erase. PTRIM style.
 		{
 			dispose_logblock(logBlock, lookupBlock);
 			Block_manager::instance()->erase_and_invalidate(event, returnAddress, LOG);
+			logBlock = NULL;
 		}
 
 	}
@@ -235,6 +503,9 @@ enum status FtlImpl_Bast::trim(Event &event)
 
 	}
 
+	if (logBlock != NULL)
+		update_cost(logBlock);
+
 	event.set_address(returnAddress);
 	event.set_noop(true);
 
@@ -247,34 +518,40 @@ enum status FtlImpl_Bast::trim(Event &event)
 
 void FtlImpl_Bast::allocate_new_logblock(LogPageBlock *logBlock, long lba, Event &event)
 {
-	if (log_map.size() >= BAST_LOG_BLOCK_LIMIT)
+	if (log_count >= BAST_LOG_BLOCK_LIMIT)
 	{
-		int victim = random()%log_map.size()-1;
-		std::map<long, LogPageBlock*>::iterator it = log_map.begin();
-
-		for (int i=0;i<victim;i++)
-			it++;
+		LogPageBlock *exLogBlock = select_victim();
+		long exLogicalBlock = exLogBlock->lba;
 
-		long exLogicalBlock = (*it).first;
-		LogPageBlock *exLogBlock = (*it).second;
-
-		if (!is_sequential(exLogBlock, exLogicalBlock, event))
+		if (!is_sequential(exLogBlock, exLogicalBlock, event) && !partial_merge(exLogBlock, exLogicalBlock, event))
 			random_merge(exLogBlock, exLogicalBlock, event);
 
 		controller.stats.numPageBlockToPageConversion++;
 	}
 
-	logBlock = new LogPageBlock();
+	logBlock = log_free;
+	log_free = logBlock->next;
+
+	logBlock->lba = lba;
 	logBlock->address = Block_manager::instance()->get_free_block(LOG, event);
 
 	//printf("Using new log block with address: %lu Block: %u\n", logBlock->address.get_linear_address(), logBlock->address.block);
-	log_map[lba] = logBlock;
+	log_index.insert(lba, logBlock - log_pool);
+	append_logblock(logBlock);
+	log_count++;
+	update_cost(logBlock);
 }
 
 void FtlImpl_Bast::dispose_logblock(LogPageBlock *logBlock, long lba)
 {
-	log_map.erase(lba);
-	delete logBlock;
+	log_index.erase(lba);
+	unlink_logblock(logBlock);
+	remove_cost(logBlock);
+	log_count--;
+
+	logBlock->reset();
+	logBlock->next = log_free;
+	log_free = logBlock;
 }
 
 bool FtlImpl_Bast::is_sequential(LogPageBlock* logBlock, long lba, Event &event)
@@ -307,12 +584,67 @@ bool FtlImpl_Bast::is_sequential(LogPageBlock* logBlock, long lba, Event &event)
 		dispose_logblock(logBlock, lba);
 
 		controller.stats.numLogMergeSwitch++;
-		update_map_block(event);
+		update_map_block(event, lba);
 	}
 
 	return isSequential;
 }
 
+bool FtlImpl_Bast::partial_merge(LogPageBlock *logBlock, long lba, Event &event)
+{
+	/* Do partial merge (n reads, n writes and 1 erase)
+	 * 1. Copy the pages after the sequential prefix from the data block
+	 *    into the same slots of the log block.
+	 * 2. Invalidate data block
+	 * 3. promote log block as data block
+	 */
+	uint written = controller.get_num_valid(&logBlock->address);
+	if (!logBlock->sequential || written == BLOCK_SIZE)
+		return false;
+
+	for (uint i=written;i<BLOCK_SIZE && data_list[lba] != -1;i++)
+	{
+		Address readAddress = Address(data_list[lba] + i, PAGE);
+
+		if (controller.get_state(readAddress) != VALID) // Empty or trimmed
+			continue;
+
+		Event readEvent = Event(READ, event.get_logical_address(), 1, event.get_start_time());
+		readEvent.set_address(readAddress);
+		controller.issue(readEvent);
+
+		Event writeEvent = Event(WRITE, event.get_logical_address(), 1, event.get_start_time()+readEvent.get_time_taken());
+		writeEvent.set_address(Address(logBlock->address.get_linear_address() + i, PAGE));
+		writeEvent.set_payload((char*)page_data + readAddress.get_linear_address() * PAGE_SIZE);
+		writeEvent.set_replace_address(readAddress);
+		controller.issue(writeEvent);
+
+		event.incr_time_taken(writeEvent.get_time_taken() + readEvent.get_time_taken());
+
+		// Statistics
+		controller.stats.numFTLRead++;
+		controller.stats.numFTLWrite++;
+		controller.stats.numWLRead++;
+		controller.stats.numWLWrite++;
+	}
+
+	Block_manager::instance()->promote_block(DATA);
+
+	if (data_list[lba] != -1)
+	{
+		Address a = Address(data_list[lba], PAGE);
+		Block_manager::instance()->erase_and_invalidate(event, a, DATA);
+	}
+
+	data_list[lba] = logBlock->address.get_linear_address();
+	dispose_logblock(logBlock, lba);
+
+	controller.stats.numLogMergePartial++;
+	update_map_block(event, lba);
+
+	return true;
+}
+
 bool FtlImpl_Bast::random_merge(LogPageBlock *logBlock, long lba, Event &event)
 {
 	/* Do merge (n reads, n writes and 2 erases (gc'ed))
@@ -380,7 +712,7 @@ bool FtlImpl_Bast::random_merge(LogPageBlock *logBlock, long lba, Event &event)
 
 	// Update mapping
 	data_list[lba] = newDataBlock.get_linear_address();
-	update_map_block(event);
+	update_map_block(event, lba);
 
 	dispose_logblock(logBlock, lba);
 
@@ -388,8 +720,18 @@ bool FtlImpl_Bast::random_merge(LogPageBlock *logBlock, long lba, Event &event)
 	return true;
 }
 
-void FtlImpl_Bast::update_map_block(Event &event)
+/*
+ * Persist the block map entry of a logical block. Without a map directory
+ * the update is simulated as a single write.
+ */
+void FtlImpl_Bast::update_map_block(Event &event, long lbn)
 {
+	if (MAP_DIRECTORY_SIZE > 0)
+	{
+		Block_manager::instance()->update_map_directory(event, lbn);
+		return;
+	}
+
 	Event writeEvent = Event(WRITE, event.get_logical_address(), 1, event.get_start_time());
 	writeEvent.set_address(Address(0, PAGE));
 	writeEvent.set_noop(true);
@@ -398,7 +740,7 @@ void FtlImpl_Bast::update_map_block(Event &event)
 
 	event.incr_time_taken(writeEvent.get_time_taken());
 
-	controller.stats.numGCWrite++;
+	controller.stats.numMapWrite++;
 	controller.stats.numFTLWrite++;
 }
 
@@ -408,3 +750,64 @@ void FtlImpl_Bast::print_ftl_statistics()
 	Block_manager::instance()->print_statistics();
 }
 
+
+long FtlImpl_Bast::pool_index(LogPageBlock *logBlock) const
+{
+	return logBlock == NULL ? -1 : logBlock - log_pool;
+}
+
+LogPageBlock *FtlImpl_Bast::pool_block(long index)
+{
+	return index == -1 ? NULL : &log_pool[index];
+}
+
+/*
+ * Save or load the block map and the log block pool. The links of the
+ * pool are stored as indices into the pool.
+ */
+void FtlImpl_Bast::checkpoint(Checkpoint &cp)
+{
+	cp.section("bast");
+
+	cp.array(data_list, NUMBER_OF_ADDRESSABLE_BLOCKS);
+	log_index.checkpoint(cp);
+
+	for (uint i=0;i<BAST_LOG_BLOCK_LIMIT;i++)
+	{
+		log_pool[i].checkpoint(cp);
+
+		long next = pool_index(log_pool[i].next);
+		long prev = pool_index(log_pool[i].prev);
+		cp.value(next);
+		cp.value(prev);
+		log_pool[i].next = pool_block(next);
+		log_pool[i].prev = pool_block(prev);
+	}
+
+	long links[] = {pool_index(log_free), pool_index(log_head), pool_index(log_tail)};
+	cp.array(links, 3);
+	log_free = pool_block(links[0]);
+	log_head = pool_block(links[1]);
+	log_tail = pool_block(links[2]);
+
+	cp.value(log_count);
+	cp.value(host_writes);
+
+	if (cp.is_loading())
+		rebuild_costs();
+}
+
+/*
+ * Precondition to the merged state: no log blocks, every logical block in
+ * its data block.
+ */
+enum status FtlImpl_Bast::precondition(Precondition &state)
+{
+	if (state.run_block_mapped() == FAILURE)
+		return FAILURE;
+
+	for (uint lbn=0;lbn<NUMBER_OF_ADDRESSABLE_BLOCKS;lbn++)
+		data_list[lbn] = state.map[(ulong)lbn * BLOCK_SIZE];
+
+	return SUCCESS;
+}
@@ -34,6 +34,7 @@
 #include <math.h>
 #include <vector>
 #include <queue>
+#include <map>
 #include <iostream>
 #include "../ssd.h"
 
@@ -44,6 +45,8 @@ FtlImpl_BDftl::BPage::BPage()
 	this->pbn = -1;
 	nextPage = 0;
 	optimal = true;
+	seqPbn = -1;
+	seqNext = 0;
 }
 
 FtlImpl_BDftl::FtlImpl_BDftl(Controller &controller):
@@ -53,6 +56,12 @@ FtlImpl_BDftl::FtlImpl_BDftl(Controller &controller):
 	trim_map = new bool[NUMBER_OF_ADDRESSABLE_BLOCKS*BLOCK_SIZE];
 
 	inuseBlock = NULL;
+	writeLbn = -1;
+
+	numSequentialPromotions = 0;
+	numGCPromotions = 0;
+	numBlockPathIO = 0;
+	numPagePathIO = 0;
 
 	printf("Using BDFTL.\n");
 }
@@ -83,8 +92,11 @@ enum status FtlImpl_BDftl::read(Event &event)
 			event.set_address(Address(0, PAGE));
 			event.set_noop(true);
 		}
+
+		numBlockPathIO++;
 	} else { // DFTL lookup
 		resolve_mapping(event, false);
+		numPagePathIO++;
 
 		MPage current = trans_map[dlpn];
 
@@ -114,6 +126,8 @@ enum status FtlImpl_BDftl::write(Event &event)
 	// Update trim map
 	trim_map[dlpn] = false;
 
+	writeLbn = dlbn;
+
 	// Block-level lookup
 	if (block_map[dlbn].optimal)
 	{
@@ -131,8 +145,10 @@ enum status FtlImpl_BDftl::write(Event &event)
 				controller.stats.numMemoryWrite++; // Update next page
 				event.incr_time_taken(RAM_WRITE_DELAY);
 				event.set_address(Address(block_map[dlbn].pbn + dppn, PAGE));
+				reverse_trans_map[block_map[dlbn].pbn + dppn] = dlpn;
 				block_map[dlbn].nextPage++;
 				handled = true;
+				numBlockPathIO++;
 			} else {
 				/*
 				 * Transfer the block to DFTL.
@@ -143,51 +159,11 @@ enum status FtlImpl_BDftl::write(Event &event)
 				 * 5. Add the block to the block queue to be used later
 				 */
 
-				// 1-3
-				uint numPages = block_map[dlbn].nextPage;
-				long startAdr = dlbn * BLOCK_SIZE;
-
-				Block *b = controller.get_block_pointer(Address(startAdr, PAGE));
-
-				for (uint i=0;i<numPages;i++)
-				{
-					//assert(b->get_state(i) != INVALID);
-
-					if (b->get_state(i) != VALID)
-						continue;
-
-					MPage current = trans_map[startAdr + i];
-
-					if (current.ppn != -1)
-					{
-						update_translation_map(current, block_map[dlbn].pbn+i);
-						current.create_ts = event.get_start_time();
-						current.modified_ts = event.get_start_time();
-						current.cached = true;
-						trans_map.replace(trans_map.begin()+startAdr+i, current);
-
-						cmt++;
-
-						event.incr_time_taken(RAM_WRITE_DELAY);
-						controller.stats.numMemoryWrite++;
-					}
-
-				}
-
-				// 4. Set block to non optimal
-				event.incr_time_taken(RAM_WRITE_DELAY);
-				controller.stats.numMemoryWrite++;
-				block_map[dlbn].optimal = false;
+				// 1-4
+				page_map_block(event, dlbn);
 
 				// 5. Add it to the queue to be used later.
-				Block *block = controller.get_block_pointer(Address(block_map[dlbn].pbn, BLOCK));
-				if (block->get_pages_valid() != BLOCK_SIZE)
-				{
-					if (inuseBlock == NULL)
-						inuseBlock = block;
-					else
-						blockQueue.push(block);
-				}
+				queue_block(controller.get_block_pointer(Address(block_map[dlbn].pbn, BLOCK)));
 
 
 				controller.stats.numPageBlockToPageConversion++;
@@ -197,8 +173,13 @@ enum status FtlImpl_BDftl::write(Event &event)
 		}
 	}
 
+	if (!handled && !block_map[dlbn].optimal)
+		handled = write_sequential(event, dlbn);
+
 	if (!handled)
 	{
+		numPagePathIO++;
+
 		// Important order. As get_free_data_page might change current.
 		long free_page = get_free_biftl_page(event);
 		resolve_mapping(event, true);
@@ -222,6 +203,8 @@ enum status FtlImpl_BDftl::write(Event &event)
 	event.incr_time_taken(RAM_READ_DELAY*3);
 	controller.stats.numFTLWrite++; // Page writes
 
+	writeLbn = -1;
+
 	return controller.issue(event);
 }
 
@@ -230,36 +213,31 @@ long FtlImpl_BDftl::get_free_biftl_page(Event &event)
 	// Important order. As get_free_data_page might change current.
 	long free_page = -1;
 
+	if (inuseBlock == NULL && blockQueue.size() != 0)
+	{
+		inuseBlock = blockQueue.front();
+		blockQueue.pop();
+	}
+
 	// Get next available data page
 	if (inuseBlock == NULL)
 	{
 		// DFTL way
 		free_page = get_free_data_page(event);
 	} else {
+		// Get page from biftl block space
 		Address address;
 		if (inuseBlock->get_next_page(address) == SUCCESS)
-		{
-			// Get page from biftl block space
 			free_page = address.get_linear_address();
-		}
-		else if (blockQueue.size() != 0)
+		else
 		{
-			inuseBlock = blockQueue.front();
-			blockQueue.pop();
-			if (inuseBlock->get_next_page(address) == SUCCESS)
-			{
-				// Get page from the next block in the biftl block space
-				free_page = address.get_linear_address();
-			}
-			else
-			{
-				assert(false);
-			}
-		} else {
-			inuseBlock = NULL;
-			// DFTL way
-			free_page = get_free_data_page(event);
+			assert(false);
 		}
+
+		// Let go of the block when its last page is handed out, as it may
+		// be cleaned and reused once it is full.
+		if (inuseBlock->get_pages_valid() + 1 >= BLOCK_SIZE)
+			inuseBlock = NULL;
 	}
 
 	assert(free_page != -1);
@@ -277,7 +255,7 @@ enum status FtlImpl_BDftl::trim(Event &event)
 	trim_map[dlpn] = true;
 
 	// Block-level lookup
-	if (block_map[dlbn].optimal)
+	if (block_map[dlbn].optimal && block_map[dlbn].pbn != -1u)
 	{
 		Address address = Address(block_map[dlbn].pbn+event.get_logical_address()%BLOCK_SIZE, PAGE);
 		Block *block = controller.get_block_pointer(address);
@@ -289,7 +267,7 @@ enum status FtlImpl_BDftl::trim(Event &event)
 			block_map[dlbn].nextPage = 0;
 			Block_manager::instance()->erase_and_invalidate(event, address, DATA);
 		}
-	} else { // DFTL lookup
+	} else if (!block_map[dlbn].optimal) { // DFTL lookup
 
 		MPage current = trans_map[dlpn];
 		if (current.ppn != -1)
@@ -323,6 +301,7 @@ enum status FtlImpl_BDftl::trim(Event &event)
 
 		if (allTrimmed)
 		{
+			abandon_sequential(dlbn);
 			block_map[dlbn].pbn = -1;
 			block_map[dlbn].nextPage = 0;
 			block_map[dlbn].optimal = true;
@@ -342,88 +321,307 @@ enum status FtlImpl_BDftl::trim(Event &event)
 
 void FtlImpl_BDftl::cleanup_block(Event &event, Block *block)
 {
-	std::map<long, long> invalidated_translation;
-	/*
-	 * 1. Copy only valid pages in the victim block to the current data block
-	 * 2. Invalidate old pages
-	 * 3. mark their corresponding translation pages for update
-	 */
-	for (uint i=0;i<BLOCK_SIZE;i++)
+	cleanup_blocks(event, std::vector<Block*>(1, block));
+}
+
+void FtlImpl_BDftl::cleanup_blocks(Event &event, const std::vector<Block*> &blocks)
+{
+	// Victims that hold a block mapped logical block are moved as a whole.
+	std::vector<Block*> pageMapped;
+	for (uint b=0;b<blocks.size();b++)
+		if (!relocate_block_mapped(event, blocks[b]))
+			pageMapped.push_back(blocks[b]);
+
+	if (pageMapped.size() == 0)
+		return;
+
+	// Logical blocks that are mostly in a victim are rewritten in order.
+	for (uint b=0;b<pageMapped.size();b++)
 	{
-		assert(block->get_state(i) != EMPTY);
-		// When valid, two events are create, one for read and one for write. They are chained and the controller are
-		// called to execute them. The execution time is then added to the real event.
-		if (block->get_state(i) == VALID)
-		{
-			// Set up events.
-			Event readEvent = Event(READ, event.get_logical_address(), 1, event.get_start_time());
-			readEvent.set_address(Address(block->get_physical_address()+i, PAGE));
-
-			// Execute read event
-			if (controller.issue(readEvent) == FAILURE)
-				printf("Data block copy failed.");
-
-			// Get new address to write to and invalidate previous
-			Event writeEvent = Event(WRITE, event.get_logical_address(), 1, event.get_start_time()+readEvent.get_time_taken());
-			Address dataBlockAddress = Address(get_free_data_page(event, false), PAGE);
-			writeEvent.set_address(dataBlockAddress);
-			writeEvent.set_replace_address(Address(block->get_physical_address()+i, PAGE));
-
-			// Setup the write event to read from the right place.
-			writeEvent.set_payload((char*)page_data + (block->get_physical_address()+i) * PAGE_SIZE);
-
-			if (controller.issue(writeEvent) == FAILURE)
-				printf("Data block copy failed.");
-
-			event.incr_time_taken(writeEvent.get_time_taken() + readEvent.get_time_taken());
-
-			// Update GTD
-			long dataPpn = dataBlockAddress.get_linear_address();
-
-			// vpn -> Old ppn to new ppn
-			//printf("%li Moving %li to %li\n", reverse_trans_map[block->get_physical_address()+i], block->get_physical_address()+i, dataPpn);
-			invalidated_translation[reverse_trans_map[block->get_physical_address()+i]] = dataPpn;
-
-			// Statistics
-			controller.stats.numFTLRead++;
-			controller.stats.numFTLWrite++;
-			controller.stats.numWLRead++;
-			controller.stats.numWLWrite++;
-			controller.stats.numMemoryRead++; // Block->get_state(i) == VALID
-			controller.stats.numMemoryWrite =+ 3; // GTD Update (2) + translation invalidate (1)
-		}
+		std::map<uint, uint> victimPages;
+		for (uint i=0;i<BLOCK_SIZE;i++)
+			if (pageMapped[b]->get_state(i) == VALID)
+				victimPages[reverse_trans_map[pageMapped[b]->get_physical_address()+i] / BLOCK_SIZE]++;
+
+		for (std::map<uint, uint>::const_iterator it = victimPages.begin(); it != victimPages.end(); ++it)
+			if ((*it).second * 2 >= BLOCK_SIZE)
+				resequentialize_block(event, (*it).first);
 	}
 
-	/*
-	 * Perform batch update on the marked translation pages
-	 * 1. Update GDT and CMT if necessary.
-	 * 2. Simulate translation page updates.
-	 */
+	relocate_valid_pages(event, pageMapped);
+}
+
+/*
+ * Only pages in blocks that fell back to page-level mapping go through the CMT.
+ */
+void FtlImpl_BDftl::resolve_batch(Event &event, const std::vector<long> &lpns, bool isWrite)
+{
+	std::vector<long> dlpns;
+	dlpns.reserve(lpns.size());
 
-	std::map<long, bool> dirtied_translation_pages;
+	for (uint i=0;i<lpns.size();i++)
+		if (!block_map[lpns[i] / BLOCK_SIZE].optimal)
+			dlpns.push_back(lpns[i]);
 
-	for (std::map<long, long>::const_iterator i = invalidated_translation.begin(); i!=invalidated_translation.end(); ++i)
+	if (dlpns.size() != 0)
+		resolve_mapping(event, dlpns, isWrite);
+}
+
+/*
+ * Move the mappings of a block mapped logical block into the page map.
+ */
+void FtlImpl_BDftl::page_map_block(Event &event, uint dlbn)
+{
+	uint numPages = block_map[dlbn].nextPage;
+	long startAdr = dlbn * BLOCK_SIZE;
+
+	Block *b = controller.get_block_pointer(Address(block_map[dlbn].pbn, PAGE));
+
+	evict_page_from_cache(event, numPages);
+
+	// The mappings are not in the GTD yet, so they enter the CMT dirty.
+	for (uint i=0;i<numPages;i++)
 	{
-		long real_vpn = (*i).first;
-		long newppn = (*i).second;
+		MPage current = trans_map[startAdr + i];
 
-		// Update translation map ( it also updates the CMT, as it is stored inside the GDT )
-		MPage current = trans_map[real_vpn];
+		// Drop what is left from an earlier page mapped period.
+		if (b->get_state(i) != VALID)
+		{
+			if (current.ppn != -1)
+			{
+				evict_specific_page_from_cache(event, startAdr+i);
+				current = trans_map[startAdr + i];
+				update_translation_map(current, -1);
+				trans_map.replace(trans_map.begin()+startAdr+i, current);
+			}
+			continue;
+		}
 
-		update_translation_map(current, newppn);
+		update_translation_map(current, block_map[dlbn].pbn+i);
+		trans_map.replace(trans_map.begin()+startAdr+i, current);
 
 		if (current.cached)
-			current.modified_ts = event.get_start_time();
+			touch_CMT(startAdr+i, event, true);
 		else
 		{
-			current.modified_ts = event.get_start_time();
-			current.create_ts = event.get_start_time();
-			current.cached = true;
-			cmt++;
+			bool dirty = false;
+			take_HMB(startAdr+i, dirty);
+			insert_CMT(startAdr+i, event, true);
 		}
 
-		trans_map.replace(trans_map.begin()+real_vpn, current);
+		event.incr_time_taken(RAM_WRITE_DELAY);
+		controller.stats.numMemoryWrite++;
+	}
+
+	// 4. Set block to non optimal
+	event.incr_time_taken(RAM_WRITE_DELAY);
+	controller.stats.numMemoryWrite++;
+	block_map[dlbn].optimal = false;
+}
+
+/*
+ * Free pages of blocks that fall back to page mapping are used for page
+ * mapped writes.
+ */
+void FtlImpl_BDftl::queue_block(Block *block)
+{
+	if (block->get_pages_valid() == BLOCK_SIZE)
+		return;
+
+	if (inuseBlock == NULL)
+		inuseBlock = block;
+	else
+		blockQueue.push(block);
+}
+
+/*
+ * Block re-promotion
+ *
+ * A write to the first page of a page mapped logical block starts a
+ * sequential rewrite into a fresh block. While the following writes stay
+ * in order they are placed at their offset in that block, and the block
+ * is mapped at block-level again once it is complete. The pages are
+ * page mapped until then, so an out of order write only hands the rest
+ * of the block to the page mapped writes.
+ */
+bool FtlImpl_BDftl::write_sequential(Event &event, uint dlbn)
+{
+	uint dlpn = event.get_logical_address();
+	unsigned char dppn = dlpn % BLOCK_SIZE;
+	BPage &bp = block_map[dlbn];
+
+	if (bp.seqPbn != -1u && bp.seqNext != dppn)
+		abandon_sequential(dlbn);
+
+	if (bp.seqPbn == -1u)
+	{
+		if (dppn != 0 || BDFTL_SEQUENTIAL_REWRITES == 0 || Block_manager::instance()->get_num_free_blocks() <= 1)
+			return false;
+
+		// Each rewrite holds a block. Give up on the oldest one.
+		if (seqOpen.size() >= BDFTL_SEQUENTIAL_REWRITES)
+			abandon_sequential(seqOpen.front());
+
+		seqOpen.push_back(dlbn);
+		bp.seqPbn = Block_manager::instance()->get_free_block(DATA, event).get_linear_address();
+		bp.seqNext = 0;
 	}
+
+	resolve_mapping(event, true);
+
+	MPage current = trans_map[dlpn];
+	if (current.ppn != -1)
+		event.set_replace_address(Address(current.ppn, PAGE));
+
+	update_translation_map(current, bp.seqPbn + dppn);
+	trans_map.replace(trans_map.begin()+dlpn, current);
+
+	event.set_address(Address(bp.seqPbn + dppn, PAGE));
+	bp.seqNext++;
+	numPagePathIO++;
+
+	if (bp.seqNext == BLOCK_SIZE)
+	{
+		seqOpen.remove(dlbn);
+		promote_block(event, dlbn, bp.seqPbn);
+		numSequentialPromotions++;
+	}
+
+	return true;
+}
+
+void FtlImpl_BDftl::abandon_sequential(uint dlbn)
+{
+	if (block_map[dlbn].seqPbn == -1u)
+		return;
+
+	queue_block(controller.get_block_pointer(Address(block_map[dlbn].seqPbn, BLOCK)));
+	seqOpen.remove(dlbn);
+	block_map[dlbn].seqPbn = -1;
+	block_map[dlbn].seqNext = 0;
+}
+
+/*
+ * Map dlbn at block-level to pbn, which holds all of its pages in order.
+ * The page mappings are dropped from the CMT.
+ */
+void FtlImpl_BDftl::promote_block(Event &event, uint dlbn, uint pbn)
+{
+	long startAdr = dlbn * BLOCK_SIZE;
+
+	for (uint i=0;i<BLOCK_SIZE;i++)
+	{
+		evict_specific_page_from_cache(event, startAdr+i);
+		reverse_trans_map[pbn+i] = startAdr+i;
+	}
+
+	block_map[dlbn].pbn = pbn;
+	block_map[dlbn].nextPage = BLOCK_SIZE;
+	block_map[dlbn].optimal = true;
+	block_map[dlbn].seqPbn = -1;
+	block_map[dlbn].seqNext = 0;
+
+	event.incr_time_taken(RAM_WRITE_DELAY);
+	controller.stats.numMemoryWrite++;
+}
+
+void FtlImpl_BDftl::copy_page(Event &event, long fromPpn, long toPpn)
+{
+	Event readEvent = Event(READ, event.get_logical_address(), 1, event.get_start_time());
+	readEvent.set_address(Address(fromPpn, PAGE));
+
+	if (controller.issue(readEvent) == FAILURE)
+		printf("Data block copy failed.");
+
+	Event writeEvent = Event(WRITE, event.get_logical_address(), 1, event.get_start_time()+readEvent.get_time_taken());
+	writeEvent.set_address(Address(toPpn, PAGE));
+	writeEvent.set_replace_address(Address(fromPpn, PAGE));
+	writeEvent.set_payload((char*)page_data + fromPpn * PAGE_SIZE);
+
+	if (controller.issue(writeEvent) == FAILURE)
+		printf("Data block copy failed.");
+
+	event.incr_time_taken(writeEvent.get_time_taken() + readEvent.get_time_taken());
+
+	controller.stats.numFTLRead++;
+	controller.stats.numFTLWrite++;
+	controller.stats.numWLRead++;
+	controller.stats.numWLWrite++;
+}
+
+/*
+ * A block mapped at block-level keeps its layout when it is cleaned.
+ */
+bool FtlImpl_BDftl::relocate_block_mapped(Event &event, Block *block)
+{
+	long pbn = block->get_physical_address();
+	uint i = 0;
+
+	while (i < BLOCK_SIZE && block->get_state(i) != VALID)
+		i++;
+
+	if (i == BLOCK_SIZE)
+		return false;
+
+	uint dlbn = reverse_trans_map[pbn+i] / BLOCK_SIZE;
+	if (!block_map[dlbn].optimal || block_map[dlbn].pbn != pbn)
+		return false;
+
+	// Without a spare block it is cleaned as page mapped.
+	if (Block_manager::instance()->get_num_free_blocks() <= 1)
+	{
+		page_map_block(event, dlbn);
+		controller.stats.numPageBlockToPageConversion++;
+		return false;
+	}
+
+	uint newPbn = Block_manager::instance()->get_free_block(DATA, event).get_linear_address();
+
+	for (;i<BLOCK_SIZE;i++)
+	{
+		if (block->get_state(i) != VALID)
+			continue;
+
+		copy_page(event, pbn+i, newPbn+i);
+		reverse_trans_map[newPbn+i] = dlbn * BLOCK_SIZE + i;
+	}
+
+	block_map[dlbn].pbn = newPbn;
+
+	event.incr_time_taken(RAM_WRITE_DELAY);
+	controller.stats.numMemoryWrite++;
+
+	return true;
+}
+
+/*
+ * Gather every page of a fully written page mapped logical block into a
+ * new block in order, and map it at block-level again.
+ */
+void FtlImpl_BDftl::resequentialize_block(Event &event, uint dlbn)
+{
+	long startAdr = dlbn * BLOCK_SIZE;
+
+	if (block_map[dlbn].optimal || block_map[dlbn].seqPbn != -1u || (long)dlbn == writeLbn || Block_manager::instance()->get_num_free_blocks() <= 1)
+		return;
+
+	for (uint i=0;i<BLOCK_SIZE;i++)
+		if (trim_map[startAdr+i] || trans_map[startAdr+i].ppn == -1)
+			return;
+
+	uint newPbn = Block_manager::instance()->get_free_block(DATA, event).get_linear_address();
+
+	for (uint i=0;i<BLOCK_SIZE;i++)
+	{
+		MPage current = trans_map[startAdr+i];
+		copy_page(event, current.ppn, newPbn+i);
+
+		update_translation_map(current, newPbn+i);
+		trans_map.replace(trans_map.begin()+startAdr+i, current);
+	}
+
+	promote_block(event, dlbn, newPbn);
+	numGCPromotions++;
 }
 
 // Returns true if the next page is in a new block
@@ -450,6 +648,45 @@ void FtlImpl_BDftl::print_ftl_statistics()
 	}
 
 	printf(" Blocks optimal: %i\n", numOptimal);
+	printf(" Promotions: Sequential rewrite: %lu GC: %lu\n", numSequentialPromotions, numGCPromotions);
+	printf(" Served through block map: %f\n", (double)numBlockPathIO / (numBlockPathIO + numPagePathIO));
+	print_mapping_statistics();
 	Block_manager::instance()->print_statistics();
 }
 
+
+void FtlImpl_BDftl::checkpoint(Checkpoint &cp)
+{
+	FtlImpl_DftlParent::checkpoint(cp);
+
+	cp.section("bdftl");
+
+	cp.array(block_map, NUMBER_OF_ADDRESSABLE_BLOCKS);
+	cp.array(trim_map, NUMBER_OF_ADDRESSABLE_BLOCKS*BLOCK_SIZE);
+
+	std::vector<Block*> queued;
+	for (std::queue<Block*> blocks = blockQueue; !blocks.empty(); blocks.pop())
+		queued.push_back(blocks.front());
+
+	ulong count = queued.size();
+	cp.value(count);
+	queued.resize(count);
+	for (ulong i=0;i<count;i++)
+		checkpoint_block(cp, queued[i]);
+
+	if (cp.is_loading())
+	{
+		blockQueue = std::queue<Block*>();
+		for (ulong i=0;i<count;i++)
+			blockQueue.push(queued[i]);
+	}
+
+	cp.sequence(seqOpen);
+	cp.value(writeLbn);
+	checkpoint_block(cp, inuseBlock);
+
+	cp.value(numSequentialPromotions);
+	cp.value(numGCPromotions);
+	cp.value(numBlockPathIO);
+	cp.value(numPagePathIO);
+}
@@ -128,94 +128,16 @@ enum status FtlImpl_Dftl::trim(Event &event)
 
 void FtlImpl_Dftl::cleanup_block(Event &event, Block *block)
 {
-	std::map<long, long> invalidated_translation;
-	/*
-	 * 1. Copy only valid pages in the victim block to the current data block
-	 * 2. Invalidate old pages
-	 * 3. mark their corresponding translation pages for update
-	 */
-	for (uint i=0;i<BLOCK_SIZE;i++)
-	{
-		assert(block->get_state(i) != EMPTY);
-		// When valid, two events are create, one for read and one for write. They are chained and the controller are
-		// called to execute them. The execution time is then added to the real event.
-		if (block->get_state(i) == VALID)
-		{
-			// Set up events.
-			Event readEvent = Event(READ, event.get_logical_address(), 1, event.get_start_time());
-			readEvent.set_address(Address(block->get_physical_address()+i, PAGE));
-
-			// Execute read event
-			if (controller.issue(readEvent) == FAILURE)
-				printf("Data block copy failed.");
-
-			// Get new address to write to and invalidate previous
-			Event writeEvent = Event(WRITE, event.get_logical_address(), 1, event.get_start_time()+readEvent.get_time_taken());
-			Address dataBlockAddress = Address(get_free_data_page(event, false), PAGE);
-
-			writeEvent.set_address(dataBlockAddress);
-
-			writeEvent.set_replace_address(Address(block->get_physical_address()+i, PAGE));
-
-			// Setup the write event to read from the right place.
-			writeEvent.set_payload((char*)page_data + (block->get_physical_address()+i) * PAGE_SIZE);
-
-			if (controller.issue(writeEvent) == FAILURE)
-				printf("Data block copy failed.");
-
-			event.incr_time_taken(writeEvent.get_time_taken() + readEvent.get_time_taken());
-
-			// Update GTD
-			long dataPpn = dataBlockAddress.get_linear_address();
-
-			// vpn -> Old ppn to new ppn
-			//printf("%li Moving %li to %li\n", reverse_trans_map[block->get_physical_address()+i], block->get_physical_address()+i, dataPpn);
-			invalidated_translation[reverse_trans_map[block->get_physical_address()+i]] = dataPpn;
-
-			// Statistics
-			controller.stats.numFTLRead++;
-			controller.stats.numFTLWrite++;
-			controller.stats.numWLRead++;
-			controller.stats.numWLWrite++;
-			controller.stats.numMemoryRead++; // Block->get_state(i) == VALID
-			controller.stats.numMemoryWrite =+ 3; // GTD Update (2) + translation invalidate (1)
-		}
-	}
-
-	/*
-	 * Perform batch update on the marked translation pages
-	 * 1. Update GDT and CMT if necessary.
-	 * 2. Simulate translation page updates.
-	 */
-
-	std::map<long, bool> dirtied_translation_pages;
-
-	for (std::map<long, long>::const_iterator i = invalidated_translation.begin(); i!=invalidated_translation.end(); ++i)
-	{
-		long real_vpn = (*i).first;
-		long newppn = (*i).second;
-
-		// Update translation map ( it also updates the CMT, as it is stored inside the GDT )
-		MPage current = trans_map[real_vpn];
-
-		update_translation_map(current, newppn);
-
-		if (current.cached)
-			current.modified_ts = event.get_start_time();
-		else
-		{
-			current.modified_ts = event.get_start_time();
-			current.create_ts = event.get_start_time();
-			current.cached = true;
-			cmt++;
-		}
-
-		trans_map.replace(trans_map.begin()+real_vpn, current);
-	}
+	cleanup_blocks(event, std::vector<Block*>(1, block));
+}
 
+void FtlImpl_Dftl::cleanup_blocks(Event &event, const std::vector<Block*> &blocks)
+{
+	relocate_valid_pages(event, blocks);
 }
 
 void FtlImpl_Dftl::print_ftl_statistics()
 {
+	print_mapping_statistics();
 	Block_manager::instance()->print_statistics();
 }
@@ -37,6 +37,10 @@
 #include <queue>
 #include <iostream>
 #include <limits>
+#include <algorithm>
+#include <boost/iterator/indirect_iterator.hpp>
+#include <set>
+#include <unordered_map>
 #include "../ssd.h"
 
 using namespace ssd;
@@ -86,9 +90,82 @@ FtlImpl_DftlParent::FtlImpl_DftlParent(Controller &controller):
 		trans_map.push_back(MPage(i));
 
 	reverse_trans_map = new long[ssdSize];
+
+	gc_updates.reserve(BLOCK_SIZE);
+
+	// A journal entry holds both the logical and the physical page number.
+	journalPerPage = PAGE_SIZE / (2*ceil(addressSize / 8.0));
+	journalNext = 0;
+	journalReads = 0;
+	journalWrites = 0;
+	journalCompactions = 0;
+
+	if (DFTL_JOURNAL_SIZE > 0)
+		printf("Mapping journal: %u pages of %i entries\n", DFTL_JOURNAL_SIZE, journalPerPage);
+
+	// An extent holds the start LPN, its PPN and a one byte length.
+	extentSize = 2*ceil(addressSize / 8.0) + 1;
+	cmtBudget = totalCMTentries * ceil(addressSize / 8.0);
+
+	if (CACHE_DFTL_EXTENTS)
+		printf("CMT caches extents of %u bytes within %lu bytes\n", extentSize, cmtBudget);
+
+	totalHMBentries = HMB_DFTL_LIMIT * addressPerPage;
+	hmbHits = 0;
+	hmbFaults = 0;
+	hmbEvictions = 0;
+	hmbPeak = 0;
+
+	if (HMB_DFTL_LIMIT > 0)
+		printf("Number of elements in Host Memory Buffer (HMB): %lu\n", totalHMBentries);
 }
 
 void FtlImpl_DftlParent::consult_GTD(long dlpn, Event &event)
+{
+	gtd_lpns.assign(1, dlpn);
+	consult_GTD(gtd_lpns, event);
+}
+
+/*
+ * Fetch the mappings of dlpns, which all belong to the same translation
+ * page. Mappings updated since the translation page was last written are
+ * read from the mapping journal instead. Each page is only read once.
+ */
+void FtlImpl_DftlParent::consult_GTD(const std::vector<long> &dlpns, Event &event)
+{
+	bool read_translation_page = false;
+	long open_page = journalNext / journalPerPage;
+
+	// Called on every CMT miss, so the pages to read are gathered in a
+	// reused buffer. A batch only touches a few journal pages.
+	gtd_journal_pages.clear();
+
+	for (uint i=0;i<dlpns.size();i++)
+	{
+		long jpage = lookup_journal(dlpns[i]);
+
+		if (jpage == -1)
+			read_translation_page = true;
+		else if (jpage == open_page)
+		{
+			// The open journal page is still in SRAM.
+			event.incr_time_taken(RAM_READ_DELAY);
+			controller.stats.numMemoryRead++;
+		}
+		else if (std::find(gtd_journal_pages.begin(), gtd_journal_pages.end(), jpage) == gtd_journal_pages.end())
+			gtd_journal_pages.push_back(jpage);
+	}
+
+	if (read_translation_page)
+		read_mapping_page(event);
+
+	for (uint i=0;i<gtd_journal_pages.size();i++)
+		read_mapping_page(event);
+
+	journalReads += gtd_journal_pages.size();
+}
+
+void FtlImpl_DftlParent::read_mapping_page(Event &event)
 {
 	// Simulate that we goto translation map and read the mapping page.
 	Event readEvent = Event(READ, event.get_logical_address(), 1, event.get_start_time());
@@ -101,6 +178,20 @@ void FtlImpl_DftlParent::consult_GTD(long dlpn, Event &event)
 	controller.stats.numFTLRead++;
 }
 
+void FtlImpl_DftlParent::write_mapping_page(Event &event)
+{
+	// Simulate the write to translate page
+	Event write_event = Event(WRITE, event.get_logical_address(), 1, event.get_start_time());
+	write_event.set_address(Address(0, PAGE));
+	write_event.set_noop(true);
+
+	if (controller.issue(write_event) == FAILURE) {	assert(false);}
+
+	event.incr_time_taken(write_event.get_time_taken());
+	controller.stats.numFTLWrite++;
+	controller.stats.numGCWrite++;
+}
+
 void FtlImpl_DftlParent::reset_MPage(FtlImpl_DftlParent::MPage &mpage)
 {
 	mpage.create_ts = -2;
@@ -152,77 +243,149 @@ void FtlImpl_DftlParent::resolve_mapping(Event &event, bool isWrite)
 	 * 5. Add mapping to CMT
 	 */
 	//printf("%i\n", cmt);
+
+	/* The batch has already looked the page up and counted it. Unless it
+	 * was evicted since, only its recency is left to update. */
+	if (batched.erase(dlpn) != 0 && trans_map[dlpn].cached)
+	{
+		touch_CMT(dlpn, event, isWrite);
+		return;
+	}
+
 	if (lookup_CMT(event.get_logical_address(), event))
 	{
 		controller.stats.numCacheHits++;
 
-		MPage current = trans_map[dlpn];
-		if (isWrite)
-		{
-			current.modified_ts = event.get_start_time();			
-		}
-		current.last_visited_time = event.get_start_time();
-		trans_map.replace(trans_map.begin()+dlpn, current);
+		touch_CMT(dlpn, event, isWrite);
 
 		// evict_page_from_cache(event);    // no need to evict page from cache
 	} else {
 		controller.stats.numCacheFaults++;
 
+		// Take it out of the HMB before evicting into it.
+		bool dirty = false;
+		bool inHMB = lookup_HMB(dlpn, event, dirty);
+
 		evict_page_from_cache(event);
 
-		consult_GTD(dlpn, event);
+		if (!inHMB)
+			consult_GTD(dlpn, event);
 
-		MPage current = trans_map[dlpn];
-		current.modified_ts = event.get_start_time();
-		current.last_visited_time = event.get_start_time();
-		if (isWrite)
-			current.modified_ts++;
-		current.create_ts = event.get_start_time();
-		current.cached = true;
-		trans_map.replace(trans_map.begin()+dlpn, current);
-
-		cmt++;
+		insert_CMT(dlpn, event, isWrite || dirty);
 	}
 }
 
-void FtlImpl_DftlParent::evict_page_from_cache(Event &event)
+/*
+ * Resolve a set of mappings at once. Misses are grouped by their
+ * translation page, such that each translation page is only read once
+ * and all of the requested mappings it holds are installed in the CMT.
+ * The pages are remembered, so that serving them one by one afterwards
+ * does not count their lookups a second time.
+ */
+void FtlImpl_DftlParent::resolve_mapping(Event &event, const std::vector<long> &dlpns, bool isWrite)
 {
-	while (cmt >= totalCMTentries)
+	std::map<long, std::vector<long> > misses;
+
+	batched.clear();
+	batched.insert(dlpns.begin(), dlpns.end());
+
+	for (uint i=0;i<dlpns.size();i++)
 	{
-		// Find page to evict
-		MpageByLastVisited::iterator evictit = boost::multi_index::get<1>(trans_map).begin();
-		MPage evictPage = *evictit;
+		long dlpn = dlpns[i];
 
-		assert(evictPage.cached && evictPage.create_ts >= 0 && evictPage.modified_ts >= 0);
+		bool dirty = false;
 
-		if (evictPage.create_ts != evictPage.modified_ts)
+		if (lookup_CMT(dlpn, event))
 		{
-			// Evict page
-			// Inform the ssd model that it should invalidate the previous page.
-			// Calculate the start address of the translation page.
-			int vpnBase = evictPage.vpn - evictPage.vpn % addressPerPage;
+			controller.stats.numCacheHits++;
+			touch_CMT(dlpn, event, isWrite);
+		}
+		else if (lookup_HMB(dlpn, event, dirty))
+		{
+			controller.stats.numCacheFaults++;
+			evict_page_from_cache(event);
+			insert_CMT(dlpn, event, isWrite || dirty);
+		}
+		else
+			misses[dlpn / addressPerPage].push_back(dlpn);
+	}
+
+	for (std::map<long, std::vector<long> >::const_iterator m = misses.begin(); m != misses.end(); ++m)
+	{
+		const std::vector<long> &group = (*m).second;
+
+		evict_page_from_cache(event, group.size());
+
+		consult_GTD(group, event);
 
-			for (int i=0;i<addressPerPage;i++)
+		for (uint i=0;i<group.size();i++)
+		{
+			// Duplicates within a batch are only fetched once.
+			if (trans_map[group[i]].cached)
 			{
-				MPage cur = trans_map[vpnBase+i];
-				if (cur.cached)
-				{
-					cur.create_ts = cur.modified_ts;
-					trans_map.replace(trans_map.begin()+vpnBase+i, cur);
-				}
+				touch_CMT(group[i], event, isWrite);
+				continue;
 			}
 
-			// Simulate the write to translate page
-			Event write_event = Event(WRITE, event.get_logical_address(), 1, event.get_start_time());
-			write_event.set_address(Address(0, PAGE));
-			write_event.set_noop(true);
+			controller.stats.numCacheFaults++;
+			insert_CMT(group[i], event, isWrite);
+		}
+	}
+}
 
-			if (controller.issue(write_event) == FAILURE) {	assert(false);}
+void FtlImpl_DftlParent::resolve_batch(Event &event, const std::vector<long> &lpns, bool isWrite)
+{
+	resolve_mapping(event, lpns, isWrite);
+}
 
-			event.incr_time_taken(write_event.get_time_taken());
-			controller.stats.numFTLWrite++;
-			controller.stats.numGCWrite++;
-		}
+void FtlImpl_DftlParent::touch_CMT(long dlpn, Event &event, bool isWrite)
+{
+	MPage current = trans_map[dlpn];
+	if (isWrite)
+	{
+		current.modified_ts = event.get_start_time();
+	}
+	current.last_visited_time = event.get_start_time();
+	trans_map.replace(trans_map.begin()+dlpn, current);
+}
+
+void FtlImpl_DftlParent::insert_CMT(long dlpn, Event &event, bool isWrite)
+{
+	MPage current = trans_map[dlpn];
+	current.modified_ts = event.get_start_time();
+	current.last_visited_time = event.get_start_time();
+	if (isWrite)
+		current.modified_ts++;
+	current.create_ts = event.get_start_time();
+	current.cached = true;
+	trans_map.replace(trans_map.begin()+dlpn, current);
+
+	cmt++;
+
+	if (CACHE_DFTL_EXTENTS)
+		insert_extent(dlpn);
+}
+
+/*
+ * Evict pages until there is room for reserve new entries in the CMT.
+ */
+void FtlImpl_DftlParent::evict_page_from_cache(Event &event, uint reserve)
+{
+	if (CACHE_DFTL_EXTENTS)
+	{
+		evict_extent_from_cache(event, reserve);
+		return;
+	}
+
+	while (cmt > 0 && cmt + reserve > totalCMTentries)
+	{
+		// Find page to evict
+		MpageByLastVisited::iterator evictit = boost::multi_index::get<1>(trans_map).begin();
+		MPage evictPage = *evictit;
+
+		assert(evictPage.cached && evictPage.create_ts >= 0 && evictPage.modified_ts >= 0);
+
+		release_CMT_entry(event, evictPage);
 
 		// Remove page from cache.
 		cmt--;
@@ -239,50 +402,620 @@ void FtlImpl_DftlParent::evict_specific_page_from_cache(Event &event, long lba)
 		MPage evictPage = trans_map[lba];
 
 		if (!evictPage.cached)
+		{
+			bool dirty = false;
+			if (HMB_DFTL_LIMIT > 0 && take_HMB(lba, dirty) && dirty)
+				write_translation_page(event, lba / addressPerPage);
 			return;
+		}
 
 		assert(evictPage.cached && evictPage.create_ts >= 0 && evictPage.modified_ts >= 0);
 
 		if (evictPage.create_ts != evictPage.modified_ts)
+			write_translation_page(event, evictPage.vpn / addressPerPage);
+
+		// Remove page from cache.
+		cmt--;
+
+		if (CACHE_DFTL_EXTENTS)
+			remove_extent(evictPage.vpn);
+
+		evictPage.cached = false;
+		reset_MPage(evictPage);
+		trans_map.replace(trans_map.begin()+evictPage.vpn, evictPage);
+
+}
+
+/*
+ * Compressed CMT
+ *
+ * Runs of mappings where neighbouring LPNs map to consecutive PPNs are
+ * cached as one extent. The CMT budget is counted in bytes, so a single
+ * random mapping costs more than a plain entry, while a sequential run
+ * of up to 255 mappings costs the same as one. Per-mapping state (dirty,
+ * last visited) is still kept in trans_map.
+ */
+std::map<long, uint>::iterator FtlImpl_DftlParent::find_extent(long dlpn)
+{
+	std::map<long, uint>::iterator it = cmt_extents.upper_bound(dlpn);
+	if (it == cmt_extents.begin())
+		return cmt_extents.end();
+
+	--it;
+	if ((*it).first + (long)(*it).second > dlpn)
+		return it;
+
+	return cmt_extents.end();
+}
+
+bool FtlImpl_DftlParent::is_contiguous(long dppn, long next_dppn)
+{
+	return dppn != -1 && next_dppn == dppn + 1;
+}
+
+/*
+ * Add a newly cached dlpn, joining the extents on either side when the
+ * PPNs continue.
+ */
+void FtlImpl_DftlParent::insert_extent(long dlpn)
+{
+	long dppn = trans_map[dlpn].ppn;
+	long start = dlpn;
+	uint length = 1;
+
+	std::map<long, uint>::iterator left = (dlpn > 0) ? find_extent(dlpn - 1) : cmt_extents.end();
+	if (left != cmt_extents.end() && (*left).second < 255 && is_contiguous(trans_map[dlpn - 1].ppn, dppn))
+	{
+		start = (*left).first;
+		length += (*left).second;
+		cmt_extents.erase(left);
+	}
+
+	std::map<long, uint>::iterator right = cmt_extents.find(dlpn + 1);
+	if (right != cmt_extents.end() && length + (*right).second <= 255 && is_contiguous(dppn, trans_map[dlpn + 1].ppn))
+	{
+		length += (*right).second;
+		cmt_extents.erase(right);
+	}
+
+	cmt_extents[start] = length;
+}
+
+/*
+ * Split dlpn out of its extent.
+ */
+void FtlImpl_DftlParent::remove_extent(long dlpn)
+{
+	std::map<long, uint>::iterator it = find_extent(dlpn);
+	if (it == cmt_extents.end())
+		return;
+
+	long start = (*it).first;
+	long end = start + (*it).second;
+	cmt_extents.erase(it);
+
+	if (start < dlpn)
+		cmt_extents[start] = dlpn - start;
+	if (dlpn + 1 < end)
+		cmt_extents[dlpn + 1] = end - dlpn - 1;
+}
+
+/*
+ * The PPN of a cached dlpn changed. It is split from its extent and
+ * joined with its neighbours again using the new PPN.
+ */
+void FtlImpl_DftlParent::remap_extent(long dlpn, long dppn)
+{
+	remove_extent(dlpn);
+
+	long start = dlpn;
+	uint length = 1;
+
+	std::map<long, uint>::iterator left = (dlpn > 0) ? find_extent(dlpn - 1) : cmt_extents.end();
+	if (left != cmt_extents.end() && (*left).first + (long)(*left).second == dlpn && (*left).second < 255 && is_contiguous(trans_map[dlpn - 1].ppn, dppn))
+	{
+		start = (*left).first;
+		length += (*left).second;
+		cmt_extents.erase(left);
+	}
+
+	std::map<long, uint>::iterator right = cmt_extents.find(dlpn + 1);
+	if (right != cmt_extents.end() && length + (*right).second <= 255 && is_contiguous(dppn, trans_map[dlpn + 1].ppn))
+	{
+		length += (*right).second;
+		cmt_extents.erase(right);
+	}
+
+	cmt_extents[start] = length;
+}
+
+/*
+ * Evict whole extents, least recently visited first, until reserve new
+ * extents fit in the byte budget.
+ */
+void FtlImpl_DftlParent::evict_extent_from_cache(Event &event, uint reserve)
+{
+	while (!cmt_extents.empty() && (cmt_extents.size() + reserve) * extentSize > cmtBudget)
+	{
+		MpageByLastVisited::iterator evictit = boost::multi_index::get<1>(trans_map).begin();
+		std::map<long, uint>::iterator ext = find_extent((*evictit).vpn);
+
+		assert((*evictit).cached && ext != cmt_extents.end());
+
+		long start = (*ext).first;
+		long end = start + (*ext).second;
+		cmt_extents.erase(ext);
+
+		for (long vpn = start; vpn < end; vpn++)
+		{
+			release_CMT_entry(event, trans_map[vpn]);
+
+			MPage evictPage = trans_map[vpn];
+
+			// Remove page from cache.
+			cmt--;
+
+			evictPage.cached = false;
+			reset_MPage(evictPage);
+			trans_map.replace(trans_map.begin()+vpn, evictPage);
+		}
+	}
+}
+
+/*
+ * Write back a translation page. All cached mappings that it holds
+ * are clean afterwards.
+ */
+void FtlImpl_DftlParent::write_translation_page(Event &event, long mvpn)
+{
+	// Inform the ssd model that it should invalidate the previous page.
+	// Calculate the start address of the translation page.
+	long vpnBase = mvpn * addressPerPage;
+
+	for (int i=0;i<addressPerPage && vpnBase+i < (long)trans_map.size();i++)
+	{
+		MPage cur = trans_map[vpnBase+i];
+		if (cur.cached && cur.create_ts != cur.modified_ts)
+		{
+			// With a journal, only the changed mappings are logged.
+			if (DFTL_JOURNAL_SIZE > 0)
+				append_journal(event, vpnBase+i);
+
+			cur.create_ts = cur.modified_ts;
+			trans_map.replace(trans_map.begin()+vpnBase+i, cur);
+		}
+		else if (dirty_in_HMB(vpnBase+i))
+		{
+			if (DFTL_JOURNAL_SIZE > 0)
+				append_journal(event, vpnBase+i);
+
+			hmb_index[vpnBase+i].second = false;
+		}
+	}
+
+	if (DFTL_JOURNAL_SIZE == 0)
+		write_mapping_page(event);
+}
+
+/*
+ * Mapping update journal
+ *
+ * Dirty mappings are logged as (dlpn, dppn) deltas in journal pages
+ * instead of rewriting their full translation page. The journal index
+ * in SRAM records the journal page holding the latest delta of a dlpn.
+ * When all DFTL_JOURNAL_SIZE pages are used, the journal is compacted by
+ * rewriting each translation page with deltas in it once.
+ */
+long FtlImpl_DftlParent::lookup_journal(long dlpn)
+{
+	if (journal_index.empty())
+		return -1;
+
+	std::unordered_map<long, long>::const_iterator it = journal_index.find(dlpn);
+	if (it == journal_index.end())
+		return -1;
+
+	return (*it).second;
+}
+
+void FtlImpl_DftlParent::append_journal(Event &event, long dlpn)
+{
+	journal_index[dlpn] = journalNext / journalPerPage;
+	journal_tpages.insert(dlpn / addressPerPage);
+	journalNext++;
+
+	event.incr_time_taken(RAM_WRITE_DELAY);
+	controller.stats.numMemoryWrite++;
+
+	// Flush the journal page when it is full.
+	if (journalNext % journalPerPage == 0)
+	{
+		write_mapping_page(event);
+		journalWrites++;
+
+		if (journalNext / journalPerPage == DFTL_JOURNAL_SIZE)
+			compact_journal(event);
+	}
+}
+
+void FtlImpl_DftlParent::compact_journal(Event &event)
+{
+	// Read-modify-write of every translation page that has deltas.
+	for (std::set<long>::const_iterator it = journal_tpages.begin(); it != journal_tpages.end(); ++it)
+	{
+		read_mapping_page(event);
+		write_mapping_page(event);
+	}
+
+	journal_index.clear();
+	journal_tpages.clear();
+	journalNext = 0;
+	journalCompactions++;
+}
+
+/*
+ * Host Memory Buffer
+ *
+ * DRAM-less drives keep a second level of the mapping cache in host
+ * memory. Mappings evicted from the on-device CMT are moved into the HMB
+ * together with their dirty state, and only written to translation pages
+ * once they leave the HMB. A CMT miss that hits in the HMB costs a PCIe
+ * round-trip instead of a flash read. The two tiers are exclusive.
+ */
+
+/*
+ * Look up a mapping that missed in the CMT. Only these lookups count as
+ * HMB hits or faults and pay the round-trip.
+ */
+bool FtlImpl_DftlParent::lookup_HMB(long dlpn, Event &event, bool &dirty)
+{
+	if (HMB_DFTL_LIMIT == 0)
+		return false;
+
+	if (!take_HMB(dlpn, dirty))
+	{
+		hmbFaults++;
+		return false;
+	}
+
+	event.incr_time_taken(HMB_READ_DELAY);
+	hmbHits++;
+
+	return true;
+}
+
+/*
+ * Remove a mapping from the HMB, e.g. when it moves back to the CMT or is
+ * written out. Returns false if it is not there.
+ */
+bool FtlImpl_DftlParent::take_HMB(long dlpn, bool &dirty)
+{
+	if (HMB_DFTL_LIMIT == 0)
+		return false;
+
+	std::unordered_map<long, std::pair<std::list<long>::iterator, bool> >::iterator it = hmb_index.find(dlpn);
+	if (it == hmb_index.end())
+		return false;
+
+	dirty = (*it).second.second;
+	hmb_lru.erase((*it).second.first);
+	hmb_index.erase(it);
+
+	return true;
+}
+
+void FtlImpl_DftlParent::insert_HMB(Event &event, long dlpn, bool dirty)
+{
+	while (!hmb_lru.empty() && hmb_lru.size() >= totalHMBentries)
+	{
+		long victim = hmb_lru.back();
+
+		// write_translation_page cleans the victim as well.
+		if (hmb_index[victim].second)
+			write_translation_page(event, victim / addressPerPage);
+
+		hmb_index.erase(victim);
+		hmb_lru.pop_back();
+		hmbEvictions++;
+	}
+
+	hmb_lru.push_front(dlpn);
+	hmb_index[dlpn] = std::make_pair(hmb_lru.begin(), dirty);
+
+	if (hmb_lru.size() > hmbPeak)
+		hmbPeak = hmb_lru.size();
+
+	event.incr_time_taken(HMB_WRITE_DELAY);
+}
+
+/*
+ * A mapping leaves the CMT. It moves down to the HMB, or its
+ * translation page is written back when it is dirty.
+ */
+void FtlImpl_DftlParent::release_CMT_entry(Event &event, const MPage &evictPage)
+{
+	bool dirty = evictPage.create_ts != evictPage.modified_ts;
+
+	if (HMB_DFTL_LIMIT > 0)
+		insert_HMB(event, evictPage.vpn, dirty);
+	else if (dirty)
+		write_translation_page(event, evictPage.vpn / addressPerPage);
+}
+
+bool FtlImpl_DftlParent::dirty_in_HMB(long dlpn)
+{
+	if (hmb_index.empty())
+		return false;
+
+	std::unordered_map<long, std::pair<std::list<long>::iterator, bool> >::const_iterator it = hmb_index.find(dlpn);
+	return it != hmb_index.end() && (*it).second.second;
+}
+
+/*
+ * Copy the valid pages of the victims to the current data block and
+ * update their mappings. With GC_SORT_BY_LPN the pages are written in
+ * LPN order, such that logically sequential data ends up physically
+ * sequential again.
+ */
+void FtlImpl_DftlParent::relocate_valid_pages(Event &event, const std::vector<Block*> &blocks)
+{
+	/*
+	 * 1. Copy only valid pages in the victim block to the current data block
+	 * 2. Invalidate old pages
+	 * 3. mark their corresponding translation pages for update
+	 */
+	std::vector<std::pair<long, long> > pages;
+	pages.reserve(blocks.size() * BLOCK_SIZE);
+
+	for (uint b=0;b<blocks.size();b++)
+	{
+		for (uint i=0;i<BLOCK_SIZE;i++)
 		{
-			// Evict page
-			// Inform the ssd model that it should invalidate the previous page.
-			// Calculate the start address of the translation page.
-			int vpnBase = evictPage.vpn - evictPage.vpn % addressPerPage;
+			assert(blocks[b]->get_state(i) != EMPTY);
 
-			for (int i=0;i<addressPerPage;i++)
+			long ppn = blocks[b]->get_physical_address()+i;
+			if (blocks[b]->get_state(i) == VALID)
 			{
-				MPage cur = trans_map[vpnBase+i];
-				if (cur.cached)
-				{
-					cur.create_ts = cur.modified_ts;
-					trans_map.replace(trans_map.begin()+vpnBase+i, cur);
-				}
+				pages.push_back(std::make_pair(reverse_trans_map[ppn], ppn));
+				controller.stats.numMemoryRead++; // Block->get_state(i) == VALID
 			}
+		}
+	}
+
+	if (GC_SORT_BY_LPN > 0)
+		std::sort(pages.begin(), pages.end());
+
+	for (uint i=0;i<pages.size();i++)
+	{
+		long ppn = pages[i].second;
 
-			// Simulate the write to translate page
-			Event write_event = Event(WRITE, event.get_logical_address(), 1, event.get_start_time());
-			write_event.set_address(Address(0, PAGE));
-			write_event.set_noop(true);
+		// A page may have been moved already, e.g. by BDFTL.
+		Address address = Address(ppn, PAGE);
+		if (get_block_pointer(address)->get_state(address.page) != VALID)
+			continue;
 
-			if (controller.issue(write_event) == FAILURE) {	assert(false);}
+		// When valid, two events are create, one for read and one for write. They are chained and the controller are
+		// called to execute them. The execution time is then added to the real event.
+		Event readEvent = Event(READ, event.get_logical_address(), 1, event.get_start_time());
+		readEvent.set_address(address);
 
-			event.incr_time_taken(write_event.get_time_taken());
-			controller.stats.numFTLWrite++;
-			controller.stats.numGCWrite++;
+		// Execute read event
+		if (controller.issue(readEvent) == FAILURE)
+			printf("Data block copy failed.");
+
+		// Get new address to write to and invalidate previous
+		Event writeEvent = Event(WRITE, event.get_logical_address(), 1, event.get_start_time()+readEvent.get_time_taken());
+		Address dataBlockAddress = Address(get_free_data_page(event, false), PAGE);
+
+		writeEvent.set_address(dataBlockAddress);
+
+		writeEvent.set_replace_address(address);
+
+		// Setup the write event to read from the right place.
+		writeEvent.set_payload((char*)page_data + ppn * PAGE_SIZE);
+
+		if (controller.issue(writeEvent) == FAILURE)
+			printf("Data block copy failed.");
+
+		event.incr_time_taken(writeEvent.get_time_taken() + readEvent.get_time_taken());
+
+		// vpn -> Old ppn to new ppn
+		stage_translation_update(pages[i].first, dataBlockAddress.get_linear_address());
+
+		// Statistics
+		controller.stats.numFTLRead++;
+		controller.stats.numFTLWrite++;
+		controller.stats.numWLRead++;
+		controller.stats.numWLWrite++;
+		controller.stats.numMemoryWrite += 3; // GTD Update (2) + translation invalidate (1)
+	}
+
+	/*
+	 * Perform batch update on the marked translation pages
+	 * 1. Update GDT and CMT if necessary.
+	 * 2. Simulate translation page updates.
+	 */
+	apply_translation_updates(event);
+}
+
+/*
+ * Mappings moved by garbage collection are staged while the victim
+ * block is relocated and applied afterwards.
+ */
+void FtlImpl_DftlParent::stage_translation_update(long dlpn, long dppn)
+{
+	gc_updates.push_back(std::make_pair(dlpn, dppn));
+}
+
+/*
+ * Apply the staged mappings grouped by translation page. Each dirty
+ * translation page is written once. Cached mappings are updated in place,
+ * the rest are not brought into the CMT.
+ */
+void FtlImpl_DftlParent::apply_translation_updates(Event &event)
+{
+	std::sort(gc_updates.begin(), gc_updates.end());
+
+	uint i = 0;
+	while (i < gc_updates.size())
+	{
+		long mvpn = gc_updates[i].first / addressPerPage;
+
+		for (; i < gc_updates.size() && gc_updates[i].first / addressPerPage == mvpn; i++)
+		{
+			MPage current = trans_map[gc_updates[i].first];
+			update_translation_map(current, gc_updates[i].second);
+
+			// Uncached mappings are not picked up by write_translation_page.
+			if (DFTL_JOURNAL_SIZE > 0 && !(current.cached && current.create_ts != current.modified_ts) && !dirty_in_HMB(current.vpn))
+				append_journal(event, current.vpn);
+
+			trans_map.replace(trans_map.begin()+current.vpn, current);
 		}
 
-		// Remove page from cache.
-		cmt--;
+		write_translation_page(event, mvpn);
+	}
 
-		evictPage.cached = false;
-		reset_MPage(evictPage);
-		trans_map.replace(trans_map.begin()+evictPage.vpn, evictPage);
+	gc_updates.clear();
+}
+
+void FtlImpl_DftlParent::print_mapping_statistics()
+{
+	uint addressBytes = ceil(addressSize / 8.0);
+	ulong pageMap = trans_map.size() * addressBytes;
+
+	printf("Mapping memory: CMT: %lu bytes GTD: %lu bytes Page map: %lu bytes\n", (ulong)totalCMTentries * addressBytes, (ulong)(pageMap / PAGE_SIZE + 1) * addressBytes, pageMap);
+
+	if (CACHE_DFTL_EXTENTS)
+	{
+		printf("Compressed CMT:\n");
+		printf(" Mappings: %li Extents: %lu Bytes: %lu of %lu\n", cmt, (ulong)cmt_extents.size(), (ulong)cmt_extents.size() * extentSize, cmtBudget);
+	}
+
+	if (HMB_DFTL_LIMIT > 0)
+	{
+		ulong cmtHits = controller.stats.numCacheHits;
+		printf("Mapping cache tiers:\n");
+		printf(" CMT Hits: %lu Faults: %lu Hit Ratio: %f\n", cmtHits, hmbHits + hmbFaults, (double)cmtHits / (cmtHits + hmbHits + hmbFaults));
+		printf(" HMB Hits: %lu Faults: %lu Hit Ratio: %f Evictions: %lu\n", hmbHits, hmbFaults, (double)hmbHits / (hmbHits + hmbFaults), hmbEvictions);
+		printf(" HMB Peak entries: %lu Peak bytes: %lu\n", hmbPeak, (ulong)(hmbPeak * ceil(addressSize / 8.0)));
+	}
 
+	if (DFTL_JOURNAL_SIZE > 0)
+	{
+		printf("Mapping journal:\n");
+		printf(" Page reads: %lu Page writes: %lu Compactions: %lu\n", journalReads, journalWrites, journalCompactions);
+		printf(" Entries indexed: %lu Translation pages pending: %lu\n", (ulong)journal_index.size(), (ulong)journal_tpages.size());
+	}
 }
 
 void FtlImpl_DftlParent::update_translation_map(FtlImpl_DftlParent::MPage &mpage, long ppn)
 {
+	if (CACHE_DFTL_EXTENTS && mpage.cached && mpage.ppn != ppn)
+		remap_extent(mpage.vpn, ppn);
+
 	mpage.ppn = ppn;
-	reverse_trans_map[ppn] = mpage.vpn;
+	if (ppn != -1)
+		reverse_trans_map[ppn] = mpage.vpn;
+}
+
+/*
+ * Save or load the mapping state. The CMT evicts the least recently
+ * visited page and pages visited at the same time leave in the order they
+ * entered the index, so the map is stored in that order and rebuilt in it.
+ */
+void FtlImpl_DftlParent::checkpoint(Checkpoint &cp)
+{
+	cp.section("dftl");
+
+	cp.value(cmt);
+
+	ulong ssdSize = NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE;
+	std::vector<MPage> mpages;
+	if (!cp.is_loading())
+	{
+		mpages.reserve(ssdSize);
+		for (MpageByLastVisited::iterator it = trans_map.get<1>().begin(); it != trans_map.get<1>().end(); ++it)
+			mpages.push_back(*it);
+	}
+
+	cp.vector(mpages);
+
+	if (cp.is_loading())
+	{
+		trans_map.clear();
+		for (ulong i=0;i<mpages.size();i++)
+			trans_map.push_back(mpages[i]);
+
+		std::vector<const MPage*> order(trans_map.size());
+		for (MpageByID::iterator it = trans_map.begin(); it != trans_map.end(); ++it)
+			order[it->vpn] = &*it;
+		trans_map.rearrange(boost::make_indirect_iterator(order.begin()));
+	}
+
+	cp.array(reverse_trans_map, ssdSize);
+	cp.vector(gc_updates);
+
+	cp.map(journal_index);
+	cp.sequence(journal_tpages);
+	cp.value(journalNext);
+	cp.value(journalReads);
+	cp.value(journalWrites);
+	cp.value(journalCompactions);
+
+	cp.map(cmt_extents);
+
+	// The HMB index points into the LRU list and is rebuilt from it.
+	std::vector<std::pair<long, bool> > hmb;
+	if (!cp.is_loading())
+		for (std::list<long>::iterator it = hmb_lru.begin(); it != hmb_lru.end(); ++it)
+			hmb.push_back(std::make_pair(*it, hmb_index[*it].second));
+
+	cp.vector(hmb);
+
+	if (cp.is_loading())
+	{
+		hmb_lru.clear();
+		hmb_index.clear();
+		for (ulong i=0;i<hmb.size();i++)
+		{
+			hmb_lru.push_back(hmb[i].first);
+			hmb_index[hmb[i].first] = std::make_pair(--hmb_lru.end(), hmb[i].second);
+		}
+	}
+
+	cp.value(hmbHits);
+	cp.value(hmbFaults);
+	cp.value(hmbEvictions);
+	cp.value(hmbPeak);
+
+	cp.value(currentDataPage);
+	cp.value(currentTranslationPage);
+}
+
+/*
+ * Precondition through the page level model. Host writes and GC share the
+ * current data block. The mappings are left in flash, the CMT starts
+ * empty.
+ */
+enum status FtlImpl_DftlParent::precondition(Precondition &state)
+{
+	if (state.run_page_mapped(std::vector<int>(1, -1), false) == FAILURE)
+		return FAILURE;
+
+	ulong ssdSize = NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE;
+	for (ulong lpn=0;lpn<ssdSize;lpn++)
+	{
+		if (state.map[lpn] == -1)
+			continue;
+
+		MPage current = trans_map[lpn];
+		current.ppn = state.map[lpn];
+		trans_map.replace(trans_map.begin()+lpn, current);
+		reverse_trans_map[current.ppn] = lpn;
+	}
+
+	currentDataPage = state.frontiers[0];
+
+	return SUCCESS;
 }
@@ -17,6 +17,15 @@
  *
  * Implementation of the FAST FTL described in the paper
  * "A Log buffer-Based Flash Translation Layer Using Fully-Associative Sector Translation by Lee et. al."
+ *
+ * The sector mapping table of the RW log blocks is kept as a hash index from
+ * logical page to log slot, and the log slots of each logical block are
+ * chained, such that reads and merges only touch the pages involved.
+ *
+ * FAST_SEQUENTIAL_LOG_BLOCKS SW log blocks follow concurrent sequential
+ * streams. A new stream takes a free SW log block or closes the least
+ * recently used one. A SW log block is switched in as soon as it is full.
+ * With no SW log blocks, all log writes go to the RW log blocks.
  */
 
 #include <new>
@@ -31,8 +40,18 @@
 
 using namespace ssd;
 
+FtlImpl_Fast::SeqLog::SeqLog():
+	lbn(-1),
+	offset(0),
+	lastUse(0),
+	switches(0),
+	merges(0)
+{}
+
 FtlImpl_Fast::FtlImpl_Fast(Controller &controller):
-	FtlParent(controller)
+	FtlParent(controller),
+	lpn_index(FAST_LOG_BLOCK_LIMIT*BLOCK_SIZE),
+	lbn_index(FAST_LOG_BLOCK_LIMIT*BLOCK_SIZE)
 {
 	addressSize = log(NUMBER_OF_ADDRESSABLE_BLOCKS)/log(2);
 	addressShift = log(BLOCK_SIZE)/log(2);
@@ -46,12 +65,16 @@ FtlImpl_Fast::FtlImpl_Fast(Controller &controller):
 	pin_list = new bool[NUMBER_OF_ADDRESSABLE_BLOCKS*BLOCK_SIZE];
 
 	// SW
-	sequential_offset = 0;
-	sequential_logicalblock_address = -1;
+	seq_logs = new SeqLog[FAST_SEQUENTIAL_LOG_BLOCKS];
+	seq_clock = 0;
 
 	log_page_next = 0;
 
-	log_pages = NULL;
+	log_ring = NULL;
+	log_head = 0;
+
+	slot_next = new long[FAST_LOG_BLOCK_LIMIT*BLOCK_SIZE];
+	slot_prev = new long[FAST_LOG_BLOCK_LIMIT*BLOCK_SIZE];
 
 	printf("Total mapping table size: %luKB\n", NUMBER_OF_ADDRESSABLE_BLOCKS * sizeof(uint) / 1024);
 	printf("Using FAST FTL.\n");
@@ -60,27 +83,96 @@ FtlImpl_Fast::FtlImpl_Fast(Controller &controller):
 FtlImpl_Fast::~FtlImpl_Fast(void)
 {
 	delete data_list;
-	delete log_pages;
+	delete [] seq_logs;
+
+	if (log_ring != NULL)
+	{
+		for (uint i=0;i<FAST_LOG_BLOCK_LIMIT;i++)
+			delete log_ring[i];
+		delete [] log_ring;
+	}
+
+	delete [] slot_next;
+	delete [] slot_prev;
 }
 
 void FtlImpl_Fast::initialize_log_pages()
 {
-	if (log_pages != NULL)
+	if (log_ring != NULL)
 		return;
 
 	Event event = Event(WRITE, 1, 1, 0);
 	// RW
-	log_pages = new LogPageBlock;
-	log_pages->address = Block_manager::instance()->get_free_block(LOG, event);
+	log_ring = new LogPageBlock*[FAST_LOG_BLOCK_LIMIT];
+	for (uint i=0;i<FAST_LOG_BLOCK_LIMIT;i++)
+	{
+		log_ring[i] = new LogPageBlock();
+		log_ring[i]->address = Block_manager::instance()->get_free_block(LOG, event);
+	}
+}
+
+LogPageBlock *FtlImpl_Fast::slot_block(long slot)
+{
+	return log_ring[slot / BLOCK_SIZE];
+}
+
+/*
+ * Map a logical page to a log slot and chain the slot to its logical block.
+ */
+void FtlImpl_Fast::link_log_page(long slot, long lpn)
+{
+	long lbn = lpn >> addressShift;
+	long head = lbn_index.find(lbn);
 
-	LogPageBlock *next = log_pages;
-	for (uint i=0;i<FAST_LOG_BLOCK_LIMIT-1;i++)
+	slot_block(slot)->aPages[slot % BLOCK_SIZE] = lpn;
+
+	slot_prev[slot] = -1;
+	slot_next[slot] = head;
+	if (head != -1)
+		slot_prev[head] = slot;
+
+	lbn_index.insert(lbn, slot);
+	lpn_index.insert(lpn, slot);
+}
+
+/*
+ * Forget the log copy of a logical page, if any.
+ */
+void FtlImpl_Fast::drop_log_page(long lpn)
+{
+	long slot = lpn_index.find(lpn);
+	if (slot == -1)
+		return;
+
+	long lbn = lpn >> addressShift;
+
+	lpn_index.erase(lpn);
+	slot_block(slot)->aPages[slot % BLOCK_SIZE] = -1;
+
+	if (slot_prev[slot] != -1)
+		slot_next[slot_prev[slot]] = slot_next[slot];
+	else if (slot_next[slot] != -1)
+		lbn_index.insert(lbn, slot_next[slot]);
+	else
+		lbn_index.erase(lbn);
+
+	if (slot_next[slot] != -1)
+		slot_prev[slot_next[slot]] = slot_prev[slot];
+}
+
+/*
+ * Forget the log copies of every page in a logical block.
+ */
+void FtlImpl_Fast::drop_log_block(long lbn)
+{
+	for (long slot = lbn_index.find(lbn); slot != -1; slot = slot_next[slot])
 	{
-		LogPageBlock *newLPB = new LogPageBlock();
-		newLPB->address = Block_manager::instance()->get_free_block(LOG, event);
-		next->next = newLPB;
-		next = newLPB;
+		LogPageBlock *lpb = slot_block(slot);
+		lpn_index.erase(lpb->aPages[slot % BLOCK_SIZE]);
+		lpb->aPages[slot % BLOCK_SIZE] = -1;
 	}
+
+	lbn_index.erase(lbn);
 }
 enum status FtlImpl_Fast::read(Event &event)
 {
@@ -92,34 +184,22 @@ enum status FtlImpl_Fast::read(Event &event)
 
 	Address eventAddress = Address(event.get_logical_address(), PAGE);
 
-	LogPageBlock *currentBlock = log_pages;
+	long slot = lpn_index.find(event.get_logical_address());
 
-	bool found = false;
-	while (!found && currentBlock != NULL)
+	bool found = (slot != -1);
+	if (found)
 	{
-		for (int i=0;i<currentBlock->numPages;i++)
-		{
-			//event.incr_time_taken(RAM_READ_DELAY);
-
-			if (currentBlock->aPages[i] == (long)event.get_logical_address())
-			{
-				Address readAddress = Address(currentBlock->address.get_linear_address() + i, PAGE);
-				event.set_address(readAddress);
-
-				// Cancel the while and for loop
-				found = true;
-				break;
-			}
-		}
-
-		currentBlock = currentBlock->next;
+		Address readAddress = Address(slot_block(slot)->address.get_linear_address() + slot % BLOCK_SIZE, PAGE);
+		event.set_address(readAddress);
 	}
 
+	SeqLog *seq = find_sequential(lookupBlock);
+
 	if (!found)
 	{
-		if (sequential_logicalblock_address == lookupBlock && sequential_offset > lbnOffset)
+		if (seq != NULL && seq->offset > lbnOffset)
 		{
-			event.set_address(Address(sequential_address.get_linear_address() + lbnOffset, PAGE));
+			event.set_address(Address(seq->address.get_linear_address() + lbnOffset, PAGE));
 		}
 		else if (data_list[lookupBlock] != -1) // If page is in the data block
 		{
@@ -147,6 +227,9 @@ enum status FtlImpl_Fast::write(Event &event)
 
 	pin_list[event.get_logical_address()] = true;
 
+	// The page is written somewhere new, so any RW log copy is stale.
+	drop_log_page(event.get_logical_address());
+
 	uint lbnOffset = event.get_logical_address() % BLOCK_SIZE;
 
 	// if a collision occurs at offset of the data block of pbn.
@@ -193,48 +276,40 @@ enum status FtlImpl_Fast::trim(Event &event)
 
 	Address eventAddress = Address(event.get_logical_address(), PAGE);
 
-	LogPageBlock *currentBlock = log_pages;
+	long slot = lpn_index.find(event.get_logical_address());
 
-	bool found = false;
-	while (!found && currentBlock != NULL)
+	bool found = (slot != -1);
+	if (found)
 	{
-		for (int i=0;i<currentBlock->numPages;i++)
-		{
-			if (currentBlock->aPages[i] == (long)event.get_logical_address())
-			{
-				Address address = Address(currentBlock->address.get_linear_address() + i, PAGE);
-				Block *block = controller.get_block_pointer(address);
-				block->invalidate_page(address.page);
+		LogPageBlock *currentBlock = slot_block(slot);
 
-				currentBlock->aPages[i] = -1;
+		Address address = Address(currentBlock->address.get_linear_address() + slot % BLOCK_SIZE, PAGE);
+		Block *block = controller.get_block_pointer(address);
+		block->invalidate_page(address.page);
 
-				if (block->get_state() == INACTIVE) // All pages invalid, force an erase. PTRIM style.
-				{
-					Block_manager::instance()->erase_and_invalidate(event, currentBlock->address, LOG);
-					data_list[lookupBlock] = -1;
-				}
+		drop_log_page(event.get_logical_address());
 
-				// Cancel the while and for loop
-				found = true;
-				break;
-			}
+		if (block->get_state() == INACTIVE) // All pages invalid, force an erase. PTRIM style.
+		{
+			Block_manager::instance()->erase_and_invalidate(event, currentBlock->address, LOG);
+			data_list[lookupBlock] = -1;
 		}
-
-		currentBlock = currentBlock->next;
 	}
 
+	SeqLog *seq = find_sequential(lookupBlock);
+
 	if (!found)
 	{
-		if (sequential_logicalblock_address == lookupBlock && sequential_offset > lbnOffset)
+		if (seq != NULL && seq->offset > lbnOffset)
 		{
-			Address address = Address(sequential_address.get_linear_address() + lbnOffset, PAGE);
+			Address address = Address(seq->address.get_linear_address() + lbnOffset, PAGE);
 			Block *block = controller.get_block_pointer(address);
 			block->invalidate_page(address.page);
 
 			if (block->get_state() == INACTIVE) // All pages invalid, force an erase. PTRIM style.
 			{
 				Block_manager::instance()->erase_and_invalidate(event, address, LOG);
-				sequential_logicalblock_address = -1;
+				seq->lbn = -1;
 			}
 
 		}
@@ -265,25 +340,77 @@ enum status FtlImpl_Fast::trim(Event &event)
 	return controller.issue(event);
 }
 
-void FtlImpl_Fast::switch_sequential(Event &event)
+FtlImpl_Fast::SeqLog *FtlImpl_Fast::find_sequential(long lbn)
 {
-	// Add to empty list i.e. switch without erasing the datablock.
+	for (uint i=0;i<FAST_SEQUENTIAL_LOG_BLOCKS;i++)
+		if (seq_logs[i].lbn == lbn)
+			return &seq_logs[i];
 
-	if (data_list[sequential_logicalblock_address] != -1)
-		Block_manager::instance()->invalidate(Address(data_list[sequential_logicalblock_address], BLOCK), DATA);
+	return NULL;
+}
 
-	data_list[sequential_logicalblock_address] = sequential_address.get_linear_address();
+/*
+ * A free SW log block, else the least recently used one.
+ */
+FtlImpl_Fast::SeqLog *FtlImpl_Fast::victim_sequential()
+{
+	SeqLog *victim = &seq_logs[0];
+	for (uint i=0;i<FAST_SEQUENTIAL_LOG_BLOCKS;i++)
+	{
+		if (seq_logs[i].lbn == -1)
+			return &seq_logs[i];
 
-	update_map_block(event);
+		if (seq_logs[i].lastUse < victim->lastUse)
+			victim = &seq_logs[i];
+	}
 
-	controller.stats.numLogMergeSwitch++;
+	return victim;
 }
 
-void FtlImpl_Fast::merge_sequential(Event &event)
+/*
+ * Return a SW log block to its logical block. A full log block is switched
+ * in as the data block, else it is merged with the data block.
+ */
+void FtlImpl_Fast::close_sequential(Event &event, SeqLog &seq)
 {
-	if (sequential_logicalblock_address == -1)
+	if (seq.lbn == -1)
 		return;
 
+	if (seq.offset == BLOCK_SIZE)
+	{
+		/* The log block is filled with sequentially written sectors
+		 * Perform switch operation
+		 * After switch, the data block is erased and returned to the free-block list
+		 */
+		switch_sequential(event, seq);
+	} else {
+		/* Before merge, a new block is allocated from the free-block list
+		 * merge the SW log block with its corresponding data block
+		 * after merge, the two blocks are erased and returned to the free-block list
+		 */
+		merge_sequential(event, seq);
+	}
+
+	seq.lbn = -1;
+}
+
+void FtlImpl_Fast::switch_sequential(Event &event, SeqLog &seq)
+{
+	// Add to empty list i.e. switch without erasing the datablock.
+
+	if (data_list[seq.lbn] != -1)
+		Block_manager::instance()->invalidate(Address(data_list[seq.lbn], BLOCK), DATA);
+
+	data_list[seq.lbn] = seq.address.get_linear_address();
+
+	update_map_block(event, seq.lbn);
+
+	seq.switches++;
+	controller.stats.numLogMergeSwitch++;
+}
+
+void FtlImpl_Fast::merge_sequential(Event &event, SeqLog &seq)
+{
 	// Do merge (n reads, n writes and 2 erases (gc'ed))
 	Address eventAddress = Address(event.get_logical_address(), PAGE);
 
@@ -298,11 +425,11 @@ void FtlImpl_Fast::merge_sequential(Event &event)
 		// Lookup page table and see if page exist in log page
 		Address readAddress;
 
-		Address seq = Address(sequential_address.get_linear_address() + i, PAGE);
-		if (get_state(seq) == VALID)
-			readAddress = seq;
-		else if (data_list[sequential_logicalblock_address] != -1 && get_state(Address(data_list[sequential_logicalblock_address] + i, PAGE)) == VALID)
-			readAddress.set_linear_address(data_list[sequential_logicalblock_address] + i, PAGE);
+		Address seqPage = Address(seq.address.get_linear_address() + i, PAGE);
+		if (get_state(seqPage) == VALID)
+			readAddress = seqPage;
+		else if (data_list[seq.lbn] != -1 && get_state(Address(data_list[seq.lbn] + i, PAGE)) == VALID)
+			readAddress.set_linear_address(data_list[seq.lbn] + i, PAGE);
 		else
 			continue; // Empty page
 
@@ -325,16 +452,17 @@ void FtlImpl_Fast::merge_sequential(Event &event)
 	}
 
 	// Invalidate inactive pages
-	Block_manager::instance()->invalidate(&sequential_address, DATA);
-	if (data_list[sequential_logicalblock_address] != -1)
-		Block_manager::instance()->invalidate(Address(data_list[sequential_logicalblock_address], BLOCK), DATA);
+	Block_manager::instance()->invalidate(&seq.address, DATA);
+	if (data_list[seq.lbn] != -1)
+		Block_manager::instance()->invalidate(Address(data_list[seq.lbn], BLOCK), DATA);
 
 	// Update mapping
-	data_list[sequential_logicalblock_address] = newDataBlock.get_linear_address();
+	data_list[seq.lbn] = newDataBlock.get_linear_address();
 
+	seq.merges++;
 	controller.stats.numLogMergeFull++;
 
-	update_map_block(event);
+	update_map_block(event, seq.lbn);
 }
 
 bool FtlImpl_Fast::random_merge(LogPageBlock *logBlock, Event &event)
@@ -369,60 +497,44 @@ bool FtlImpl_Fast::random_merge(LogPageBlock *logBlock, Event &event)
 		long victimLBA = m->first;
 		if (victimLBA == -1)
 			continue;
-		// Find the last block and then the next last etc.
-		for (int logblockNr = FAST_LOG_BLOCK_LIMIT; logblockNr > 0; logblockNr--)
+		// Copy the latest log copy of each page in the logical block
+		for (long slot = lbn_index.find(victimLBA); slot != -1; slot = slot_next[slot])
 		{
-			LogPageBlock *lpb = log_pages;
-			for (int i = 0;i<logblockNr-1;i++)
-				lpb = lpb->next;
+			event.incr_time_taken(RAM_READ_DELAY);
 
-			// Go though the pages and see if any falls into the same category as the current logical block
-			for (int i=lpb->numPages-1;i>0;i--)
-			{
-				event.incr_time_taken(RAM_READ_DELAY);
+			LogPageBlock *lpb = slot_block(slot);
+			long lpn = lpb->aPages[slot % BLOCK_SIZE];
 
-				if (lpb->aPages[i] == -1u)
-					continue;
+			Address writeAddress = Address(mergeAddress.get_linear_address() + (lpn%BLOCK_SIZE), PAGE);
 
-				// See if there is a conflict, if there isn't. Read and rewrite the page.
-				long currentLBA = (lpb->aPages[i] >> addressShift);
-				if (victimLBA == currentLBA)
-				{
-					Address writeAddress = Address(mergeAddress.get_linear_address() + (lpb->aPages[i]%BLOCK_SIZE), PAGE);
-					if (pinned[lpb->aPages[i]%BLOCK_SIZE])
-					{
-						lpb->aPages[i] = -1;
-					}
-					else if (get_state(writeAddress) == EMPTY)
-					{
-						// Read the active log address
-						Event readEvent = Event(READ, event.get_logical_address(), 1, event.get_start_time());
-						Address readAddress = Address(lpb->address.get_linear_address()+i, PAGE);
-						readEvent.set_address(readAddress);
-
-						if (controller.issue(readEvent) == FAILURE) { printf("failed\n"); return false; }
-						//event.consolidate_metaevent(readEvent);
-
-						Event writeEvent = Event(WRITE, event.get_logical_address(), 1, event.get_start_time()+readEvent.get_time_taken());
-						writeEvent.set_payload((char*)page_data + readAddress.get_linear_address() * PAGE_SIZE);
-						writeEvent.set_address(writeAddress);
-
-						if (controller.issue(writeEvent) == FAILURE) { printf("failed\n"); return false; }
-						//event.consolidate_metaevent(writeEvent);
-						event.incr_time_taken(writeEvent.get_time_taken() + readEvent.get_time_taken());
-
-						pinned[lpb->aPages[i]%BLOCK_SIZE] = true;
-
-						// Statistics
-						controller.stats.numFTLRead++;
-						controller.stats.numFTLWrite++;
-						controller.stats.numWLRead++;
-						controller.stats.numWLWrite++;
-					}
-				}
-			}
+			// Read the active log address
+			Event readEvent = Event(READ, event.get_logical_address(), 1, event.get_start_time());
+			Address readAddress = Address(lpb->address.get_linear_address() + slot % BLOCK_SIZE, PAGE);
+			readEvent.set_address(readAddress);
+
+			if (controller.issue(readEvent) == FAILURE) { printf("failed\n"); return false; }
+			//event.consolidate_metaevent(readEvent);
+
+			Event writeEvent = Event(WRITE, event.get_logical_address(), 1, event.get_start_time()+readEvent.get_time_taken());
+			writeEvent.set_payload((char*)page_data + readAddress.get_linear_address() * PAGE_SIZE);
+			writeEvent.set_address(writeAddress);
+
+			if (controller.issue(writeEvent) == FAILURE) { printf("failed\n"); return false; }
+			//event.consolidate_metaevent(writeEvent);
+			event.incr_time_taken(writeEvent.get_time_taken() + readEvent.get_time_taken());
+
+			pinned[lpn%BLOCK_SIZE] = true;
+
+			// Statistics
+			controller.stats.numFTLRead++;
+			controller.stats.numFTLWrite++;
+			controller.stats.numWLRead++;
+			controller.stats.numWLWrite++;
 		}
 
+		// The log copies now live in the merged block.
+		drop_log_block(victimLBA);
+
 		// Merge the data block with the pages from the log
 		for (uint i=0;i<BLOCK_SIZE;i++)
 		{
@@ -464,73 +576,64 @@ bool FtlImpl_Fast::random_merge(LogPageBlock *logBlock, Event &event)
 
 		data_list[victimLBA] = mergeAddress.get_linear_address();
 
+		update_map_block(event, victimLBA);
 	}
 
 	controller.stats.numLogMergeFull++;
 
-	update_map_block(event);
-
 	return true;
 }
 
 bool FtlImpl_Fast::write_to_log_block(Event &event, long logicalBlockAddress)
 {
 	uint lbnOffset = event.get_logical_address() % BLOCK_SIZE;
-	if (lbnOffset == 0) /* Case 1 in Figure 5 */
+
+	// The SW log block of the logical block, if any.
+	SeqLog *seq = find_sequential(logicalBlockAddress);
+
+	if (lbnOffset == 0 && FAST_SEQUENTIAL_LOG_BLOCKS > 0) /* Case 1 in Figure 5 */
 	{
-		if (sequential_offset == BLOCK_SIZE)
-		{
-			/* The log block is filled with sequentially written sectors
-			 * Perform switch operation
-			 * After switch, the data block is erased and returned to the free-block list
-			 */
-			switch_sequential(event);
-		} else {
-			/* Before merge, a new block is allocated from the free-block list
-			 * merge the SW log block with its corresponding data block
-			 * after merge, the two blocks are erased and returned to the free-block list
-			 */
-			merge_sequential(event);
-		}
+		/* Close the SW log block of the logical block, or make room for a
+		 * new stream by closing a free or the least recently used one.
+		 */
+		if (seq == NULL)
+			seq = victim_sequential();
+
+		close_sequential(event, *seq);
 
 		/* Get a block from the free-block list and use it as a SW log block
 		 * Append data to the SW log block
 		 * Update the SW log block part of the sector mapping table
 		 */
 
-		sequential_offset = 1;
-		sequential_address = Block_manager::instance()->get_free_block(DATA, event);
-		sequential_logicalblock_address = logicalBlockAddress;
+		seq->offset = 1;
+		seq->address = Block_manager::instance()->get_free_block(DATA, event);
+		seq->lbn = logicalBlockAddress;
+		seq->lastUse = ++seq_clock;
 
-		event.set_address(sequential_address);
+		event.set_address(seq->address);
 	} else {
-		if (sequential_logicalblock_address == logicalBlockAddress) // If the current owner for the SW log block is the same with lbn
+		if (seq != NULL && lbnOffset == seq->offset) // If the current owner for the SW log block is the same with lbn and lsn is equivalent with (last_lsn+1)
 		{
-			// last_lsn = getLastLsnFromSMT(lbn) Sector mapping table
-
-			if (lbnOffset == sequential_offset)// lsn is equivalent with (last_lsn+1)
-			{
-				// Append data to the SW log block
-				Address seq = sequential_address;
-				controller.get_free_page(seq);
-				event.set_address(seq);
-
-				sequential_offset++;
+			// Append data to the SW log block
+			Address seqAddress = seq->address;
+			controller.get_free_page(seqAddress);
+			event.set_address(seqAddress);
 
-			} else {
-				// Merge the SW log block with its corresponding data block
-				// Get a block from the free-block list and use it as a SW log block
-				merge_sequential(event);
+			seq->offset++;
+			seq->lastUse = ++seq_clock;
 
-				sequential_offset = 1;
-				sequential_address = Block_manager::instance()->get_free_block(DATA, event);
-				sequential_logicalblock_address = logicalBlockAddress;
-
-				// Append data to the SW log block
-				event.set_address(sequential_address);
-			}
 			// Update the SW log block part of the sector mapping table
+
+			// A full SW log block is switched in right away.
+			if (seq->offset == BLOCK_SIZE)
+				close_sequential(event, *seq);
 		} else {
+			// The stream is broken. Merge the SW log block with its
+			// corresponding data block and write the page to the RW log.
+			if (seq != NULL)
+				close_sequential(event, *seq);
+
 			if (log_page_next == FAST_LOG_BLOCK_LIMIT*BLOCK_SIZE) // There are no room in the RW log lock to write data
 			{
 				/*
@@ -540,38 +643,34 @@ bool FtlImpl_Fast::write_to_log_block(Event &event, long logicalBlockAddress)
 				 * update the RW log block part of the sector-mapping table
 				 */
 
-				LogPageBlock *victim = log_pages;
+				LogPageBlock *victim = log_ring[log_head];
 
 				random_merge(victim, event);
 
-				// Maintain the log page list
-				log_pages = log_pages->next;
+				// Maintain the log page ring
 				Block_manager::instance()->invalidate(&victim->address, LOG);
 				delete victim;
 
-				// Create new LogPageBlock and append it to the log_pages list.
+				// Create new LogPageBlock in place of the victim. It is the youngest in the ring.
 				LogPageBlock *newLPB = new LogPageBlock();
 				newLPB->address = Block_manager::instance()->get_free_block(LOG, event);
 
-				LogPageBlock *next = log_pages;
-				while (next->next != NULL) next = next->next;
-
-				next->next = newLPB;
+				log_ring[log_head] = newLPB;
+				log_head = (log_head + 1) % FAST_LOG_BLOCK_LIMIT;
 
 				log_page_next -= BLOCK_SIZE;
 			}
 
 			// Append data to the RW log blocks.
-			LogPageBlock *victim = log_pages;
-			while (victim->numPages == (int)BLOCK_SIZE)
-				victim = victim->next;
+			long slot = ((log_head + log_page_next / BLOCK_SIZE) % FAST_LOG_BLOCK_LIMIT) * BLOCK_SIZE + log_page_next % BLOCK_SIZE;
+			LogPageBlock *current = slot_block(slot);
 
-			victim->aPages[log_page_next % BLOCK_SIZE] = event.get_logical_address();
-			victim->numPages++;
+			link_log_page(slot, event.get_logical_address());
+			current->numPages++;
 
-			Address rw = victim->address;
+			Address rw = current->address;
 			rw.valid = PAGE;
-			rw += log_page_next % BLOCK_SIZE;
+			rw += slot % BLOCK_SIZE;
 			event.set_address(rw);
 
 			log_page_next++;
@@ -581,8 +680,18 @@ bool FtlImpl_Fast::write_to_log_block(Event &event, long logicalBlockAddress)
 	return true;
 }
 
-void FtlImpl_Fast::update_map_block(Event &event)
+/*
+ * Persist the block map entry of a logical block. Without a map directory
+ * the update is simulated as a single write.
+ */
+void FtlImpl_Fast::update_map_block(Event &event, long lbn)
 {
+	if (MAP_DIRECTORY_SIZE > 0)
+	{
+		Block_manager::instance()->update_map_directory(event, lbn);
+		return;
+	}
+
 	Event writeEvent = Event(WRITE, event.get_logical_address(), 1, event.get_start_time());
 	writeEvent.set_address(Address(0, PAGE));
 	writeEvent.set_noop(true);
@@ -591,13 +700,88 @@ void FtlImpl_Fast::update_map_block(Event &event)
 
 	event.incr_time_taken(writeEvent.get_time_taken());
 
-	controller.stats.numGCWrite++;
+	controller.stats.numMapWrite++;
 	controller.stats.numFTLWrite++;
 }
 
 
 void FtlImpl_Fast::print_ftl_statistics()
 {
+	printf("FAST sequential log blocks:\n");
+	for (uint i=0;i<FAST_SEQUENTIAL_LOG_BLOCKS;i++)
+		printf(" SW %u: Switches: %lu Merges: %lu\n", i, seq_logs[i].switches, seq_logs[i].merges);
+
 	Block_manager::instance()->print_statistics();
 }
 
+
+/*
+ * Save or load the block map, the log blocks and the log page index. The
+ * RW log blocks are taken from the block manager on the first write, so a
+ * checkpoint taken before that has none.
+ */
+void FtlImpl_Fast::checkpoint(Checkpoint &cp)
+{
+	cp.section("fast");
+
+	cp.array(data_list, NUMBER_OF_ADDRESSABLE_BLOCKS);
+	cp.array(pin_list, NUMBER_OF_ADDRESSABLE_BLOCKS*BLOCK_SIZE);
+
+	for (uint i=0;i<FAST_SEQUENTIAL_LOG_BLOCKS;i++)
+	{
+		cp.value(seq_logs[i].lbn);
+		cp.address(seq_logs[i].address);
+		cp.value(seq_logs[i].offset);
+		cp.value(seq_logs[i].lastUse);
+		cp.value(seq_logs[i].switches);
+		cp.value(seq_logs[i].merges);
+	}
+	cp.value(seq_clock);
+	cp.value(log_page_next);
+
+	bool ring = log_ring != NULL;
+	cp.value(ring);
+	if (ring)
+	{
+		if (log_ring == NULL)
+		{
+			log_ring = new LogPageBlock*[FAST_LOG_BLOCK_LIMIT];
+			for (uint i=0;i<FAST_LOG_BLOCK_LIMIT;i++)
+				log_ring[i] = new LogPageBlock();
+		}
+
+		for (uint i=0;i<FAST_LOG_BLOCK_LIMIT;i++)
+			log_ring[i]->checkpoint(cp);
+	}
+	else if (log_ring != NULL)
+	{
+		for (uint i=0;i<FAST_LOG_BLOCK_LIMIT;i++)
+			delete log_ring[i];
+		delete [] log_ring;
+		log_ring = NULL;
+	}
+	cp.value(log_head);
+
+	lpn_index.checkpoint(cp);
+	lbn_index.checkpoint(cp);
+	cp.array(slot_next, FAST_LOG_BLOCK_LIMIT*BLOCK_SIZE);
+	cp.array(slot_prev, FAST_LOG_BLOCK_LIMIT*BLOCK_SIZE);
+}
+
+/*
+ * Precondition to the merged state. The log blocks are taken on the first
+ * write as usual.
+ */
+enum status FtlImpl_Fast::precondition(Precondition &state)
+{
+	if (state.run_block_mapped() == FAILURE)
+		return FAILURE;
+
+	for (uint lbn=0;lbn<NUMBER_OF_ADDRESSABLE_BLOCKS;lbn++)
+		data_list[lbn] = state.map[(ulong)lbn * BLOCK_SIZE];
+
+	for (ulong lpn=0;lpn<(ulong)NUMBER_OF_ADDRESSABLE_BLOCKS*BLOCK_SIZE;lpn++)
+		pin_list[lpn] = state.map[lpn] != -1;
+
+	return SUCCESS;
+}
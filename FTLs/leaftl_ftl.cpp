@@ -0,0 +1,593 @@
+/* Copyright 2011 Matias Bjørling */
+
+/* leaftl_ftl.cpp  */
+
+/* FlashSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version. */
+
+/* FlashSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. */
+
+/* You should have received a copy of the GNU General Public License
+ * along with FlashSim.  If not, see <http://www.gnu.org/licenses/>. */
+
+/****************************************************************************/
+
+/* Implementation of the learned page map described in the paper
+ * "LeaFTL: A Learning-Based Flash Translation Layer for Solid-State Drives"
+ *
+ * Mapping updates are buffered and learned into segments. A segment maps
+ * the LPNs [start, end] with ppn = intercept + slope * (lpn - start) and
+ * predicts the PPN of each LPN it learned within LEAFTL_GAMMA pages.
+ *
+ * Segments are kept in levels. A new segment goes into the top level and
+ * pushes the older segments it overlaps one level down. A lookup walks
+ * the levels top-down and verifies the predicted PPN against the LPN in
+ * the OOB area of the flash page. The OOB area also holds the LPNs of
+ * the pages within the error bound, so a misprediction costs one extra
+ * flash read.
+ *
+ * Segments that lost most of their mappings are retrained during GC.
+ */
+
+#include <new>
+#include <assert.h>
+#include <stdio.h>
+#include <math.h>
+#include <limits>
+#include <algorithm>
+#include "../ssd.h"
+
+using namespace ssd;
+
+FtlImpl_LeaFtl::FtlImpl_LeaFtl(Controller &controller):
+	FtlParent(controller)
+{
+	uint ssdSize = NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE;
+
+	currentDataPage = -1;
+	addressBytes = ceil(ceil(log(ssdSize)/log(2)) / 8.0);
+
+	oob_lpn = new long[ssdSize];
+	owner = new int[ssdSize];
+	for (uint i=0;i<ssdSize;i++)
+	{
+		oob_lpn[i] = -1;
+		owner[i] = -1;
+	}
+
+	numLookups = 0;
+	numLevelsProbed = 0;
+	numMispredictions = 0;
+	numFalseProbes = 0;
+	numBufferHits = 0;
+	numRetrained = 0;
+
+	printf("Total size to map: %uKB\n", ssdSize * PAGE_SIZE / 1024);
+	printf("Using LeaFTL. Error bound: %u Buffer: %u mappings\n", LEAFTL_GAMMA, LEAFTL_BUFFER_SIZE);
+	return;
+}
+
+FtlImpl_LeaFtl::~FtlImpl_LeaFtl(void)
+{
+	delete[] oob_lpn;
+	delete[] owner;
+	return;
+}
+
+long FtlImpl_LeaFtl::predict(const Segment &segment, long lpn) const
+{
+	return segment.intercept + lround(segment.slope * (lpn - segment.start));
+}
+
+/*
+ * True if the valid flash page ppn holds lpn.
+ */
+bool FtlImpl_LeaFtl::in_oob(long ppn, long lpn)
+{
+	if (ppn < 0 || ppn >= (long)(NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE) || oob_lpn[ppn] != lpn)
+		return false;
+
+	Address address = Address(ppn, PAGE);
+	return get_block_pointer(address)->get_state(address.page) == VALID;
+}
+
+void FtlImpl_LeaFtl::read_oob_page(Event &event)
+{
+	// Simulate the read of a flash page to get at its OOB area.
+	Event readEvent = Event(READ, event.get_logical_address(), 1, event.get_start_time());
+	readEvent.set_address(Address(0, PAGE));
+	readEvent.set_noop(true);
+
+	if (controller.issue(readEvent) == FAILURE) { assert(false);}
+	event.incr_time_taken(readEvent.get_time_taken());
+	controller.stats.numFTLRead++;
+}
+
+/*
+ * Find the PPN of lpn, or -1 if it is not mapped.
+ */
+long FtlImpl_LeaFtl::lookup(Event &event, long lpn)
+{
+	numLookups++;
+
+	std::map<long, long>::const_iterator b = buffer.find(lpn);
+	if (b != buffer.end())
+	{
+		event.incr_time_taken(RAM_READ_DELAY);
+		controller.stats.numMemoryRead++;
+		numBufferHits++;
+		return (*b).second;
+	}
+
+	for (uint level=0;level<levels.size();level++)
+	{
+		event.incr_time_taken(RAM_READ_DELAY);
+		controller.stats.numMemoryRead++;
+		numLevelsProbed++;
+
+		std::map<long, int>::const_iterator it = levels[level].upper_bound(lpn);
+		if (it == levels[level].begin())
+			continue;
+
+		--it;
+		const Segment &segment = segments[(*it).second];
+		if (segment.end < lpn)
+			continue;
+
+		long ppn = predict(segment, lpn);
+		if (in_oob(ppn, lpn))
+			return ppn;
+
+		// The predicted page tells where its neighbours belong.
+		read_oob_page(event);
+
+		for (long d=-(long)LEAFTL_GAMMA;d<=(long)LEAFTL_GAMMA;d++)
+		{
+			if (in_oob(ppn + d, lpn))
+			{
+				numMispredictions++;
+				return ppn + d;
+			}
+		}
+
+		// The lpn lies between the mappings of the segment.
+		numFalseProbes++;
+	}
+
+	return -1;
+}
+
+/*
+ * The current mapping of lpn is replaced. Drop it from the segment
+ * that learned it.
+ */
+void FtlImpl_LeaFtl::drop_mapping(long lpn)
+{
+	buffer.erase(lpn);
+
+	int id = owner[lpn];
+	if (id == -1)
+		return;
+
+	owner[lpn] = -1;
+
+	Segment &segment = segments[id];
+	segment.live--;
+
+	if (segment.live == 0)
+		remove_segment(id);
+	else if (segment.live * 2 < segment.learned)
+		retrain.insert(id);
+}
+
+void FtlImpl_LeaFtl::buffer_mapping(long lpn, long ppn)
+{
+	drop_mapping(lpn);
+
+	oob_lpn[ppn] = lpn;
+	buffer[lpn] = ppn;
+}
+
+/*
+ * Learn the buffered mappings into segments.
+ */
+void FtlImpl_LeaFtl::learn_segments(Event &event)
+{
+	if (buffer.empty())
+		return;
+
+	std::vector<std::pair<long, long> > points(buffer.begin(), buffer.end());
+	buffer.clear();
+
+	uint before = segments.size() - free_segments.size();
+	learn(points);
+	uint after = segments.size() - free_segments.size();
+
+	if (after > before)
+	{
+		event.incr_time_taken((after - before) * RAM_WRITE_DELAY);
+		controller.stats.numMemoryWrite += after - before;
+	}
+}
+
+/*
+ * Greedy piecewise-linear fit of points sorted by lpn. A segment is
+ * extended as long as a slope exists that keeps every point within
+ * LEAFTL_GAMMA of the line through its first point. Segments are not
+ * stretched over holes wider than the error bound, as lookups of the
+ * LPNs in the hole would probe them in vain.
+ */
+void FtlImpl_LeaFtl::learn(const std::vector<std::pair<long, long> > &points)
+{
+	uint i = 0;
+	while (i < points.size())
+	{
+		long x0 = points[i].first;
+		long y0 = points[i].second;
+		double lo = -std::numeric_limits<double>::max();
+		double hi = std::numeric_limits<double>::max();
+
+		uint j = i + 1;
+		for (;j<points.size();j++)
+		{
+			long x = points[j].first;
+			long y = points[j].second;
+
+			if (x - points[j-1].first > (long)LEAFTL_GAMMA + 1 || x - x0 > 65535)
+				break;
+
+			double l = (double)(y - y0 - (long)LEAFTL_GAMMA) / (x - x0);
+			double h = (double)(y - y0 + (long)LEAFTL_GAMMA) / (x - x0);
+
+			if (std::max(lo, l) > std::min(hi, h))
+				break;
+
+			lo = std::max(lo, l);
+			hi = std::min(hi, h);
+		}
+
+		double slope = (j == i + 1) ? 0 : (lo + hi) / 2;
+		int id = new_segment(x0, points[j-1].first, y0, slope, j - i);
+
+		for (uint k=i;k<j;k++)
+		{
+			assert(labs(predict(segments[id], points[k].first) - points[k].second) <= (long)LEAFTL_GAMMA);
+			owner[points[k].first] = id;
+		}
+
+		insert_segment(id, 0);
+		i = j;
+	}
+}
+
+int FtlImpl_LeaFtl::new_segment(long start, long end, long intercept, double slope, uint learned)
+{
+	int id;
+	if (free_segments.empty())
+	{
+		id = segments.size();
+		segments.push_back(Segment());
+	}
+	else
+	{
+		id = free_segments.back();
+		free_segments.pop_back();
+	}
+
+	Segment &segment = segments[id];
+	segment.start = start;
+	segment.end = end;
+	segment.intercept = intercept;
+	segment.slope = slope;
+	segment.level = 0;
+	segment.learned = learned;
+	segment.live = learned;
+
+	return id;
+}
+
+/*
+ * Place a segment in level and push the segments it overlaps one level
+ * down. Segments within a level never overlap.
+ */
+void FtlImpl_LeaFtl::insert_segment(int id, uint level)
+{
+	if (level == levels.size())
+		levels.push_back(std::map<long, int>());
+
+	std::map<long, int> &lvl = levels[level];
+	std::vector<int> pushed;
+
+	while (!lvl.empty())
+	{
+		std::map<long, int>::iterator it = lvl.upper_bound(segments[id].end);
+		if (it == lvl.begin())
+			break;
+
+		--it;
+		if (segments[(*it).second].end < segments[id].start)
+			break;
+
+		pushed.push_back((*it).second);
+		lvl.erase(it);
+	}
+
+	lvl[segments[id].start] = id;
+	segments[id].level = level;
+
+	for (uint i=0;i<pushed.size();i++)
+		insert_segment(pushed[i], level + 1);
+}
+
+void FtlImpl_LeaFtl::remove_segment(int id)
+{
+	levels[segments[id].level].erase(segments[id].start);
+	free_segments.push_back(id);
+	retrain.erase(id);
+
+	while (!levels.empty() && levels.back().empty())
+		levels.pop_back();
+}
+
+/*
+ * Relearn the remaining mappings of segments where most mappings were
+ * replaced. The PPNs are recovered through the OOB area.
+ */
+void FtlImpl_LeaFtl::retrain_segments(Event &event)
+{
+	while (!retrain.empty())
+	{
+		int id = *retrain.begin();
+		Segment segment = segments[id];
+
+		std::vector<std::pair<long, long> > points;
+		points.reserve(segment.live);
+
+		read_oob_page(event);
+
+		for (long lpn=segment.start;lpn<=segment.end;lpn++)
+		{
+			if (owner[lpn] != id)
+				continue;
+
+			long ppn = predict(segment, lpn);
+			long d = 0;
+			while (!in_oob(ppn + d, lpn))
+			{
+				d = (d > 0) ? -d : -d + 1;
+				assert(labs(d) <= (long)LEAFTL_GAMMA);
+			}
+
+			points.push_back(std::make_pair(lpn, ppn + d));
+		}
+
+		remove_segment(id);
+		learn(points);
+		numRetrained++;
+
+		event.incr_time_taken(RAM_WRITE_DELAY);
+		controller.stats.numMemoryWrite++;
+	}
+}
+
+long FtlImpl_LeaFtl::get_free_data_page(Event &event, bool insert_events)
+{
+	if (currentDataPage == -1 || (currentDataPage % BLOCK_SIZE == BLOCK_SIZE -1 && insert_events))
+		Block_manager::instance()->insert_events(event);
+
+	if (currentDataPage == -1 || currentDataPage % BLOCK_SIZE == BLOCK_SIZE -1)
+		currentDataPage = Block_manager::instance()->get_free_block(DATA, event).get_linear_address();
+	else
+		currentDataPage++;
+
+	return currentDataPage;
+}
+
+ulong FtlImpl_LeaFtl::segment_bytes() const
+{
+	// Start LPN and intercept PPN, a 2 byte length and a 4 byte slope.
+	return (segments.size() - free_segments.size()) * (2 * addressBytes + 6);
+}
+
+enum status FtlImpl_LeaFtl::read(Event &event)
+{
+	long ppn = lookup(event, event.get_logical_address());
+
+	if (ppn == -1)
+	{
+		event.set_address(Address(0, PAGE));
+		event.set_noop(true);
+	}
+	else
+		event.set_address(Address(ppn, PAGE));
+
+	controller.stats.numFTLRead++;
+
+	return controller.issue(event);
+}
+
+enum status FtlImpl_LeaFtl::write(Event &event)
+{
+	long lpn = event.get_logical_address();
+
+	// Important order. GC in get_free_data_page might move the current page.
+	long free_page = get_free_data_page(event, true);
+
+	long ppn = lookup(event, lpn);
+	if (ppn != -1)
+		event.set_replace_address(Address(ppn, PAGE));
+
+	buffer_mapping(lpn, free_page);
+
+	if (buffer.size() >= LEAFTL_BUFFER_SIZE)
+		learn_segments(event);
+
+	event.set_address(Address(free_page, PAGE));
+
+	controller.stats.numFTLWrite++;
+
+	return controller.issue(event);
+}
+
+enum status FtlImpl_LeaFtl::trim(Event &event)
+{
+	long lpn = event.get_logical_address();
+
+	event.set_address(Address(0, PAGE));
+
+	long ppn = lookup(event, lpn);
+
+	if (ppn != -1)
+	{
+		Address address = Address(ppn, PAGE);
+		Block *block = controller.get_block_pointer(address);
+		block->invalidate_page(address.page);
+
+		drop_mapping(lpn);
+	}
+
+	controller.stats.numFTLTrim++;
+
+	return controller.issue(event);
+}
+
+void FtlImpl_LeaFtl::cleanup_block(Event &event, Block *block)
+{
+	cleanup_blocks(event, std::vector<Block*>(1, block));
+}
+
+void FtlImpl_LeaFtl::cleanup_blocks(Event &event, const std::vector<Block*> &blocks)
+{
+	// (lpn, old ppn) of the valid pages, in LPN order with GC_SORT_BY_LPN.
+	std::vector<std::pair<long, long> > pages;
+	pages.reserve(blocks.size() * BLOCK_SIZE);
+
+	for (uint b=0;b<blocks.size();b++)
+	{
+		for (uint i=0;i<BLOCK_SIZE;i++)
+		{
+			assert(blocks[b]->get_state(i) != EMPTY);
+
+			long ppn = blocks[b]->get_physical_address()+i;
+			if (blocks[b]->get_state(i) == VALID)
+			{
+				pages.push_back(std::make_pair(oob_lpn[ppn], ppn));
+				controller.stats.numMemoryRead++;
+			}
+		}
+	}
+
+	if (GC_SORT_BY_LPN > 0)
+		std::sort(pages.begin(), pages.end());
+
+	for (uint i=0;i<pages.size();i++)
+	{
+		long oldPpn = pages[i].second;
+
+		Event readEvent = Event(READ, event.get_logical_address(), 1, event.get_start_time());
+		readEvent.set_address(Address(oldPpn, PAGE));
+
+		if (controller.issue(readEvent) == FAILURE)
+			printf("Data block copy failed.");
+
+		Event writeEvent = Event(WRITE, event.get_logical_address(), 1, event.get_start_time()+readEvent.get_time_taken());
+		Address dataBlockAddress = Address(get_free_data_page(event, false), PAGE);
+
+		writeEvent.set_address(dataBlockAddress);
+		writeEvent.set_replace_address(Address(oldPpn, PAGE));
+
+		// Setup the write event to read from the right place.
+		writeEvent.set_payload((char*)page_data + oldPpn * PAGE_SIZE);
+
+		if (controller.issue(writeEvent) == FAILURE)
+			printf("Data block copy failed.");
+
+		event.incr_time_taken(writeEvent.get_time_taken() + readEvent.get_time_taken());
+
+		buffer_mapping(pages[i].first, dataBlockAddress.get_linear_address());
+
+		controller.stats.numFTLRead++;
+		controller.stats.numFTLWrite++;
+		controller.stats.numWLRead++;
+		controller.stats.numWLWrite++;
+	}
+
+	// Learn the relocated mappings together and retrain segments that
+	// lost most of their mappings.
+	learn_segments(event);
+	retrain_segments(event);
+}
+
+void FtlImpl_LeaFtl::print_ftl_statistics()
+{
+	ulong pageMap = (ulong)NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE * addressBytes;
+
+	controller.stats.numMemoryTranslation = segment_bytes();
+	controller.stats.numMemoryCache = LEAFTL_BUFFER_SIZE * 2 * addressBytes;
+
+	printf("LeaFTL:\n");
+	printf(" Segments: %lu Levels: %lu Retrained: %lu\n", (ulong)(segments.size() - free_segments.size()), (ulong)levels.size(), numRetrained);
+	printf(" Mapping memory: Segments: %lu bytes Buffer: %lu bytes Page map: %lu bytes\n", segment_bytes(), (ulong)controller.stats.numMemoryCache, pageMap);
+	printf(" Lookups: %lu Buffer hits: %lu Levels per lookup: %f Mispredictions: %lu False probes: %lu\n", numLookups, numBufferHits, numLookups ? (double)numLevelsProbed / numLookups : 0.0, numMispredictions, numFalseProbes);
+	Block_manager::instance()->print_statistics();
+}
+
+void FtlImpl_LeaFtl::checkpoint(Checkpoint &cp)
+{
+	cp.section("leaftl");
+
+	uint ssdSize = NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE;
+
+	cp.map(buffer);
+	cp.vector(segments);
+	cp.vector(free_segments);
+
+	ulong count = levels.size();
+	cp.value(count);
+	levels.resize(count);
+	for (ulong i=0;i<count;i++)
+		cp.map(levels[i]);
+
+	cp.sequence(retrain);
+	cp.array(oob_lpn, ssdSize);
+	cp.array(owner, ssdSize);
+
+	cp.value(currentDataPage);
+	cp.value(numLookups);
+	cp.value(numLevelsProbed);
+	cp.value(numMispredictions);
+	cp.value(numFalseProbes);
+	cp.value(numBufferHits);
+	cp.value(numRetrained);
+}
+
+/*
+ * Precondition through the page level model and learn the resulting map
+ * as a single level of segments.
+ */
+enum status FtlImpl_LeaFtl::precondition(Precondition &state)
+{
+	if (state.run_page_mapped(std::vector<int>(1, -1), false) == FAILURE)
+		return FAILURE;
+
+	uint ssdSize = NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE;
+
+	std::vector<std::pair<long, long> > points;
+	for (uint lpn=0;lpn<ssdSize;lpn++)
+		if (state.map[lpn] != -1)
+		{
+			points.push_back(std::make_pair((long)lpn, state.map[lpn]));
+			oob_lpn[state.map[lpn]] = lpn;
+		}
+
+	learn(points);
+
+	currentDataPage = state.frontiers[0];
+
+	return SUCCESS;
+}
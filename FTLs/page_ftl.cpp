@@ -17,12 +17,24 @@
 
 /****************************************************************************/
 
-/* Implements a very simple page-level FTL without merge */
+/* Implementation of an ideal page-level FTL
+ *
+ * The complete logical to physical page map is kept in DRAM, so every
+ * lookup costs one RAM access and no translation pages are written. It is
+ * the upper bound for the demand based FTLs (DFTL, BDFTL, LeaFTL).
+ *
+ * Writes are spread round robin over PAGE_WRITE_FRONTIERS open data
+ * blocks, each allocated in its own die, so consecutive writes can be
+ * served by the dies in parallel. Valid pages of GC victims are relocated
+ * to a separate open block, keeping them apart from the host writes.
+ * Victims are chosen greedily by the block manager.
+ */
 
 #include <new>
 #include <assert.h>
 #include <stdio.h>
 #include <math.h>
+#include <algorithm>
 #include "../ssd.h"
 
 using namespace ssd;
@@ -30,23 +42,86 @@ using namespace ssd;
 FtlImpl_Page::FtlImpl_Page(Controller &controller):
 	FtlParent(controller)
 {
-	trim_map = new bool[NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE];
+	uint ssdSize = NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE;
+
+	addressBytes = ceil(ceil(log(ssdSize)/log(2)) / 8.0);
+
+	map = new long[ssdSize];
+	reverse_map = new long[ssdSize];
+	for (uint i=0;i<ssdSize;i++)
+	{
+		map[i] = -1;
+		reverse_map[i] = -1;
+	}
+
+	uint numFrontiers = PAGE_WRITE_FRONTIERS;
+	if (numFrontiers == 0)
+		numFrontiers = SSD_SIZE * PACKAGE_SIZE * DIE_SIZE;
+
+	frontiers.resize(numFrontiers, -1);
+	nextFrontier = 0;
+	gcFrontier = -1;
+	gcDie = 0;
 
 	numPagesActive = 0;
 
+	printf("Total size to map: %uKB\n", ssdSize * PAGE_SIZE / 1024);
+	printf("Using page FTL. Write frontiers: %u Page map: %lu bytes\n", numFrontiers, (ulong)ssdSize * addressBytes);
 	return;
 }
 
 FtlImpl_Page::~FtlImpl_Page(void)
 {
-
+	delete[] map;
+	delete[] reverse_map;
 	return;
 }
 
+/*
+ * Next free page of an open block. A new block is taken from the die when
+ * the block is full. Only host writes may start GC.
+ */
+long FtlImpl_Page::get_free_data_page(Event &event, long &frontier, uint die, bool insert_events)
+{
+	if (frontier == -1 || (frontier % BLOCK_SIZE == BLOCK_SIZE -1 && insert_events))
+		Block_manager::instance()->insert_events(event);
+
+	if (frontier == -1 || frontier % BLOCK_SIZE == BLOCK_SIZE -1)
+		frontier = Block_manager::instance()->get_free_block(DATA, event, die).get_linear_address();
+	else
+		frontier++;
+
+	return frontier;
+}
+
+long FtlImpl_Page::lookup(Event &event, long lpn)
+{
+	event.incr_time_taken(RAM_READ_DELAY);
+	controller.stats.numMemoryRead++;
+
+	return map[lpn];
+}
+
+void FtlImpl_Page::update_mapping(Event &event, long lpn, long ppn)
+{
+	map[lpn] = ppn;
+	reverse_map[ppn] = lpn;
+
+	event.incr_time_taken(RAM_WRITE_DELAY);
+	controller.stats.numMemoryWrite++;
+}
+
 enum status FtlImpl_Page::read(Event &event)
 {
-	event.set_address(Address(0, PAGE));
-	event.set_noop(true);
+	long ppn = lookup(event, event.get_logical_address());
+
+	if (ppn == -1)
+	{
+		event.set_address(Address(0, PAGE));
+		event.set_noop(true);
+	}
+	else
+		event.set_address(Address(ppn, PAGE));
 
 	controller.stats.numFTLRead++;
 
@@ -55,65 +130,179 @@ enum status FtlImpl_Page::read(Event &event)
 
 enum status FtlImpl_Page::write(Event &event)
 {
-	event.set_address(Address(1, PAGE));
-	event.set_noop(true);
-
-	controller.stats.numFTLWrite++;
-
-	if (numPagesActive == NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE)
-	{
-		numPagesActive -= BLOCK_SIZE;
+	long lpn = event.get_logical_address();
 
-		Event eraseEvent = Event(ERASE, event.get_logical_address(), 1, event.get_start_time());
-		eraseEvent.set_address(Address(0, PAGE));
+	uint frontier = nextFrontier;
+	nextFrontier = (nextFrontier + 1) % frontiers.size();
 
-		if (controller.issue(eraseEvent) == FAILURE) printf("Erase failed");
+	// Important order. GC in get_free_data_page might move the current page.
+	long free_page = get_free_data_page(event, frontiers[frontier], frontier % Block_manager::instance()->get_num_dies(), true);
 
-		event.incr_time_taken(eraseEvent.get_time_taken());
+	long ppn = lookup(event, lpn);
+	if (ppn != -1)
+		event.set_replace_address(Address(ppn, PAGE));
+	else
+		numPagesActive++;
 
-		controller.stats.numFTLErase++;
-	}
+	update_mapping(event, lpn, free_page);
 
-	numPagesActive++;
+	event.set_address(Address(free_page, PAGE));
 
+	controller.stats.numFTLWrite++;
 
 	return controller.issue(event);
 }
 
 enum status FtlImpl_Page::trim(Event &event)
 {
+	long lpn = event.get_logical_address();
+
+	event.set_address(Address(0, PAGE));
+
+	long ppn = lookup(event, lpn);
+
+	if (ppn != -1)
+	{
+		Address address = Address(ppn, PAGE);
+		Block *block = controller.get_block_pointer(address);
+		block->invalidate_page(address.page);
+
+		map[lpn] = -1;
+		reverse_map[ppn] = -1;
+		numPagesActive--;
+
+		event.incr_time_taken(RAM_WRITE_DELAY);
+		controller.stats.numMemoryWrite++;
+	}
+
 	controller.stats.numFTLTrim++;
 
-	uint dlpn = event.get_logical_address();
+	return controller.issue(event);
+}
 
-	if (!trim_map[event.get_logical_address()])
-		trim_map[event.get_logical_address()] = true;
+void FtlImpl_Page::cleanup_block(Event &event, Block *block)
+{
+	cleanup_blocks(event, std::vector<Block*>(1, block));
+}
+
+void FtlImpl_Page::cleanup_blocks(Event &event, const std::vector<Block*> &blocks)
+{
+	// (lpn, old ppn) of the valid pages, in LPN order with GC_SORT_BY_LPN.
+	std::vector<std::pair<long, long> > pages;
+	pages.reserve(blocks.size() * BLOCK_SIZE);
 
-	// Update trim map and update block map if all pages are trimmed. i.e. the state are reseted to optimal.
-	long addressStart = dlpn - dlpn % BLOCK_SIZE;
-	bool allTrimmed = true;
-	for (uint i=addressStart;i<addressStart+BLOCK_SIZE;i++)
+	for (uint b=0;b<blocks.size();b++)
 	{
-		if (!trim_map[i])
-			allTrimmed = false;
+		for (uint i=0;i<BLOCK_SIZE;i++)
+		{
+			assert(blocks[b]->get_state(i) != EMPTY);
+
+			long ppn = blocks[b]->get_physical_address()+i;
+			if (blocks[b]->get_state(i) == VALID)
+			{
+				assert(reverse_map[ppn] != -1 && map[reverse_map[ppn]] == ppn);
+				pages.push_back(std::make_pair(reverse_map[ppn], ppn));
+				controller.stats.numMemoryRead++;
+			}
+		}
 	}
 
-	if (allTrimmed)
+	if (GC_SORT_BY_LPN > 0)
+		std::sort(pages.begin(), pages.end());
+
+	for (uint i=0;i<pages.size();i++)
 	{
-		Event eraseEvent = Event(ERASE, event.get_logical_address(), 1, event.get_start_time());
-		eraseEvent.set_address(Address(0, PAGE));
+		long oldPpn = pages[i].second;
+
+		Event readEvent = Event(READ, event.get_logical_address(), 1, event.get_start_time());
+		readEvent.set_address(Address(oldPpn, PAGE));
+
+		if (controller.issue(readEvent) == FAILURE)
+			printf("Data block copy failed.");
+
+		// Relocated pages go to their own open block, taken from the dies in turn.
+		if (gcFrontier == -1 || gcFrontier % BLOCK_SIZE == BLOCK_SIZE -1)
+			gcDie = (gcDie + 1) % Block_manager::instance()->get_num_dies();
+
+		Event writeEvent = Event(WRITE, event.get_logical_address(), 1, event.get_start_time()+readEvent.get_time_taken());
+		Address dataBlockAddress = Address(get_free_data_page(event, gcFrontier, gcDie, false), PAGE);
 
-		if (controller.issue(eraseEvent) == FAILURE) printf("Erase failed");
+		writeEvent.set_address(dataBlockAddress);
+		writeEvent.set_replace_address(Address(oldPpn, PAGE));
 
-		event.incr_time_taken(eraseEvent.get_time_taken());
+		// Setup the write event to read from the right place.
+		writeEvent.set_payload((char*)page_data + oldPpn * PAGE_SIZE);
 
-		for (uint i=addressStart;i<addressStart+BLOCK_SIZE;i++)
-			trim_map[i] = false;
+		if (controller.issue(writeEvent) == FAILURE)
+			printf("Data block copy failed.");
 
-		controller.stats.numFTLErase++;
+		event.incr_time_taken(writeEvent.get_time_taken() + readEvent.get_time_taken());
 
-		numPagesActive -= BLOCK_SIZE;
+		reverse_map[oldPpn] = -1;
+		update_mapping(event, pages[i].first, dataBlockAddress.get_linear_address());
+
+		controller.stats.numFTLRead++;
+		controller.stats.numFTLWrite++;
+		controller.stats.numWLRead++;
+		controller.stats.numWLWrite++;
 	}
+}
+
+void FtlImpl_Page::print_ftl_statistics()
+{
+	ulong pageMap = (ulong)NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE * addressBytes;
+
+	controller.stats.numMemoryTranslation = pageMap;
+
+	printf("Page FTL:\n");
+	printf(" Write frontiers: %lu Mapped pages: %lu\n", (ulong)frontiers.size(), numPagesActive);
+	printf(" Mapping memory: Page map: %lu bytes\n", pageMap);
+	Block_manager::instance()->print_statistics();
+}
+
+void FtlImpl_Page::checkpoint(Checkpoint &cp)
+{
+	cp.section("page");
+
+	uint ssdSize = NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE;
+
+	cp.array(map, ssdSize);
+	cp.array(reverse_map, ssdSize);
+	cp.vector(frontiers);
+	cp.value(nextFrontier);
+	cp.value(gcFrontier);
+	cp.value(gcDie);
+	cp.value(numPagesActive);
+}
+
+/*
+ * Precondition through the page level model, with a frontier per die as
+ * write uses them and relocation to the GC frontier.
+ */
+enum status FtlImpl_Page::precondition(Precondition &state)
+{
+	std::vector<int> dies;
+	for (uint i=0;i<frontiers.size();i++)
+		dies.push_back(i % Block_manager::instance()->get_num_dies());
+
+	if (state.run_page_mapped(dies, true) == FAILURE)
+		return FAILURE;
+
+	uint ssdSize = NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE;
+
+	numPagesActive = 0;
+	for (uint i=0;i<ssdSize;i++)
+	{
+		map[i] = state.map[i];
+		reverse_map[i] = state.reverse[i];
+		if (map[i] != -1)
+			numPagesActive++;
+	}
+
+	frontiers = state.frontiers;
+	nextFrontier = state.hostWrites % frontiers.size();
+	gcFrontier = state.gcFrontier;
+	gcDie = state.gcDie;
 
 	return SUCCESS;
 }
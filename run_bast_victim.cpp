@@ -0,0 +1,80 @@
+/* BAST log block victim check
+ *
+ * Replays one workload on BAST with random and with cheapest merge victim
+ * selection (BAST_LOG_VICTIM 0 and 3). The workload needs all three
+ * merges: a few sequential streams, some of which stop part way through a
+ * block, interleaved with random writes. Exits with 1 if the workload
+ * does not produce switches, partial and full merges, or if the cheapest
+ * merge erases more blocks than random victims.
+ *
+ * Usage: bast_victim [config] */
+
+#include "ssd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace ssd;
+
+static const uint STREAMS = 4;
+static const uint WRITES = 100000;
+
+// Percentage of random writes, and of blocks a stream leaves part way
+static const uint RANDOM_WRITES = 10;
+static const uint STREAM_STOPS = 10;
+
+static Stats replay(const char *config_name, uint victim)
+{
+	SimConfig config(config_name);
+	config.set("FTL_IMPLEMENTATION", 1);
+	config.set("BAST_LOG_BLOCK_LIMIT", 16);
+	config.set("BAST_LOG_VICTIM", victim);
+	config.set("PLANE_SIZE", 64);
+	config.set("PAGE_ENABLE_DATA", 0);
+	config.set("WRITE_BUFFER_SIZE", 0);
+	config.set("FUNCTIONAL_MODE", 1);
+	config.apply();
+
+	Ssd ssd;
+	ulong blocks = (ulong)NUMBER_OF_ADDRESSABLE_BLOCKS * 7 / 10;
+	std::vector<ulong> next(STREAMS);
+
+	srandom(1);
+	for (uint i=0;i<STREAMS;i++)
+		next[i] = (random() % blocks) * BLOCK_SIZE;
+
+	for (uint i=0;i<WRITES;i++)
+	{
+		if ((uint)(random() % 100) < RANDOM_WRITES)
+		{
+			ssd.event_arrive(WRITE, random() % (blocks * BLOCK_SIZE), 1, i);
+			continue;
+		}
+
+		uint s = random() % STREAMS;
+		ssd.event_arrive(WRITE, next[s]++, 1, i);
+
+		if (next[s] % BLOCK_SIZE == 0 || (uint)(random() % (100 * BLOCK_SIZE)) < STREAM_STOPS)
+			next[s] = (random() % blocks) * BLOCK_SIZE;
+	}
+
+	const Stats &stats = ssd.get_controller().stats;
+	printf("BAST_LOG_VICTIM %u: Writes: %li Erases: %li Switch: %li Partial: %li Full: %li\n", victim, stats.numFTLWrite, stats.numFTLErase, stats.numLogMergeSwitch, stats.numLogMergePartial, stats.numLogMergeFull);
+	return stats;
+}
+
+int main(int argc, char **argv)
+{
+	const char *config_name = argc > 1 ? argv[1] : "ssd.conf";
+
+	Stats randomPick = replay(config_name, 0);
+	Stats cheapestPick = replay(config_name, 3);
+
+	if (randomPick.numLogMergeSwitch == 0 || randomPick.numLogMergePartial == 0 || randomPick.numLogMergeFull == 0)
+	{
+		printf("The workload does not need all merge types.\n");
+		return 1;
+	}
+
+	return cheapestPick.numFTLErase < randomPick.numFTLErase ? 0 : 1;
+}
@@ -0,0 +1,221 @@
+/* Branching driver
+ *
+ * Ages one SSD, clones it once per branch trace and replays every branch
+ * on its own clone and thread. The aged state is built once: the SSD is
+ * preconditioned when PRECONDITION_FILL is set, then the warm-up trace is
+ * replayed functionally. The clones share the page data copy-on-write;
+ * the FTL maps and block state are copied into each clone.
+ *
+ * Usage: branch <config>[,NAME=VALUE...] <warm-up trace|-> <trace> ...
+ *
+ * Traces have the format of the sweep driver. The branches start where
+ * the warm-up ends, their arrival times are offset by the last arrival of
+ * the warm-up. The erases printed are those of the branch alone. */
+
+#include "ssd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+using namespace ssd;
+
+struct TraceEvent
+{
+	double time;
+	enum event_type type;
+	ulong lpn;
+	uint size;
+};
+
+struct BranchResult
+{
+	ulong reads;
+	ulong writes;
+	double readTime;
+	double writeTime;
+	long erases;
+};
+
+static double now(void)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static SimConfig parse_config(const char *spec)
+{
+	std::string s(spec);
+	size_t comma = s.find(',');
+	SimConfig config(s.substr(0, comma).c_str());
+
+	while (comma != std::string::npos)
+	{
+		size_t next = s.find(',', comma + 1);
+		std::string entry = s.substr(comma + 1, next == std::string::npos ? std::string::npos : next - comma - 1);
+		size_t eq = entry.find('=');
+		if (eq == std::string::npos)
+		{
+			fprintf(stderr, "Invalid config entry %s.\n", entry.c_str());
+			exit(-1);
+		}
+
+		std::string value = entry.substr(eq + 1);
+		char *end = NULL;
+		double number = strtod(value.c_str(), &end);
+		if (end != value.c_str() && *end == '\0')
+			config.set(entry.substr(0, eq).c_str(), number);
+		else
+			config.set_text(entry.substr(0, eq).c_str(), value.c_str());
+		comma = next;
+	}
+
+	return config;
+}
+
+static std::vector<TraceEvent> read_trace(const char *name)
+{
+	FILE *file = NULL;
+	if ((file = fopen(name, "r")) == NULL)
+	{
+		printf("Trace file %s cannot be read.\n", name);
+		exit(-1);
+	}
+
+	std::vector<TraceEvent> trace;
+	char line[128];
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		TraceEvent e;
+		char type;
+		if (sscanf(line, "%lf %c %lu %u", &e.time, &type, &e.lpn, &e.size) != 4)
+			continue;
+
+		if (type == 'R')
+			e.type = READ;
+		else if (type == 'W')
+			e.type = WRITE;
+		else if (type == 'T')
+			e.type = TRIM;
+		else
+			continue;
+
+		trace.push_back(e);
+	}
+	fclose(file);
+
+	return trace;
+}
+
+static void replay(Ssd &ssd, const std::vector<TraceEvent> &trace, double offset, BranchResult &result)
+{
+	ulong pages = (ulong)NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE;
+	long erases = ssd.get_controller().stats.numFTLErase;
+
+	result.reads = 0;
+	result.writes = 0;
+	result.readTime = 0;
+	result.writeTime = 0;
+
+	for (uint i=0;i<trace.size();i++)
+	{
+		const TraceEvent &e = trace[i];
+		if (e.size == 0 || e.size > pages)
+			continue;
+
+		ulong lpn = e.lpn % pages;
+		if (lpn + e.size > pages)
+			lpn = pages - e.size;
+
+		double time = ssd.event_arrive(e.type, lpn, e.size, offset + e.time);
+
+		if (e.type == READ)
+		{
+			result.reads++;
+			result.readTime += time;
+		}
+		else if (e.type == WRITE)
+		{
+			result.writes++;
+			result.writeTime += time;
+		}
+	}
+
+	result.erases = ssd.get_controller().stats.numFTLErase - erases;
+}
+
+static void run(Ssd *ssd, const SimConfig &config, const std::vector<TraceEvent> &trace, double offset, BranchResult &result)
+{
+	config.apply();
+	replay(*ssd, trace, offset, result);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 4)
+	{
+		printf("Usage: %s <config>[,NAME=VALUE...] <warm-up trace|-> <trace> ...\n", argv[0]);
+		exit(-1);
+	}
+
+	SimConfig config = parse_config(argv[1]);
+	Ssd ssd(config);
+
+	double begin = now();
+	if (PRECONDITION_FILL > 0 && ssd.precondition() == FAILURE)
+		exit(-1);
+
+	double offset = 0;
+	if (strcmp(argv[2], "-") != 0)
+	{
+		std::vector<TraceEvent> warmup = read_trace(argv[2]);
+		BranchResult result;
+
+		ssd.set_functional(true);
+		replay(ssd, warmup, 0, result);
+		ssd.set_functional(false);
+
+		if (!warmup.empty())
+			offset = warmup.back().time;
+	}
+	double aged = now() - begin;
+
+	std::vector<std::vector<TraceEvent> > traces;
+	for (int i=3;i<argc;i++)
+		traces.push_back(read_trace(argv[i]));
+
+	begin = now();
+	std::vector<Ssd *> clones;
+	for (uint i=0;i<traces.size();i++)
+	{
+		Ssd *clone = ssd.clone();
+		if (clone == NULL)
+			exit(-1);
+		clones.push_back(clone);
+	}
+	double cloned = now() - begin;
+
+	printf("Aged in %f s, cloned %lu branches in %f s.\n", aged, (ulong)clones.size(), cloned);
+
+	begin = now();
+	std::vector<BranchResult> results(traces.size());
+	std::vector<std::thread> threads;
+	for (uint i=0;i<traces.size();i++)
+		threads.push_back(std::thread(run, clones[i], std::cref(config), std::cref(traces[i]), offset, std::ref(results[i])));
+
+	for (uint i=0;i<threads.size();i++)
+		threads[i].join();
+	double branched = now() - begin;
+
+	printf("Branches ran in %f s.\n", branched);
+	printf("Trace;Reads;ReadTime;Writes;WriteTime;Erases\n");
+	for (uint i=0;i<traces.size();i++)
+	{
+		printf("%s;%lu;%f;%lu;%f;%li\n", argv[i + 3], results[i].reads, results[i].readTime, results[i].writes, results[i].writeTime, results[i].erases);
+		delete clones[i];
+	}
+
+	return 0;
+}
@@ -0,0 +1,56 @@
+/* DFTL cached mapping table accounting check
+ *
+ * Issues multi-page requests to a DFTL SSD and checks that every page of a
+ * request counts one CMT hit or one CMT fault: the mappings of the request
+ * are resolved together before its pages are served one by one, and the
+ * second pass must not count the lookups again. Exits with 1 if a request
+ * counts other hits or faults than expected.
+ *
+ * Usage: cmt [config] */
+
+#include "ssd.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace ssd;
+
+static const uint SIZE = 8;
+
+static uint request(Ssd &ssd, double &time, enum event_type type, ulong lpn, long hits, long faults)
+{
+	const Stats &stats = ssd.get_controller().stats;
+	long oldHits = stats.numCacheHits;
+	long oldFaults = stats.numCacheFaults;
+
+	time += ssd.event_arrive(type, lpn, SIZE, time);
+
+	long gotHits = stats.numCacheHits - oldHits;
+	long gotFaults = stats.numCacheFaults - oldFaults;
+	printf("%s %lu-%lu: hits %li (expected %li) faults %li (expected %li)\n", type == READ ? "Read" : "Write", lpn, lpn + SIZE - 1, gotHits, hits, gotFaults, faults);
+
+	return gotHits == hits && gotFaults == faults ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	SimConfig config(argc > 1 ? argv[1] : "ssd.conf");
+	config.set("FTL_IMPLEMENTATION", 3);
+	config.set("WRITE_BUFFER_SIZE", 0);
+	config.set("HMB_DFTL_LIMIT", 0);
+	config.set("CACHE_DFTL_EXTENTS", 0);
+	config.apply();
+
+	Ssd ssd;
+	double time = 0;
+	uint errors = 0;
+
+	// Cold mappings, then the same mappings cached
+	errors += request(ssd, time, WRITE, 0, 0, SIZE);
+	errors += request(ssd, time, READ, 0, SIZE, 0);
+	errors += request(ssd, time, WRITE, 0, SIZE, 0);
+
+	// Half of the request cached
+	errors += request(ssd, time, READ, SIZE / 2, SIZE / 2, SIZE / 2);
+
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+/* Preconditioning check
+ *
+ * Builds the SSD of a configuration twice: one is brought to steady state
+ * by Ssd::precondition, the other by replaying the same preconditioning
+ * writes through event_arrive. Both then serve the same random writes and
+ * reads, and their write amplification, erases and latencies are printed
+ * side by side.
+ *
+ * Usage: precondition <config> [NAME=VALUE...]
+ *
+ * PRECONDITION_FILL must be set, by the config file or an override, e.g.
+ * precondition ssd.conf PRECONDITION_FILL=0.7 PRECONDITION_PASSES=2 */
+
+#include "ssd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <chrono>
+
+using namespace ssd;
+
+struct Measurement
+{
+	double seconds;
+	long writes;
+	long erases;
+	double writeTime;
+	double readTime;
+};
+
+static const ulong MEASURE_WRITES = 20000;
+
+static double now(void)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * The overwrites of Precondition::run, written one by one.
+ */
+static double replay(Ssd &ssd)
+{
+	ulong pages = (ulong)NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE;
+	ulong span = (ulong)(PRECONDITION_FILL * pages);
+	if (span > pages)
+		span = pages;
+
+	double time = 0;
+	for (ulong lpn=0;lpn<span;lpn++)
+		time += ssd.event_arrive(WRITE, lpn, 1, time);
+
+	ulong overwrites = (ulong)(PRECONDITION_PASSES * span);
+
+	std::mt19937_64 generator(PRECONDITION_SEED);
+	for (ulong i=0;i<overwrites && span > 0;i++)
+		time += ssd.event_arrive(WRITE, Precondition::overwrite(generator, span), 1, time);
+
+	return time;
+}
+
+/*
+ * Random writes and reads over the filled pages, starting at time start.
+ */
+static void measure(Ssd &ssd, double start, Measurement &result)
+{
+	ulong pages = (ulong)NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE;
+	ulong span = (ulong)(PRECONDITION_FILL * pages);
+	if (span == 0)
+		span = 1;
+
+	const Stats &stats = ssd.get_controller().stats;
+	long writes = stats.numFTLWrite;
+	long erases = stats.numFTLErase;
+
+	result.writeTime = 0;
+	result.readTime = 0;
+
+	std::mt19937_64 generator(PRECONDITION_SEED + 1);
+	double time = start;
+	for (ulong i=0;i<MEASURE_WRITES;i++)
+	{
+		double latency = ssd.event_arrive(WRITE, generator() % span, 1, time);
+		result.writeTime += latency;
+		time += latency;
+
+		latency = ssd.event_arrive(READ, generator() % span, 1, time);
+		result.readTime += latency;
+		time += latency;
+	}
+
+	result.writes = stats.numFTLWrite - writes;
+	result.erases = stats.numFTLErase - erases;
+}
+
+static void print(const char *name, const Measurement &m)
+{
+	printf("%s;%f;%f;%li;%f;%f\n", name, m.seconds, (double)m.writes / MEASURE_WRITES, m.erases, m.writeTime / MEASURE_WRITES, m.readTime / MEASURE_WRITES);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <config> [NAME=VALUE...]\n", argv[0]);
+		exit(-1);
+	}
+
+	SimConfig config(argv[1]);
+	for (int i=2;i<argc;i++)
+	{
+		const char *eq = strchr(argv[i], '=');
+		if (eq == NULL)
+		{
+			fprintf(stderr, "Invalid config entry %s.\n", argv[i]);
+			exit(-1);
+		}
+		config.set(std::string(argv[i], eq - argv[i]).c_str(), atof(eq + 1));
+	}
+
+	config.apply();
+	if (PRECONDITION_FILL <= 0)
+	{
+		fprintf(stderr, "Set PRECONDITION_FILL to precondition.\n");
+		exit(-1);
+	}
+
+	Measurement synthesised;
+	Measurement replayed;
+	double start;
+
+	{
+		Ssd ssd(config);
+
+		double begin = now();
+		start = replay(ssd);
+		replayed.seconds = now() - begin;
+
+		printf("Replayed: Writes: %li Erases: %li\n", ssd.get_controller().stats.numFTLWrite, ssd.get_controller().stats.numFTLErase);
+		measure(ssd, start, replayed);
+	}
+
+	{
+		Ssd ssd(config);
+
+		double begin = now();
+		if (ssd.precondition() == FAILURE)
+			exit(-1);
+		synthesised.seconds = now() - begin;
+
+		// Start at the same time, the channels are idle by then in both.
+		measure(ssd, start, synthesised);
+	}
+
+	printf("Device;Seconds;WritesPerHostWrite;Erases;WriteTime;ReadTime\n");
+	print("replayed", replayed);
+	print("synthesised", synthesised);
+
+	return 0;
+}
@@ -0,0 +1,99 @@
+/* Degraded RAID-6 check
+ *
+ * Builds a RAID-6 array of five SSDs with one and with two failed SSDs, for
+ * every SSD and pair of SSDs, writes random requests to it and reads every
+ * page back. Pages of the failed SSDs are reconstructed from the rest of
+ * their row, with P, Q or both. Exits with 1 if a page read differs from
+ * the page written.
+ *
+ * Usage: raid6 [config] */
+
+#include "ssd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace ssd;
+
+static const uint MEMBERS = 5;
+static const ulong SPAN = 2048;
+static const uint WRITES = 4000;
+
+/*
+ * Check the page of lpn returned by the array.
+ */
+static bool check(RaidSsd &raid, ulong lpn, const std::vector<ulong> &versions)
+{
+	const ulong *page = (const ulong *)raid.get_result_buffer();
+	if (versions[lpn] == 0)
+		return true;
+
+	return page != NULL && page[0] == lpn && page[1] == versions[lpn] && page[PAGE_SIZE / sizeof(ulong) - 1] == (lpn ^ versions[lpn]);
+}
+
+static ulong degraded(const char *config_name, int failed, int failed2)
+{
+	SimConfig config(config_name);
+	config.set("PARALLELISM_MODE", 4);
+	config.set("RAID_NUMBER_OF_PHYSICAL_SSDS", MEMBERS);
+	config.set("RAID_CHUNK_SIZE", 2);
+	config.set("RAID_FAILED_SSD", failed);
+	config.set("RAID_FAILED_SSD2", failed2);
+	config.set("PAGE_ENABLE_DATA", 1);
+	config.set("PLANE_SIZE", 16);
+	config.apply();
+
+	RaidSsd raid;
+	std::vector<ulong> versions(SPAN, 0);
+	std::vector<char> buffer(8 * PAGE_SIZE);
+	double time = 0;
+	ulong errors = 0;
+
+	srandom(failed * MEMBERS + failed2 + 1);
+	for (uint i=0;i<WRITES;i++)
+	{
+		uint size = 1 + random() % 8;
+		ulong lpn = random() % (SPAN - size);
+
+		for (uint p=0;p<size;p++)
+		{
+			ulong *page = (ulong *)&buffer[p * PAGE_SIZE];
+			versions[lpn + p]++;
+			page[0] = lpn + p;
+			page[1] = versions[lpn + p];
+			page[PAGE_SIZE / sizeof(ulong) - 1] = page[0] ^ page[1];
+		}
+		time += raid.event_arrive(WRITE, lpn, size, time, &buffer[0]);
+
+		ulong read = random() % SPAN;
+		time += raid.event_arrive(READ, read, 1, time);
+		if (!check(raid, read, versions))
+			errors++;
+	}
+
+	for (ulong lpn=0;lpn<SPAN;lpn++)
+	{
+		time += raid.event_arrive(READ, lpn, 1, time);
+		if (!check(raid, lpn, versions))
+			errors++;
+	}
+
+	printf("Failed SSDs %i %i: %lu pages differ\n", failed, failed2, errors);
+	return errors;
+}
+
+int main(int argc, char **argv)
+{
+	const char *config_name = argc > 1 ? argv[1] : "ssd.conf";
+	ulong errors = 0;
+
+	for (uint a=0;a<MEMBERS;a++)
+	{
+		errors += degraded(config_name, a, -1);
+		for (uint b=a+1;b<MEMBERS;b++)
+			errors += degraded(config_name, a, b);
+	}
+
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,174 @@
+/* Parameter sweep driver
+ *
+ * Replays one trace against several configurations, each on its own
+ * thread. The trace is read once and shared by all threads.
+ *
+ * Usage: sweep <trace> <config>[,NAME=VALUE...] ...
+ *
+ * A config is a config file, optionally followed by entries that override
+ * it, e.g. ssd.conf,CACHE_DFTL_LIMIT=1024. Trace lines hold the arrival
+ * time, the type (R, W or T), the logical page and the size in pages.
+ * With PRECONDITION_FILL set, the SSD is preconditioned before the trace.
+ * With FUNCTIONAL_MODE set, the trace is replayed without timing: the
+ * times printed are 0, the erases are those of the timed replay. */
+
+#include "ssd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+
+using namespace ssd;
+
+struct TraceEvent
+{
+	double time;
+	enum event_type type;
+	ulong lpn;
+	uint size;
+};
+
+struct SweepResult
+{
+	ulong reads;
+	ulong writes;
+	double readTime;
+	double writeTime;
+	long erases;
+};
+
+static SimConfig parse_config(const char *spec)
+{
+	std::string s(spec);
+	size_t comma = s.find(',');
+	SimConfig config(s.substr(0, comma).c_str());
+
+	while (comma != std::string::npos)
+	{
+		size_t next = s.find(',', comma + 1);
+		std::string entry = s.substr(comma + 1, next == std::string::npos ? std::string::npos : next - comma - 1);
+		size_t eq = entry.find('=');
+		if (eq == std::string::npos)
+		{
+			fprintf(stderr, "Invalid config entry %s.\n", entry.c_str());
+			exit(-1);
+		}
+
+		// Values that are not numbers are text, e.g. PAGE_DATA_FILE=a.img
+		std::string value = entry.substr(eq + 1);
+		char *end = NULL;
+		double number = strtod(value.c_str(), &end);
+		if (end != value.c_str() && *end == '\0')
+			config.set(entry.substr(0, eq).c_str(), number);
+		else
+			config.set_text(entry.substr(0, eq).c_str(), value.c_str());
+		comma = next;
+	}
+
+	return config;
+}
+
+static void run(const std::vector<TraceEvent> &trace, const SimConfig &config, SweepResult &result)
+{
+	Ssd ssd(config);
+
+	if (PRECONDITION_FILL > 0 && ssd.precondition() == FAILURE)
+		exit(-1);
+
+	ulong pages = (ulong)NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE;
+
+	result.reads = 0;
+	result.writes = 0;
+	result.readTime = 0;
+	result.writeTime = 0;
+
+	for (uint i=0;i<trace.size();i++)
+	{
+		const TraceEvent &e = trace[i];
+		if (e.size == 0 || e.size > pages)
+			continue;
+
+		ulong lpn = e.lpn % pages;
+		if (lpn + e.size > pages)
+			lpn = pages - e.size;
+
+		double time = ssd.event_arrive(e.type, lpn, e.size, e.time);
+
+		if (e.type == READ)
+		{
+			result.reads++;
+			result.readTime += time;
+		}
+		else if (e.type == WRITE)
+		{
+			result.writes++;
+			result.writeTime += time;
+		}
+	}
+
+	// Buffered writes count once they reach flash.
+	if (!trace.empty())
+		ssd.flush(trace.back().time);
+
+	result.erases = ssd.get_controller().stats.numFTLErase;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		printf("Usage: %s <trace> <config>[,NAME=VALUE...] ...\n", argv[0]);
+		exit(-1);
+	}
+
+	FILE *file = NULL;
+	if ((file = fopen(argv[1], "r")) == NULL)
+	{
+		printf("Trace file %s cannot be read.\n", argv[1]);
+		exit(-1);
+	}
+
+	std::vector<TraceEvent> trace;
+	char line[128];
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		TraceEvent e;
+		char type;
+		if (sscanf(line, "%lf %c %lu %u", &e.time, &type, &e.lpn, &e.size) != 4)
+			continue;
+
+		if (type == 'R')
+			e.type = READ;
+		else if (type == 'W')
+			e.type = WRITE;
+		else if (type == 'T')
+			e.type = TRIM;
+		else
+			continue;
+
+		trace.push_back(e);
+	}
+	fclose(file);
+
+	printf("Replaying %lu events against %i configurations.\n", (ulong)trace.size(), argc - 2);
+
+	std::vector<SimConfig> configs;
+	for (int i=2;i<argc;i++)
+		configs.push_back(parse_config(argv[i]));
+
+	std::vector<SweepResult> results(configs.size());
+	std::vector<std::thread> threads;
+	for (uint i=0;i<configs.size();i++)
+		threads.push_back(std::thread(run, std::cref(trace), std::cref(configs[i]), std::ref(results[i])));
+
+	for (uint i=0;i<threads.size();i++)
+		threads[i].join();
+
+	printf("Config;Reads;ReadTime;Writes;WriteTime;Erases\n");
+	for (uint i=0;i<configs.size();i++)
+		printf("%s;%lu;%f;%lu;%f;%li\n", argv[i + 2], results[i].reads, results[i].readTime, results[i].writes, results[i].writeTime, results[i].erases);
+
+	return 0;
+}
@@ -29,7 +29,16 @@
 #include <stdio.h>
 #include <vector>
 #include <queue>
+#include <deque>
 #include <map>
+#include <set>
+#include <list>
+#include <unordered_map>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <random>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/identity.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -57,15 +66,34 @@ typedef unsigned long ulong;
 
 /* Simulator configuration from ssd_config.cpp */
 
-/* Configuration file parsing for extern config variables defined below */
+/* Configuration file parsing for extern config variables defined below.
+ * The variables are thread local, load_config sets them for the calling
+ * thread. */
 void load_entry(char *name, double value, uint line_number);
+void load_text_entry(char *name, const char *value, uint line_number);
 void load_config(void);
+void load_config(const char *config_name);
+void read_config(const char *config_name, std::vector<std::pair<std::string, double> > &entries, std::vector<std::pair<std::string, std::string> > &text_entries);
+void update_config(void);
+void reset_config(void);
+ulong get_config_id(void);
+void set_config_id(ulong id);
+void get_config_entries(std::vector<std::pair<std::string, double> > &entries);
+void get_config_text_entries(std::vector<std::pair<std::string, std::string> > &entries);
 void print_config(FILE *stream);
 
+/* Parity kernels from ssd_parity.cpp: dst ^= src and dst ^= g^exponent * src
+ * over GF(2^8), and the recovery of one lost data page from Q or of two
+ * from P and Q. */
+void parity_xor(char *dst, const char *src, uint bytes);
+void parity_mul_xor(char *dst, const char *src, uint exponent, uint bytes);
+void parity_recover_q(char *dst, const char *q, uint x, uint bytes);
+void parity_recover_pq(char *dx, char *dy, uint x, uint y, uint bytes);
+
 /* Ram class:
  * 	delay to read from and write to the RAM for 1 page of data */
-extern const double RAM_READ_DELAY;
-extern const double RAM_WRITE_DELAY;
+extern __thread const double RAM_READ_DELAY;
+extern __thread const double RAM_WRITE_DELAY;
 
 /* Bus class:
  * 	delay to communicate over bus
@@ -73,24 +101,24 @@ extern const double RAM_WRITE_DELAY;
  * 	flag value to detect free table entry (keep this negative)
  * 	number of time entries bus has to keep track of future schedule usage
  * 	number of simultaneous communication channels - defined by SSD_SIZE */
-extern const double BUS_CTRL_DELAY;
-extern const double BUS_DATA_DELAY;
-extern const uint BUS_MAX_CONNECT;
-extern const double BUS_CHANNEL_FREE_FLAG;
-extern const uint BUS_TABLE_SIZE;
+extern __thread const double BUS_CTRL_DELAY;
+extern __thread const double BUS_DATA_DELAY;
+extern __thread const uint BUS_MAX_CONNECT;
+extern __thread const double BUS_CHANNEL_FREE_FLAG;
+extern __thread const uint BUS_TABLE_SIZE;
 /* extern const uint BUS_CHANNELS = 4; same as # of Packages, defined by SSD_SIZE */
 
 /* Ssd class:
  * 	number of Packages per Ssd (size) */
-extern const uint SSD_SIZE;
+extern __thread const uint SSD_SIZE;
 
 /* Package class:
  * 	number of Dies per Package (size) */
-extern const uint PACKAGE_SIZE;
+extern __thread const uint PACKAGE_SIZE;
 
 /* Die class:
  * 	number of Planes per Die (size) */
-extern const uint DIE_SIZE;
+extern __thread const uint DIE_SIZE;
 
 /* Plane class:
  * 	number of Blocks per Plane (size)
@@ -98,72 +126,196 @@ extern const uint DIE_SIZE;
  * 	delay for writing to plane register
  * 	delay for merging is based on read, write, reg_read, reg_write 
  * 		and does not need to be explicitly defined */
-extern const uint PLANE_SIZE;
-extern const double PLANE_REG_READ_DELAY;
-extern const double PLANE_REG_WRITE_DELAY;
+extern __thread const uint PLANE_SIZE;
+extern __thread const double PLANE_REG_READ_DELAY;
+extern __thread const double PLANE_REG_WRITE_DELAY;
 
 /* Block class:
  * 	number of Pages per Block (size)
  * 	number of erases in lifetime of block
  * 	delay for erasing block */
-extern const uint BLOCK_SIZE;
-extern const uint BLOCK_ERASES;
-extern const double BLOCK_ERASE_DELAY;
+extern __thread const uint BLOCK_SIZE;
+extern __thread const uint BLOCK_ERASES;
+extern __thread const double BLOCK_ERASE_DELAY;
 
 /* Page class:
  * 	delay for Page reads
  * 	delay for Page writes */
-extern const double PAGE_READ_DELAY;
-extern const double PAGE_WRITE_DELAY;
-extern const uint PAGE_SIZE;
-extern const bool PAGE_ENABLE_DATA;
+extern __thread const double PAGE_READ_DELAY;
+extern __thread const double PAGE_WRITE_DELAY;
+extern __thread const uint PAGE_SIZE;
+
+/* Page data:
+ * 	file that backs the page data between runs (empty -> memory only)
+ * 	use transparent huge pages for the page data
+ * 	access advice (0 -> none, 1 -> random, 2 -> sequential, 3 -> will need) */
+extern __thread const char PAGE_DATA_FILE[128];
+extern __thread const uint PAGE_DATA_HUGE_PAGES;
+extern __thread const uint PAGE_DATA_ADVICE;
+extern __thread const bool PAGE_ENABLE_DATA;
 
 /*
  * Mapping directory
  */
-extern const uint MAP_DIRECTORY_SIZE;
+extern __thread const uint MAP_DIRECTORY_SIZE;
+
+/*
+ * Block map updates collected in the cached directory page before it is
+ * written to the map directory.
+ */
+extern __thread const uint MAP_DIRECTORY_BATCH;
 
 /*
  * FTL Implementation
  */
-extern const uint FTL_IMPLEMENTATION;
+extern __thread const uint FTL_IMPLEMENTATION;
 
 /*
  * LOG page limit for BAST.
  */
-extern const uint BAST_LOG_BLOCK_LIMIT;
+extern __thread const uint BAST_LOG_BLOCK_LIMIT;
+
+/*
+ * LOG block victim selection for BAST (0 -> Random, 1 -> LRU, 2 -> FIFO,
+ * 3 -> Cheapest merge).
+ */
+extern __thread const uint BAST_LOG_VICTIM;
 
 /*
  * LOG page limit for FAST.
  */
-extern const uint FAST_LOG_BLOCK_LIMIT;
+extern __thread const uint FAST_LOG_BLOCK_LIMIT;
+
+/*
+ * Number of sequential (SW) log blocks for FAST.
+ */
+extern __thread const uint FAST_SEQUENTIAL_LOG_BLOCKS;
 
 /*
  * Number of blocks allowed to be in DFTL Cached Mapping Table.
  */
-extern const uint CACHE_DFTL_LIMIT;
+extern __thread const uint CACHE_DFTL_LIMIT;
+
+/*
+ * Number of flash pages used by the DFTL mapping update journal (0 -> disabled).
+ */
+extern __thread const uint DFTL_JOURNAL_SIZE;
+
+/*
+ * Cache runs of contiguous mappings as extents in the DFTL CMT (0 -> off, 1 -> on).
+ */
+extern __thread const uint CACHE_DFTL_EXTENTS;
+
+/*
+ * Host Memory Buffer tier for the DFTL mapping cache. Number of pages of
+ * mappings held in host memory behind the on-device CMT (0 -> off), and
+ * the access delays including the PCIe round-trip.
+ */
+extern __thread const uint HMB_DFTL_LIMIT;
+extern __thread const double HMB_READ_DELAY;
+extern __thread const double HMB_WRITE_DELAY;
+
+/*
+ * LeaFTL learned page map. Maximum prediction error of a segment in pages,
+ * and the number of mapping updates buffered before segments are learned.
+ */
+extern __thread const uint LEAFTL_GAMMA;
+extern __thread const uint LEAFTL_BUFFER_SIZE;
+
+/*
+ * Number of page mapped logical blocks BDFTL follows for a sequential rewrite
+ * at a time (0 -> no re-promotion on rewrite).
+ */
+extern __thread const uint BDFTL_SEQUENTIAL_REWRITES;
+
+/*
+ * Relocate valid pages in LPN order during GC for the page mapping FTLs.
+ * Number of victims gathered per relocation (0 -> physical order).
+ */
+extern __thread const uint GC_SORT_BY_LPN;
+
+/*
+ * Open data blocks the page FTL writes to in turn, each in its own die
+ * (0 -> one per die).
+ */
+extern __thread const uint PAGE_WRITE_FRONTIERS;
+
+/*
+ * Pages in the controller BPLRU write buffer (0 = no buffer).
+ */
+extern __thread const uint WRITE_BUFFER_SIZE;
 
 /*
  * Parallelism mode
  */
-extern const uint PARALLELISM_MODE;
+extern __thread const uint PARALLELISM_MODE;
 
 /* Virtual block size (as a multiple of the physical block size) */
-extern const uint VIRTUAL_BLOCK_SIZE;
+extern __thread const uint VIRTUAL_BLOCK_SIZE;
 
 /* Virtual page size (as a multiple of the physical page size) */
-extern const uint VIRTUAL_PAGE_SIZE;
+extern __thread const uint VIRTUAL_PAGE_SIZE;
 
-extern const uint NUMBER_OF_ADDRESSABLE_BLOCKS;
+extern __thread const uint NUMBER_OF_ADDRESSABLE_BLOCKS;
 
 /* RAISSDs: Number of physical SSDs */
-extern const uint RAID_NUMBER_OF_PHYSICAL_SSDS;
+extern __thread const uint RAID_NUMBER_OF_PHYSICAL_SSDS;
+
+/* RAISSDs: Pages per chunk when the address space is split over the SSDs */
+extern __thread const uint RAID_CHUNK_SIZE;
+
+/* RAISSDs: Drive each SSD from its own worker thread (0 -> serial) */
+extern __thread const uint RAID_PARALLEL;
+
+/* RAISSDs: Parity update of RAID-5/6 writes (0 -> the one with the fewest
+ * reads, 1 -> read-modify-write, 2 -> reconstruct-write) */
+extern __thread const uint RAID_PARITY_UPDATE;
+
+/* RAISSDs: Time to fold one page into a parity page */
+extern __thread const double RAID_PARITY_DELAY;
+
+/* RAISSDs: Failed SSD of a degraded RAID-5/6 (-1 -> none) */
+extern __thread const int RAID_FAILED_SSD;
+
+/* RAISSDs: Second failed SSD of a degraded RAID-6 (-1 -> none) */
+extern __thread const int RAID_FAILED_SSD2;
+
+/* RAISSDs: Reconstruct RAID-5/6 reads of an SSD that is busy, e.g. with
+ * garbage collection, from the rest of the row (0 -> off) */
+extern __thread const uint RAID_READ_AROUND_BUSY;
+
+/* RAISSDs: Start garbage collection on one SSD at a time, once it has this
+ * many free blocks left (0 -> the SSDs collect on their own) */
+extern __thread const uint RAID_GC_FREE_BLOCKS;
+
+/* Preconditioning (Ssd::precondition): Fraction of the logical pages
+ * written in order */
+extern __thread const double PRECONDITION_FILL;
+
+/* Preconditioning: Random overwrites of the filled pages, as a multiple of
+ * the pages filled */
+extern __thread const double PRECONDITION_PASSES;
+
+/* Preconditioning: Fraction of the filled pages that are hot (0 -> the
+ * overwrites are uniform) */
+extern __thread const double PRECONDITION_HOT_SPACE;
+
+/* Preconditioning: Fraction of the overwrites that go to the hot pages */
+extern __thread const double PRECONDITION_HOT_WRITES;
+
+/* Preconditioning: Seed of the overwrites */
+extern __thread const uint PRECONDITION_SEED;
+
+/* Functional mode of a new SSD (Ssd::set_functional): the FTL, garbage
+ * collection and wear leveling run as usual, but requests skip the bus, RAM
+ * and flash timing and take no time (0 -> timed) */
+extern __thread const uint FUNCTIONAL_MODE;
 
 /*
  * Memory area to support pages with data.
  */
-extern void *page_data;
-extern void *global_buffer;
+extern __thread void *page_data;
+extern __thread void *global_buffer;
 
 /* Enumerations to clarify status integers in simulation
  * Do not use typedefs on enums for reader clarity */
@@ -212,7 +364,7 @@ enum block_type {LOG, DATA, LOG_SEQ};
 /*
  * Enumeration of the different FTL implementations.
  */
-enum ftl_implementation {IMPL_PAGE, IMPL_BAST, IMPL_FAST, IMPL_DFTL, IMPL_BIMODAL};
+enum ftl_implementation {IMPL_PAGE, IMPL_BAST, IMPL_FAST, IMPL_DFTL, IMPL_BIMODAL, IMPL_LEAFTL};
 
 
 #define BOOST_MULTI_INDEX_ENABLE_SAFE_MODE 1
@@ -226,6 +378,8 @@ enum ftl_implementation {IMPL_PAGE, IMPL_BAST, IMPL_FAST, IMPL_DFTL, IMPL_BIMODA
  * constructors that accept args
  * (e.g. a Ssd contains a Controller, Ram, Bus, and Packages). */
 class Address;
+class Checkpoint;
+class Precondition;
 class Stats;
 class Event;
 class Channel;
@@ -245,10 +399,13 @@ class FtlImpl_Fast;
 class FtlImpl_DftlParent;
 class FtlImpl_Dftl;
 class FtlImpl_BDftl;
+class FtlImpl_LeaFtl;
 
 class Ram;
+class WriteBuffer;
 class Controller;
 class Ssd;
+class SimConfig;
 
 
 
@@ -286,6 +443,216 @@ public:
 	ulong get_linear_address() const;
 };
 
+/* Versioned binary snapshot of the simulator state. The checkpoint method
+ * of a class either saves its state to the snapshot or loads it back,
+ * depending on the direction of the Checkpoint, so both directions are
+ * kept in one place. Snapshots are written sequentially and read through a
+ * mapping of the file. Arrays are 8 byte aligned and copied straight out
+ * of the mapping. A snapshot can also be kept in memory and read back, to
+ * copy the state from one SSD to another (Ssd::clone). */
+class Checkpoint
+{
+public:
+	Checkpoint(void);
+	~Checkpoint(void);
+	enum status create(const char *path);
+	enum status create(void);
+	enum status open(const char *path);
+	enum status reopen(void);
+	enum status close(void);
+	bool is_loading(void) const;
+	bool is_in_memory(void) const;
+
+	void section(const char *name);
+	void address(Address &address);
+	void bits(std::vector<bool> &bits);
+
+	template <class T> void value(T &value)
+	{
+		transfer(&value, sizeof(T));
+	}
+
+	template <class T> void array(T *data, ulong count)
+	{
+		align();
+		transfer(data, count * sizeof(T));
+	}
+
+	template <class T> void vector(std::vector<T> &list)
+	{
+		ulong count = list.size();
+		value(count);
+		if (loading)
+			list.resize(count);
+		if (count > 0)
+			array(&list[0], count);
+	}
+
+	/* std::map or std::unordered_map of plain keys and values */
+	template <class M> void map(M &map)
+	{
+		ulong count = map.size();
+		value(count);
+		if (loading)
+		{
+			map.clear();
+			for (ulong i=0;i<count;i++)
+			{
+				typename M::key_type key;
+				typename M::mapped_type mapped;
+				value(key);
+				value(mapped);
+				map.insert(map.end(), std::make_pair(key, mapped));
+			}
+			return;
+		}
+
+		for (typename M::iterator it = map.begin(); it != map.end(); ++it)
+		{
+			typename M::key_type key = it->first;
+			typename M::mapped_type mapped = it->second;
+			value(key);
+			value(mapped);
+		}
+	}
+
+	/* std::set or std::list of plain values */
+	template <class S> void sequence(S &sequence)
+	{
+		ulong count = sequence.size();
+		value(count);
+		if (loading)
+		{
+			sequence.clear();
+			for (ulong i=0;i<count;i++)
+			{
+				typename S::value_type item;
+				value(item);
+				sequence.insert(sequence.end(), item);
+			}
+			return;
+		}
+
+		for (typename S::iterator it = sequence.begin(); it != sequence.end(); ++it)
+		{
+			typename S::value_type item = *it;
+			value(item);
+		}
+	}
+private:
+	void transfer(void *data, ulong bytes);
+	void align(void);
+	enum status check_header(void);
+
+	bool loading;
+	bool failed;
+	std::string path;
+
+	// Writing
+	FILE *file;
+
+	// Reading
+	char *image;
+	ulong size;
+	ulong offset;
+
+	// Snapshot kept in memory by create(void), read back by reopen
+	bool in_memory;
+	char *memory;
+	size_t memory_size;
+};
+
+/* Steady state of a device after the preconditioning workload of the
+ * PRECONDITION_* configuration, computed without the timing model. The
+ * FTL runs the model that matches its mapping, then the FTL, the blocks
+ * and the block manager take over the result. Like Address, the result is
+ * kept in public members. */
+class Precondition
+{
+public:
+	Precondition(const Block_manager &manager);
+	enum status run_page_mapped(const std::vector<int> &dies, bool gcFrontier);
+	enum status run_block_mapped(void);
+	void print_statistics(void);
+	static long overwrite(std::mt19937_64 &generator, ulong span);
+
+	// Logical page -> physical page and back (-1 -> none)
+	std::vector<long> map;
+	std::vector<long> reverse;
+
+	// Pages programmed, pages invalidated and erases of each block
+	std::vector<uint> written;
+	std::vector<uint> invalid;
+	std::vector<uint> erases;
+
+	// Last page written by each host frontier and by GC (-1 -> none)
+	std::vector<long> frontiers;
+	long gcFrontier;
+	uint gcDie;
+
+	// Block allocation as kept by Block_manager: the never written blocks
+	// left, the erased blocks in the order they were freed, the blocks in
+	// cost order and the block allocated last.
+	std::vector<ulong> dieCurrentFree;
+	ulong simpleCurrentFree;
+	std::vector<ulong> freeList;
+	std::vector<ulong> costOrder;
+	ulong allocations;
+	long currentWritingBlock;
+
+	ulong hostWrites;
+	ulong gcWrites;
+	ulong numErases;
+private:
+	enum status run(void);
+	enum status finish(void);
+	void write(long lpn);
+	long next_page(long &frontier, int die, bool collect);
+	long allocate(int die);
+	ulong die_end(uint die) const;
+	void skip_map_blocks(uint die);
+	void collect(void);
+	void relocate(const std::vector<ulong> &victims);
+	void program(long ppn, long lpn);
+	void invalidate(long ppn);
+	void erase(ulong block);
+	ulong num_free_blocks(void) const;
+
+	// Invalid pages of each block, ordered like the cost index of
+	// Block_manager such that blocks of equal cost are picked alike.
+	typedef boost::multi_index_container<
+			uint,
+			boost::multi_index::indexed_by<
+				boost::multi_index::random_access<>,
+				boost::multi_index::ordered_non_unique<boost::multi_index::identity<uint> >
+		  >
+		> cost_set;
+	typedef cost_set::nth_index<1>::type CostByInvalid;
+
+	ulong block_of(CostByInvalid::iterator it) const;
+
+	const Block_manager &manager;
+	cost_set cost;
+	ulong blocks;
+	ulong span;
+	bool full;
+	bool cleaning;
+	bool outOfBlocks;
+	bool merged;
+
+	// Die of each host frontier, the next one to write and whether GC
+	// writes to gcFrontier instead of the first host frontier
+	std::vector<int> frontierDies;
+	uint nextFrontier;
+	bool ownGcFrontier;
+
+	// Erased blocks of each die, oldest first, and when they were erased
+	std::vector<std::deque<ulong> > freeDies;
+	std::vector<ulong> freeStamp;
+	ulong freeCount;
+	ulong freeClock;
+};
+
 class Stats
 {
 public:
@@ -317,6 +684,9 @@ public:
 	long numCacheHits;
 	long numCacheFaults;
 
+	// Block map updates of BAST and FAST
+	long numMapWrite;
+
 	// Memory consumptions (Bytes)
 	long numMemoryTranslation;
 	long numMemoryCache;
@@ -336,6 +706,7 @@ public:
 	void reset_statistics();
 	void write_statistics(FILE *stream);
 	void write_header(FILE *stream);
+	void checkpoint(Checkpoint &cp);
 private:
 	void reset();
 };
@@ -354,11 +725,52 @@ public:
 
 	LogPageBlock *next;
 
+	// Pooled log blocks (BAST): logical block and previous in victim order.
+	long lba;
+	LogPageBlock *prev;
+
+	// Every page so far was written to the slot of its offset (BAST).
+	bool sequential;
+
+	// Host write count of the FTL at the last write to the block (BAST).
+	ulong lastWrite;
+
+	// Merge cost bucket of the log block and its neighbours in it (BAST
+	// cheapest merge, cost -1 -> in no bucket).
+	uint cost;
+	LogPageBlock *costPrev;
+	LogPageBlock *costNext;
+
+	void reset(void);
+	void checkpoint(Checkpoint &cp);
+
 	bool operator() (const ssd::LogPageBlock& lhs, const ssd::LogPageBlock& rhs) const;
 	bool operator() (const ssd::LogPageBlock*& lhs, const ssd::LogPageBlock*& rhs) const;
 };
 
 
+/* Fixed size open addressing hash table from a non-negative key to a value.
+ * find() returns -1 for keys that are not present. */
+class HashIndex
+{
+public:
+	HashIndex(uint entries);
+	~HashIndex(void);
+	long find(long key) const;
+	void insert(long key, long value);
+	void erase(long key);
+	void clear(void);
+	uint size(void) const;
+	void checkpoint(Checkpoint &cp);
+private:
+	ulong home(long key) const;
+	long *keys;
+	long *values;
+	uint bits;
+	ulong mask;
+	uint count;
+};
+
 /* Class to manage I/O requests as events for the SSD.  It was designed to keep
  * track of an I/O request by storing its type, addressing, and timing.  The
  * SSD class creates an instance for each I/O request it receives. */
@@ -427,6 +839,7 @@ public:
 	enum status connect(void);
 	enum status disconnect(void);
 	double ready_time(void);
+	void checkpoint(Checkpoint &cp);
 private:
 	void unlock(double current_time);
 
@@ -467,6 +880,7 @@ public:
 	enum status disconnect(uint channel);
 	Channel &get_channel(uint channel);
 	double ready_time(uint channel);
+	void checkpoint(Checkpoint &cp);
 private:
 	uint num_channels;
 	Channel * const channels;
@@ -522,6 +936,8 @@ public:
 	Block *get_pointer(void);
 	block_type get_block_type(void) const;
 	void set_block_type(block_type value);
+	void checkpoint(Checkpoint &cp);
+	void precondition(const Precondition &state);
 
 private:
 	uint size;
@@ -562,6 +978,8 @@ public:
 	ssd::uint get_num_valid(const Address &address) const;
 	ssd::uint get_num_invalid(const Address &address) const;
 	Block *get_block_pointer(const Address & address);
+	void checkpoint(Checkpoint &cp);
+	void precondition(const Precondition &state);
 private:
 	void update_wear_stats(void);
 	enum status get_next_page(void);
@@ -601,6 +1019,8 @@ public:
 	ssd::uint get_num_valid(const Address &address) const;
 	ssd::uint get_num_invalid(const Address &address) const;
 	Block *get_block_pointer(const Address & address);
+	void checkpoint(Checkpoint &cp);
+	void precondition(const Precondition &state);
 private:
 	void update_wear_stats(const Address &address);
 	uint size;
@@ -637,6 +1057,8 @@ public:
 	ssd::uint get_num_valid(const Address &address) const;
 	ssd::uint get_num_invalid(const Address &address) const;
 	Block *get_block_pointer(const Address & address);
+	void checkpoint(Checkpoint &cp);
+	void precondition(const Precondition &state);
 private:
 	void update_wear_stats (const Address &address);
 	uint size;
@@ -675,13 +1097,15 @@ public:
 	// Usual suspects
 	Address get_free_block(Event &event);
 	Address get_free_block(block_type btype, Event &event);
+	Address get_free_block(block_type btype, Event &event, int die);
 	void invalidate(Address address, block_type btype);
 	void print_statistics();
-	void insert_events(Event &event);
+	void insert_events(Event &event, bool force = false);
 	void promote_block(block_type to_type);
 	bool is_log_full();
 	void erase_and_invalidate(Event &event, Address &address, block_type btype);
 	int get_num_free_blocks();
+	uint get_num_dies() const;
 
 	// Used to update GC on used pages in blocks.
 	void update_block(Block * b);
@@ -689,16 +1113,28 @@ public:
 	// Singleton
 	static Block_manager *instance();
 	static void instance_initialize(FtlParent *ftl);
-	static Block_manager *inst;
+	static __thread Block_manager *inst;
 
 	void cost_insert(Block *b);
 
 	void print_cost_status();
 
+	// Block map directory of the log block FTLs
+	void update_map_directory(Event &event, long lbn);
+
+	void checkpoint(Checkpoint &cp);
+	void precondition(const Precondition &state);
 
+	friend class Precondition;
 
 private:
-	void get_page_block(Address &address, Event &event);
+	void get_page_block(Address &address, Event &event, int die);
+	ulong die_end(uint die) const;
+	void skip_map_blocks(uint die);
+	bool is_map_block(ulong blockNumber) const;
+	void flush_map_directory(Event &event);
+	void clean_map_directory(Event &event);
+	void rebuild_cost(const std::vector<long> &order);
 	static bool block_comparitor_simple (Block const *x,Block const *y);
 
 	FtlParent *ftl;
@@ -727,6 +1163,8 @@ private:
 
 	active_set active_cost;
 
+	void select_victims(ActiveByCost::iterator it, uint num_to_erase, std::vector<Block*> &victims);
+
 	// Usual block lists
 	std::vector<Block*> active_list;
 	std::vector<Block*> free_list;
@@ -735,10 +1173,28 @@ private:
 	// Counter for returning the next free page.
 	ulong directoryCurrentPage;
 	// Address on the current cached page in SRAM.
-	ulong directoryCachedPage;
+	long directoryCachedPage;
+
+	// Map directory blocks, spread over the SSD, and the directory page
+	// they hold (directory page -> physical page, -1 if never written).
+	std::vector<ulong> directoryBlocks;
+	std::vector<long> directoryPages;
+	uint directoryCurrentBlock;
+	uint directoryPerPage;
+	uint directoryStride;
+	uint directoryPending;
+
+	ulong numDirectoryUpdates;
+	ulong numDirectoryReads;
+	ulong numDirectoryWrites;
+	ulong numDirectoryCleans;
 
 	ulong simpleCurrentFree;
 
+	// Next never written block of each die and the blocks per die.
+	std::vector<ulong> dieCurrentFree;
+	ulong dieBlocks;
+
 	// Counter for handling periodic sort of active_list
 	uint num_insert_events;
 
@@ -747,6 +1203,9 @@ private:
 	bool inited;
 
 	bool out_of_blocks;
+
+	// Set while the FTL relocates pages, which may allocate blocks.
+	bool cleaning;
 };
 
 class FtlParent
@@ -759,9 +1218,17 @@ public:
 	virtual enum status write(Event &event) = 0;
 	virtual enum status trim(Event &event) = 0;
 	virtual void cleanup_block(Event &event, Block *block);
+	virtual void cleanup_blocks(Event &event, const std::vector<Block*> &blocks);
+	virtual void resolve_batch(Event &event, const std::vector<long> &lpns, bool isWrite);
 
 	virtual void print_ftl_statistics();
 
+	// Save or load the state of the FTL
+	virtual void checkpoint(Checkpoint &cp) = 0;
+
+	// Run the preconditioning model of the FTL and take over its mapping
+	virtual enum status precondition(Precondition &state) = 0;
+
 	friend class Block_manager;
 
 	ulong get_erases_remaining(const Address &address) const;
@@ -772,10 +1239,12 @@ public:
 
 	Address resolve_logical_address(unsigned int logicalAddress);
 protected:
+	void checkpoint_block(Checkpoint &cp, Block *&block);
+
 	Controller &controller;
 };
 
-class FtlImpl_Page : public FtlParent
+class FtlImpl_Page final : public FtlParent
 {
 public:
 	FtlImpl_Page(Controller &controller);
@@ -783,14 +1252,33 @@ public:
 	enum status read(Event &event);
 	enum status write(Event &event);
 	enum status trim(Event &event);
+	void cleanup_block(Event &event, Block *block);
+	void cleanup_blocks(Event &event, const std::vector<Block*> &blocks);
+	void print_ftl_statistics();
+	void checkpoint(Checkpoint &cp);
+	enum status precondition(Precondition &state);
 private:
-	ulong currentPage;
-	ulong numPagesActive;
-	bool *trim_map;
+	long get_free_data_page(Event &event, long &frontier, uint die, bool insert_events);
+	long lookup(Event &event, long lpn);
+	void update_mapping(Event &event, long lpn, long ppn);
+
+	// Logical page -> physical page and back (-1 if not mapped)
 	long *map;
+	long *reverse_map;
+
+	// Current page of each open data block (-1 before its first block)
+	std::vector<long> frontiers;
+	uint nextFrontier;
+
+	// Open block for pages relocated by GC and the die it was taken from
+	long gcFrontier;
+	uint gcDie;
+
+	ulong numPagesActive;
+	int addressBytes;
 };
 
-class FtlImpl_Bast : public FtlParent
+class FtlImpl_Bast final : public FtlParent
 {
 public:
 	FtlImpl_Bast(Controller &controller);
@@ -798,18 +1286,51 @@ public:
 	enum status read(Event &event);
 	enum status write(Event &event);
 	enum status trim(Event &event);
+	void checkpoint(Checkpoint &cp);
+	enum status precondition(Precondition &state);
 private:
-	std::map<long, LogPageBlock*> log_map;
+	long pool_index(LogPageBlock *logBlock) const;
+	LogPageBlock *pool_block(long index);
+
+	// Logical block -> index into log_pool
+	HashIndex log_index;
+
+	// Preallocated log blocks. Unused ones are chained on log_free, used
+	// ones are kept in victim order from log_head to log_tail.
+	LogPageBlock *log_pool;
+	LogPageBlock *log_free;
+	LogPageBlock *log_head;
+	LogPageBlock *log_tail;
+	uint log_count;
+
+	// Cheapest merge: used log blocks bucketed by merge cost, least
+	// recently written first. No bucket below cost_min is used.
+	std::vector<LogPageBlock*> cost_buckets;
+	std::vector<LogPageBlock*> cost_tails;
+	uint cost_min;
+
+	// Host writes served so far
+	ulong host_writes;
 
 	long *data_list;
 
+	LogPageBlock *find_logblock(long lba);
+	void unlink_logblock(LogPageBlock *logBlock);
+	void append_logblock(LogPageBlock *logBlock);
+	LogPageBlock *select_victim();
+	ulong merge_cost(LogPageBlock *logBlock);
+	bool is_filling(LogPageBlock *logBlock) const;
+	void update_cost(LogPageBlock *logBlock);
+	void remove_cost(LogPageBlock *logBlock);
+	void rebuild_costs(void);
 	void dispose_logblock(LogPageBlock *logBlock, long lba);
 	void allocate_new_logblock(LogPageBlock *logBlock, long lba, Event &event);
 
 	bool is_sequential(LogPageBlock* logBlock, long lba, Event &event);
+	bool partial_merge(LogPageBlock *logBlock, long lba, Event &event);
 	bool random_merge(LogPageBlock *logBlock, long lba, Event &event);
 
-	void update_map_block(Event &event);
+	void update_map_block(Event &event, long lbn);
 
 	void print_ftl_statistics();
 
@@ -817,7 +1338,7 @@ private:
 	int addressSize;
 };
 
-class FtlImpl_Fast : public FtlParent
+class FtlImpl_Fast final : public FtlParent
 {
 public:
 	FtlImpl_Fast(Controller &controller);
@@ -825,6 +1346,8 @@ public:
 	enum status read(Event &event);
 	enum status write(Event &event);
 	enum status trim(Event &event);
+	void checkpoint(Checkpoint &cp);
+	enum status precondition(Precondition &state);
 private:
 	void initialize_log_pages();
 
@@ -835,20 +1358,53 @@ private:
 
 	bool write_to_log_block(Event &event, long logicalBlockAddress);
 
-	void switch_sequential(Event &event);
-	void merge_sequential(Event &event);
+	// Sequential (SW) log block following one stream
+	struct SeqLog {
+		long lbn;
+		Address address;
+		uint offset;
+		ulong lastUse;
+
+		ulong switches;
+		ulong merges;
+
+		SeqLog();
+	};
+
+	SeqLog *seq_logs;
+	ulong seq_clock;
+
+	SeqLog *find_sequential(long lbn);
+	SeqLog *victim_sequential();
+	void close_sequential(Event &event, SeqLog &seq);
+	void switch_sequential(Event &event, SeqLog &seq);
+	void merge_sequential(Event &event, SeqLog &seq);
 	bool random_merge(LogPageBlock *logBlock, Event &event);
 
-	void update_map_block(Event &event);
+	void update_map_block(Event &event, long lbn);
 
 	void print_ftl_statistics();
 
-	long sequential_logicalblock_address;
-	Address sequential_address;
-	uint sequential_offset;
-
 	uint log_page_next;
-	LogPageBlock *log_pages;
+
+	// RW log blocks as a ring, oldest at log_head. A log slot is the ring
+	// position of the block times BLOCK_SIZE plus the page in the block.
+	LogPageBlock **log_ring;
+	uint log_head;
+
+	// Logical page -> log slot holding its latest copy
+	HashIndex lpn_index;
+
+	// Logical block -> first log slot of the block. The slots of a logical
+	// block are chained through slot_next and slot_prev.
+	HashIndex lbn_index;
+	long *slot_next;
+	long *slot_prev;
+
+	LogPageBlock *slot_block(long slot);
+	void link_log_page(long slot, long lpn);
+	void drop_log_page(long lpn);
+	void drop_log_block(long lbn);
 
 	int addressShift;
 	int addressSize;
@@ -864,6 +1420,9 @@ public:
 	virtual enum status read(Event &event) = 0;
 	virtual enum status write(Event &event) = 0;
 	virtual enum status trim(Event &event) = 0;
+	virtual void resolve_batch(Event &event, const std::vector<long> &lpns, bool isWrite);
+	virtual void checkpoint(Checkpoint &cp);
+	virtual enum status precondition(Precondition &state);
 protected:
 	struct MPage {
 		long vpn;
@@ -873,7 +1432,7 @@ protected:
 		double last_visited_time;
 		bool cached;
 
-		MPage(long vpn);
+		MPage(long vpn = -1);
 	};
 
 	long int cmt;
@@ -898,18 +1457,77 @@ protected:
 	long *reverse_trans_map;
 
 	void consult_GTD(long dppn, Event &event);
+	void consult_GTD(const std::vector<long> &dlpns, Event &event);
+	void read_mapping_page(Event &event);
+
+	// Scratch buffers of consult_GTD
+	std::vector<long> gtd_lpns;
+	std::vector<long> gtd_journal_pages;
+	void write_mapping_page(Event &event);
 	void reset_MPage(FtlImpl_DftlParent::MPage &mpage);
 
 	void resolve_mapping(Event &event, bool isWrite);
+	void resolve_mapping(Event &event, const std::vector<long> &dlpns, bool isWrite);
+
+	// Pages of the current multi-page request already resolved by the batch
+	std::set<long> batched;
 	void update_translation_map(FtlImpl_DftlParent::MPage &mpage, long ppn);
 
 	bool lookup_CMT(long dlpn, Event &event);
+	void touch_CMT(long dlpn, Event &event, bool isWrite);
+	void insert_CMT(long dlpn, Event &event, bool isWrite);
 
 	long get_free_data_page(Event &event);
 	long get_free_data_page(Event &event, bool insert_events);
 
-	void evict_page_from_cache(Event &event);
+	void evict_page_from_cache(Event &event, uint reserve = 1);
 	void evict_specific_page_from_cache(Event &event, long lba);
+	void write_translation_page(Event &event, long mvpn);
+
+	// Mapping updates from garbage collection (dlpn, new dppn)
+	std::vector<std::pair<long, long> > gc_updates;
+	void stage_translation_update(long dlpn, long dppn);
+	void apply_translation_updates(Event &event);
+	void relocate_valid_pages(Event &event, const std::vector<Block*> &blocks);
+
+	// Mapping update journal (dlpn -> journal page)
+	std::unordered_map<long, long> journal_index;
+	std::set<long> journal_tpages;
+	long lookup_journal(long dlpn);
+	void append_journal(Event &event, long dlpn);
+	void compact_journal(Event &event);
+	void print_mapping_statistics();
+
+	int journalPerPage;
+	ulong journalNext;
+	ulong journalReads;
+	ulong journalWrites;
+	ulong journalCompactions;
+
+	// Compressed CMT (start dlpn -> length)
+	std::map<long, uint> cmt_extents;
+	uint extentSize;
+	ulong cmtBudget;
+	std::map<long, uint>::iterator find_extent(long dlpn);
+	bool is_contiguous(long dppn, long next_dppn);
+	void insert_extent(long dlpn);
+	void remove_extent(long dlpn);
+	void remap_extent(long dlpn, long dppn);
+	void evict_extent_from_cache(Event &event, uint reserve);
+
+	// Host Memory Buffer tier (dlpn -> position in LRU, dirty)
+	std::list<long> hmb_lru;
+	std::unordered_map<long, std::pair<std::list<long>::iterator, bool> > hmb_index;
+	ulong totalHMBentries;
+	ulong hmbHits;
+	ulong hmbFaults;
+	ulong hmbEvictions;
+	ulong hmbPeak;
+	bool lookup_HMB(long dlpn, Event &event, bool &dirty);
+	bool take_HMB(long dlpn, bool &dirty);
+	void insert_HMB(Event &event, long dlpn, bool dirty);
+	void release_CMT_entry(Event &event, const MPage &evictPage);
+	bool dirty_in_HMB(long dlpn);
 
 	// Mapping information
 	int addressPerPage;
@@ -921,7 +1539,7 @@ protected:
 	long currentTranslationPage;
 };
 
-class FtlImpl_Dftl : public FtlImpl_DftlParent
+class FtlImpl_Dftl final : public FtlImpl_DftlParent
 {
 public:
 	FtlImpl_Dftl(Controller &controller);
@@ -930,10 +1548,11 @@ public:
 	enum status write(Event &event);
 	enum status trim(Event &event);
 	void cleanup_block(Event &event, Block *block);
+	void cleanup_blocks(Event &event, const std::vector<Block*> &blocks);
 	void print_ftl_statistics();
 };
 
-class FtlImpl_BDftl : public FtlImpl_DftlParent
+class FtlImpl_BDftl final : public FtlImpl_DftlParent
 {
 public:
 	FtlImpl_BDftl(Controller &controller);
@@ -942,12 +1561,19 @@ public:
 	enum status write(Event &event);
 	enum status trim(Event &event);
 	void cleanup_block(Event &event, Block *block);
+	void cleanup_blocks(Event &event, const std::vector<Block*> &blocks);
+	void resolve_batch(Event &event, const std::vector<long> &lpns, bool isWrite);
+	void checkpoint(Checkpoint &cp);
 private:
 	struct BPage {
 		uint pbn;
 		unsigned char nextPage;
 		bool optimal;
 
+		// Block receiving a sequential rewrite of a page mapped block
+		uint seqPbn;
+		unsigned char seqNext;
+
 		BPage();
 	};
 
@@ -956,13 +1582,100 @@ private:
 
 	std::queue<Block*> blockQueue;
 
+	// Logical blocks with a sequential rewrite in progress, oldest first
+	std::list<uint> seqOpen;
+
+	// Logical block of the write being served. GC must not remap it.
+	long writeLbn;
+
 	Block* inuseBlock;
 	bool block_next_new();
 	long get_free_biftl_page(Event &event);
+	void page_map_block(Event &event, uint dlbn);
+	void queue_block(Block *block);
+	bool write_sequential(Event &event, uint dlbn);
+	void abandon_sequential(uint dlbn);
+	void promote_block(Event &event, uint dlbn, uint pbn);
+	void copy_page(Event &event, long fromPpn, long toPpn);
+	bool relocate_block_mapped(Event &event, Block *block);
+	void resequentialize_block(Event &event, uint dlbn);
 	void print_ftl_statistics();
+
+	ulong numSequentialPromotions;
+	ulong numGCPromotions;
+	ulong numBlockPathIO;
+	ulong numPagePathIO;
 };
 
 
+/* Page mapping FTL that keeps the page map as error-bounded piecewise-linear
+ * segments (LeaFTL). Segments are kept in levels where newer segments shadow
+ * older overlapping ones. Predictions are checked against the LPN stored in
+ * the OOB area of the flash page. */
+class FtlImpl_LeaFtl final : public FtlParent
+{
+public:
+	FtlImpl_LeaFtl(Controller &controller);
+	~FtlImpl_LeaFtl();
+	enum status read(Event &event);
+	enum status write(Event &event);
+	enum status trim(Event &event);
+	void cleanup_block(Event &event, Block *block);
+	void cleanup_blocks(Event &event, const std::vector<Block*> &blocks);
+	void print_ftl_statistics();
+	void checkpoint(Checkpoint &cp);
+	enum status precondition(Precondition &state);
+private:
+	struct Segment {
+		long start;
+		long end;
+		long intercept;
+		double slope;
+		uint level;
+		uint learned;
+		uint live;
+	};
+
+	long predict(const Segment &segment, long lpn) const;
+	bool in_oob(long ppn, long lpn);
+	long lookup(Event &event, long lpn);
+	void drop_mapping(long lpn);
+	void buffer_mapping(long lpn, long ppn);
+	void learn_segments(Event &event);
+	void learn(const std::vector<std::pair<long, long> > &points);
+	int new_segment(long start, long end, long intercept, double slope, uint learned);
+	void insert_segment(int id, uint level);
+	void remove_segment(int id);
+	void retrain_segments(Event &event);
+	void read_oob_page(Event &event);
+	long get_free_data_page(Event &event, bool insert_events);
+	ulong segment_bytes() const;
+
+	// Mapping updates not learned yet (lpn -> ppn)
+	std::map<long, long> buffer;
+
+	// Segments by level, each level indexed by start lpn
+	std::vector<Segment> segments;
+	std::vector<int> free_segments;
+	std::vector<std::map<long, int> > levels;
+	std::set<int> retrain;
+
+	// LPN stored in the OOB area of each physical page
+	long *oob_lpn;
+
+	// Segment holding the current mapping of each lpn (bookkeeping only)
+	int *owner;
+
+	long currentDataPage;
+	uint addressBytes;
+	ulong numLookups;
+	ulong numLevelsProbed;
+	ulong numMispredictions;
+	ulong numFalseProbes;
+	ulong numBufferHits;
+	ulong numRetrained;
+};
+
 /* This is a basic implementation that only provides delay updates to events
  * based on a delay value multiplied by the size (number of pages) needed to
  * be written. */
@@ -978,6 +1691,48 @@ private:
 	double write_delay;
 };
 
+/* Write buffer in front of the FTL. Buffered pages are grouped by logical
+ * block and the least recently used block is written to the FTL as a whole,
+ * padded with its pages from flash (BPLRU). */
+class WriteBuffer
+{
+public:
+	WriteBuffer(Controller &controller);
+	~WriteBuffer(void);
+	enum status read(Event &event);
+	enum status write(Event &event);
+	enum status trim(Event &event);
+	enum status flush(Event &event);
+	void print_statistics();
+	void checkpoint(Checkpoint &cp);
+private:
+	struct BufferedBlock {
+		int *frames;
+		uint pages;
+		std::list<long>::iterator position;
+	};
+
+	char *frame_data(int frame);
+	enum status evict_block(Event &event);
+
+	Controller &controller;
+
+	// Logical block -> buffered pages, least recently used block first
+	std::unordered_map<long, BufferedBlock> blocks;
+	std::list<long> lru;
+
+	std::vector<int> free_frames;
+	char *data;
+
+	// Logical pages that hold data, to know which pages to pad
+	std::vector<bool> written;
+	bool padding;
+
+	ulong numHits;
+	ulong numEvictions;
+	ulong numPadded;
+};
+
 /* The controller accepts read/write requests through its event_arrive method
  * and consults the FTL regarding what to do by calling the FTL's read/write
  * methods.  The FTL returns an event list for the controller through its issue
@@ -992,6 +1747,7 @@ public:
 	Controller(Ssd &parent);
 	~Controller(void);
 	enum status event_arrive(Event &event);
+	enum status flush(Event &event);
 	friend class FtlParent;
 	friend class FtlImpl_Page;
 	friend class FtlImpl_Bast;
@@ -999,13 +1755,18 @@ public:
 	friend class FtlImpl_DftlParent;
 	friend class FtlImpl_Dftl;
 	friend class FtlImpl_BDftl;
+	friend class FtlImpl_LeaFtl;
 	friend class Block_manager;
+	friend class WriteBuffer;
 
 	Stats stats;
 	void print_ftl_statistics();
 	const FtlParent &get_ftl(void) const;
+	void checkpoint(Checkpoint &cp);
+	enum status precondition(Precondition &state);
 private:
 	enum status issue(Event &event_list);
+	enum status issue_functional(Event &event_list);
 	void translate_address(Address &address);
 	ssd::ulong get_erases_remaining(const Address &address) const;
 	void get_least_worn(Address &address) const;
@@ -1017,8 +1778,49 @@ private:
 	ssd::uint get_num_valid(const Address &address) const;
 	ssd::uint get_num_invalid(const Address &address) const;
 	Block *get_block_pointer(const Address & address);
+
+	// FTL registry. The FTL of FTL_IMPLEMENTATION is created with the
+	// controller, and requests reach it through the request path
+	// instantiated for its type.
+	struct FtlEntry;
+	static const FtlEntry ftl_registry[];
+	template <class FTL> static FtlParent *create_ftl(Controller &controller);
+	template <class FTL> static enum status serve_ftl(Controller &controller, Event &event);
+	template <class FTL> enum status serve(FTL &ftl, Event &event);
+	template <class FTL> enum status serve_range(FTL &ftl, Event &event);
+	enum status (*ftl_serve)(Controller &controller, Event &event);
+
 	Ssd &ssd;
 	FtlParent *ftl;
+	WriteBuffer *buffer;
+};
+
+/* Configuration of a simulation: a config file and entries that override
+ * it. apply() sets the configuration of the calling thread to the defaults
+ * and loads it. current() captures the configuration of the calling thread.
+ * Each Ssd keeps the configuration it was built with and applies it again
+ * when it serves a request on a thread with another configuration. */
+class SimConfig
+{
+public:
+	SimConfig(const char *config_name = "ssd.conf");
+	~SimConfig(void);
+	static SimConfig current(void);
+	void set(const char *name, double value);
+	void set_text(const char *name, const char *value);
+	void apply(void) const;
+	bool is_applied(void) const;
+	const char *get_name(void) const;
+private:
+	static ulong next_id(void);
+
+	// Changes with the entries, copies of a SimConfig share it.
+	ulong id;
+	std::string config_name;
+	std::vector<std::pair<std::string, double> > file_entries;
+	std::vector<std::pair<std::string, std::string> > file_text_entries;
+	std::vector<std::pair<std::string, double> > entries;
+	std::vector<std::pair<std::string, std::string> > text_entries;
 };
 
 /* The SSD is the single main object that will be created to simulate a real
@@ -1028,6 +1830,7 @@ class Ssd
 {
 public:
 	Ssd (uint ssd_size = SSD_SIZE);
+	Ssd (const SimConfig &config);
 	~Ssd(void);
 	double event_arrive(enum event_type type, ulong logical_address, uint size, double start_time);
 	double event_arrive(enum event_type type, ulong logical_address, uint size, double start_time, void *buffer);
@@ -1041,7 +1844,21 @@ public:
 
 	void print_ftl_statistics();
 	double ready_at(void);
+	uint get_free_blocks(void);
+	double collect_garbage(double start_time);
+	double flush(double start_time);
+	enum status save_checkpoint(const char *path);
+	enum status load_checkpoint(const char *path);
+	enum status precondition(void);
+	void set_functional(bool functional);
+	bool is_functional(void) const;
+	// Copy of this SSD; only the page data is shared copy-on-write, the
+	// maps and block state are copied
+	Ssd *clone(void);
+	friend class RaidSsd;
 private:
+	Ssd (uint ssd_size, bool map_data, int member = -1);
+	enum status checkpoint(Checkpoint &cp);
 	enum status read(Event &event);
 	enum status write(Event &event);
 	enum status erase(Event &event);
@@ -1060,6 +1877,13 @@ private:
 	ssd::uint get_num_valid(const Address &address) const;
 	ssd::uint get_num_invalid(const Address &address) const;
 	Block *get_block_pointer(const Address & address);
+	static uint apply_config(const SimConfig &config);
+	void activate(void);
+	void map_pages(ulong bytes);
+	void advise_pages(ulong bytes);
+	enum status replay_precondition(void);
+	int share_pages(void);
+	void unshare_pages(void);
 
 	uint size;
 	Controller controller;
@@ -1069,6 +1893,32 @@ private:
 	ulong erases_remaining;
 	ulong least_worn;
 	double last_erase_time;
+
+	// Owned by this SSD and made current on the thread while it serves a
+	// request.
+	Block_manager *block_manager;
+	void *pages;
+	void *result;
+
+	// Bytes mapped at pages, unmapped with them
+	ulong pages_bytes;
+
+	// Open PAGE_DATA_FILE backing pages (-1 -> memory only)
+	int pages_file;
+
+	// Name of the page data file, PAGE_DATA_FILE with the index of the SSD
+	// appended in a RAID
+	std::string pages_name;
+
+	// Requests skip the bus, RAM and flash timing (FUNCTIONAL_MODE)
+	bool functional;
+
+	// Memory file holding the page data as it is now, mapped copy-on-write
+	// by the clones of this SSD (-1 -> none, or changed since)
+	int pages_base;
+
+	// Configuration the SSD was built with
+	SimConfig config;
 };
 
 class RaidSsd
@@ -1087,11 +1937,73 @@ public:
 	const Controller &get_controller(void) const;
 
 	void print_ftl_statistics();
+	void set_functional(bool functional);
+	bool is_functional(void) const;
 private:
+	// Part of a request served by one SSD
+	struct Request {
+		enum event_type type;
+		ulong logical_address;
+		uint size;
+		void *buffer;
+		char *result; // Pages read are copied here, if not NULL
+	};
+
+	void add_request(uint ssd, enum event_type type, ulong logical_address, uint size, void *buffer, char *result = NULL);
+	double run_round(double start_time);
+	void serve(uint ssd, const std::vector<Request> &list, double start_time);
+	void run_worker(uint ssd);
+
+	// RAID-5/6
+	uint get_parity_ssds(void) const;
+	uint get_data_ssd(ulong stripe, uint chunk) const;
+	uint get_parity_ssd(ulong stripe, uint parity) const;
+	bool is_failed(uint ssd) const;
+	double recover(char *slot, uint chunks, const std::vector<uint> &lost, bool q);
+	bool is_busy(ulong stripe, uint chunk, double start_time);
+	void coordinate_gc(double start_time);
+	double parity_read(ulong logical_address, uint size, double start_time);
+	double parity_write(ulong logical_address, uint size, double start_time, void *buffer);
+
 	uint size;
 
 	Ssd *Ssds;
 
+	// Requests of each SSD for the request in progress and their latency
+	std::vector<std::vector<Request> > requests;
+	std::vector<double> latency;
+	int last;
+
+	// RAID-5/6: the page returned by get_result_buffer, the reads and
+	// writes each SSD serves for parity and the time spent on parity
+	std::vector<char> page;
+	void *result;
+	std::vector<ulong> numParityReads;
+	std::vector<ulong> numParityWrites;
+	double parityTime;
+
+	// Reads served around a busy SSD, garbage collections started on each
+	// SSD and the time the one in progress completes
+	std::vector<ulong> numBusyReads;
+	std::vector<ulong> numCoordinatedGC;
+	double collecting;
+
+	// One worker thread per SSD with RAID_PARALLEL. A new round is started
+	// for each request, the workers with requests report back through done.
+	// Under the lock, a round moves the requests of an SSD to its worker
+	// and assigns it the round number; a worker only serves the requests
+	// of the round it was assigned.
+	SimConfig config;
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done;
+	std::vector<std::vector<Request> > work;
+	std::vector<ulong> assigned;
+	ulong round;
+	uint pending;
+	double start;
+	bool stop;
 };
 } /* end namespace ssd */
 
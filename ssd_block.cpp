@@ -277,3 +277,64 @@ void Block::set_block_type(block_type value)
 {
 	this->btype = value;
 }
+
+/*
+ * Save or load the state of the block and its pages. The page states are
+ * kept as one array per block.
+ */
+void Block::checkpoint(Checkpoint &cp)
+{
+	cp.value(pages_invalid);
+	cp.value(pages_valid);
+	cp.value(state);
+	cp.value(erases_remaining);
+	cp.value(last_erase_time);
+	cp.value(modification_time);
+	cp.value(btype);
+
+	std::vector<enum page_state> states(size);
+	for (uint i=0;i<size;i++)
+		states[i] = data[i].get_state();
+
+	cp.array(&states[0], size);
+
+	if (cp.is_loading())
+		for (uint i=0;i<size;i++)
+			data[i].set_state(states[i]);
+}
+
+/*
+ * Take over the pages and the wear the preconditioning left in the block.
+ * The block manager rebuilds its cost index afterwards.
+ */
+void Block::precondition(const Precondition &state)
+{
+	ulong block = physical_address / BLOCK_SIZE;
+	uint written = state.written[block];
+
+	for (uint i=0;i<size;i++)
+	{
+		if (i >= written)
+			data[i].set_state(EMPTY);
+		else if (state.reverse[physical_address + i] != -1)
+			data[i].set_state(VALID);
+		else
+			data[i].set_state(INVALID);
+	}
+
+	pages_valid = written;
+	pages_invalid = state.invalid[block];
+
+	assert(state.erases[block] < erases_remaining);
+	erases_remaining -= state.erases[block];
+
+	if (pages_valid == 0)
+		this->state = FREE;
+	else if (pages_invalid >= size)
+		this->state = INACTIVE;
+	else
+		this->state = ACTIVE;
+
+	if (pages_valid > 0)
+		btype = DATA;
+}
@@ -4,6 +4,14 @@
  *
  * This class handle allocation of block pools for the FTL
  * algorithms.
+ *
+ * For the log block FTLs it also keeps the block map directory. The
+ * directory pages are written out of place to reserved blocks spread over
+ * the SSD. The directory gets the blocks its pages fill plus one for
+ * cleaning, or MAP_DIRECTORY_SIZE blocks if that is more. One directory
+ * page is cached in SRAM and collects updates before it is written. When
+ * the directory blocks are used up, the block with the fewest valid
+ * directory pages is cleaned.
  */
 
 #include <new>
@@ -13,6 +21,7 @@
 #include <stdexcept>
 #include <algorithm>
 #include <queue>
+#include <boost/iterator/indirect_iterator.hpp>
 #include "ssd.h"
 
 using namespace ssd;
@@ -36,6 +45,35 @@ Block_manager::Block_manager(FtlParent *ftl) : ftl(ftl)
 	max_map_pages = MAP_DIRECTORY_SIZE * BLOCK_SIZE;
 
 	directoryCurrentPage = 0;
+	directoryCachedPage = -1;
+	directoryCurrentBlock = 0;
+	directoryPending = 0;
+	directoryStride = 0;
+
+	numDirectoryUpdates = 0;
+	numDirectoryReads = 0;
+	numDirectoryWrites = 0;
+	numDirectoryCleans = 0;
+
+	// Each directory entry holds the physical block of a logical block.
+	directoryPerPage = PAGE_SIZE / sizeof(uint);
+
+	if (MAP_DIRECTORY_SIZE > 0 && (FTL_IMPLEMENTATION == IMPL_BAST || FTL_IMPLEMENTATION == IMPL_FAST))
+	{
+		directoryPages.resize((max_blocks + directoryPerPage - 1) / directoryPerPage, -1);
+
+		// One block is kept free for cleaning.
+		uint reserved = (directoryPages.size() + BLOCK_SIZE - 1) / BLOCK_SIZE + 1;
+		if (reserved < MAP_DIRECTORY_SIZE)
+			reserved = MAP_DIRECTORY_SIZE;
+
+		assert(reserved < max_blocks);
+
+		directoryStride = max_blocks / reserved;
+		for (uint i=0;i<reserved;i++)
+			directoryBlocks.push_back(((ulong)i * directoryStride + directoryStride - 1) * BLOCK_SIZE);
+	}
+
 	num_insert_events = 0;
 
 	data_active = 0;
@@ -44,9 +82,23 @@ Block_manager::Block_manager(FtlParent *ftl) : ftl(ftl)
 	current_writing_block = -2;
 
 	out_of_blocks = false;
+	cleaning = false;
 
 	simpleCurrentFree = 0;
 
+	// Never written blocks are handed out per die. Virtual pages that do
+	// not divide evenly over the dies fall back to a single range.
+	uint dies = SSD_SIZE * PACKAGE_SIZE * DIE_SIZE;
+	if (max_blocks % dies != 0)
+		dies = 1;
+	dieBlocks = max_blocks / dies;
+
+	for (uint i=0;i<dies;i++)
+	{
+		dieCurrentFree.push_back((ulong)i * dieBlocks * BLOCK_SIZE);
+		skip_map_blocks(i);
+	}
+
 	active_cost.reserve(NUMBER_OF_ADDRESSABLE_BLOCKS);
 }
 
@@ -74,16 +126,28 @@ Block_manager *Block_manager::instance()
  * Retrieves a page using either simple approach (when not all
  * pages have been written or the complex that retrieves
  * it from a free page list.
+ *
+ * A die below SSD_SIZE * PACKAGE_SIZE * DIE_SIZE asks for a block of that
+ * die, which is honoured while the die has free blocks. Otherwise the never
+ * written blocks are handed out in address order.
  */
-void Block_manager::get_page_block(Address &address, Event &event)
+void Block_manager::get_page_block(Address &address, Event &event, int die)
 {
 	// We need separate queues for each plane? communication channel? communication channel is at the per die level at the moment. i.e. each LUN is a die.
 
 	if (simpleCurrentFree < max_blocks*BLOCK_SIZE)
 	{
-		address.set_linear_address(simpleCurrentFree, BLOCK);
-		current_writing_block = simpleCurrentFree;
+		uint d = 0;
+		if (die >= 0 && (uint)die < dieCurrentFree.size() && dieCurrentFree[die] < die_end(die))
+			d = die;
+		while (dieCurrentFree[d] == die_end(d))
+			d++;
+
+		address.set_linear_address(dieCurrentFree[d], BLOCK);
+		current_writing_block = dieCurrentFree[d];
+		dieCurrentFree[d] += BLOCK_SIZE;
 		simpleCurrentFree += BLOCK_SIZE;
+		skip_map_blocks(d);
 	}
 	else
 	{
@@ -94,13 +158,47 @@ void Block_manager::get_page_block(Address &address, Event &event)
 		}
 
 		assert(free_list.size() != 0);
-		address.set_linear_address(free_list.front()->get_physical_address(), BLOCK);
-		current_writing_block = free_list.front()->get_physical_address();
-		free_list.erase(free_list.begin());
+
+		std::vector<Block*>::iterator it = free_list.begin();
+		if (die >= 0)
+		{
+			while (it != free_list.end() && (ulong)(*it)->get_physical_address() / BLOCK_SIZE / dieBlocks != (ulong)die)
+				++it;
+			if (it == free_list.end())
+				it = free_list.begin();
+		}
+
+		address.set_linear_address((*it)->get_physical_address(), BLOCK);
+		current_writing_block = (*it)->get_physical_address();
+		free_list.erase(it);
 		out_of_blocks = false;
 	}
 }
 
+/*
+ * First page after the blocks of a die.
+ */
+ulong Block_manager::die_end(uint die) const
+{
+	return (ulong)(die + 1) * dieBlocks * BLOCK_SIZE;
+}
+
+/*
+ * Skip the blocks reserved for the map directory.
+ */
+void Block_manager::skip_map_blocks(uint die)
+{
+	while (dieCurrentFree[die] < die_end(die) && is_map_block(dieCurrentFree[die] / BLOCK_SIZE))
+	{
+		dieCurrentFree[die] += BLOCK_SIZE;
+		simpleCurrentFree += BLOCK_SIZE;
+	}
+}
+
+uint Block_manager::get_num_dies() const
+{
+	return dieCurrentFree.size();
+}
 
 Address Block_manager::get_free_block(Event &event)
 {
@@ -143,6 +241,8 @@ void Block_manager::print_statistics()
 	printf("Free blocks: %lu\n", (max_blocks - (simpleCurrentFree/BLOCK_SIZE)) + free_list.size());
 	printf("Invalid blocks: %lu\n", invalid_list.size());
 	printf("Free2 blocks: %lu\n", (unsigned long int)invalid_list.size() + (unsigned long int)log_active + (unsigned long int)data_active - (unsigned long int)free_list.size());
+	if (!directoryBlocks.empty())
+		printf("Map directory: Blocks: %lu Pages: %lu Updates: %lu Reads: %lu Writes: %lu Cleans: %lu\n", (ulong)directoryBlocks.size(), (ulong)directoryPages.size(), numDirectoryUpdates, numDirectoryReads, numDirectoryWrites, numDirectoryCleans);
 	printf("-----------------\n");
 
 
@@ -168,15 +268,16 @@ void Block_manager::invalidate(Address address, block_type type)
 /*
  * Insert erase events into the event stream.
  * The strategy is to clean up all invalid pages instantly.
+ * A forced round runs even when the SSD is not yet full.
  */
-void Block_manager::insert_events(Event &event)
+void Block_manager::insert_events(Event &event, bool force)
 {
 	// Calculate if GC should be activated.
 	float used = (int)invalid_list.size() + (int)log_active + (int)data_active - (int)free_list.size();
 	float total = NUMBER_OF_ADDRESSABLE_BLOCKS;
 	float ratio = used/total;
 
-	if (ratio < 0.90) // Magic number
+	if ((ratio < 0.90 && !force) || cleaning) // Magic number
 		return;
 
 	uint num_to_erase = 5; // More Magic!
@@ -200,8 +301,10 @@ void Block_manager::insert_events(Event &event)
 
 	num_insert_events++;
 
-	if (FTL_IMPLEMENTATION == IMPL_DFTL || FTL_IMPLEMENTATION == IMPL_BIMODAL)
+	if (FTL_IMPLEMENTATION == IMPL_PAGE || FTL_IMPLEMENTATION == IMPL_DFTL || FTL_IMPLEMENTATION == IMPL_BIMODAL || FTL_IMPLEMENTATION == IMPL_LEAFTL)
 	{
+		// Blocks allocated by cleanup_block must not start another round.
+		cleaning = true;
 
 		ActiveByCost::iterator it = active_cost.get<1>().end();
 		--it;
@@ -212,23 +315,34 @@ void Block_manager::insert_events(Event &event)
 			if (current_writing_block != (*it)->physical_address)
 			{
 				//printf("erase p: %p phy: %li ratio: %i num: %i\n", (*it), (*it)->physical_address, (*it)->get_pages_invalid(), num_to_erase);
-				Block *blockErase = (*it);
+				std::vector<Block*> victims;
+				select_victims(it, num_to_erase, victims);
+
+				// Let the FTL handle cleanup of the blocks.
+				if (victims.size() == 1)
+					ftl->cleanup_block(event, victims[0]);
+				else
+					ftl->cleanup_blocks(event, victims);
+
+				for (uint i=0;i<victims.size();i++)
+				{
+					Block *blockErase = victims[i];
 
-				// Let the FTL handle cleanup of the block.
-				ftl->cleanup_block(event, blockErase);
+					// Create erase event and attach to current event queue.
+					Event erase_event = Event(ERASE, event.get_logical_address(), 1, event.get_start_time());
+					erase_event.set_address(Address(blockErase->get_physical_address(), BLOCK));
 
-				// Create erase event and attach to current event queue.
-				Event erase_event = Event(ERASE, event.get_logical_address(), 1, event.get_start_time());
-				erase_event.set_address(Address(blockErase->get_physical_address(), BLOCK));
+					// Execute erase
+					if (ftl->controller.issue(erase_event) == FAILURE) { assert(false);	}
 
-				// Execute erase
-				if (ftl->controller.issue(erase_event) == FAILURE) { assert(false);	}
+					free_list.push_back(blockErase);
 
-				free_list.push_back(blockErase);
+					event.incr_time_taken(erase_event.get_time_taken());
 
-				event.incr_time_taken(erase_event.get_time_taken());
+					ftl->controller.stats.numFTLErase++;
+				}
 
-				ftl->controller.stats.numFTLErase++;
+				num_to_erase -= victims.size() - 1;
 			}
 
 			it = active_cost.get<1>().end();
@@ -239,13 +353,50 @@ void Block_manager::insert_events(Event &event)
 
 			num_to_erase--;
 		}
+
+		cleaning = false;
+	}
+}
+
+/*
+ * Pick the GC victims starting at it. With GC_SORT_BY_LPN above one, the
+ * next most invalid blocks are cleaned together, as long as their valid
+ * pages fit in the free blocks.
+ */
+void Block_manager::select_victims(ActiveByCost::iterator it, uint num_to_erase, std::vector<Block*> &victims)
+{
+	victims.push_back(*it);
+
+	int toMove = (*it)->get_pages_valid() - (*it)->get_pages_invalid();
+	int freePages = (get_num_free_blocks() - 1) * BLOCK_SIZE;
+
+	while (victims.size() < GC_SORT_BY_LPN && victims.size() < num_to_erase && it != active_cost.get<1>().begin())
+	{
+		--it;
+
+		if ((*it)->get_pages_invalid() == 0 || (*it)->get_pages_valid() != BLOCK_SIZE)
+			break;
+
+		if (current_writing_block == (*it)->physical_address)
+			continue;
+
+		toMove += BLOCK_SIZE - (*it)->get_pages_invalid();
+		if (toMove > freePages)
+			break;
+
+		victims.push_back(*it);
 	}
 }
 
 Address Block_manager::get_free_block(block_type type, Event &event)
+{
+	return get_free_block(type, event, -1);
+}
+
+Address Block_manager::get_free_block(block_type type, Event &event, int die)
 {
 	Address address;
-	get_page_block(address, event);
+	get_page_block(address, event, die);
 	switch (type)
 	{
 	case DATA:
@@ -317,7 +468,7 @@ void Block_manager::erase_and_invalidate(Event &event, Address &address, block_t
 int Block_manager::get_num_free_blocks()
 {
 	if (simpleCurrentFree < max_blocks*BLOCK_SIZE)
-		return (simpleCurrentFree / BLOCK_SIZE) + free_list.size();
+		return (max_blocks - simpleCurrentFree / BLOCK_SIZE) + free_list.size();
 	else
 		return free_list.size();
 }
@@ -327,3 +478,242 @@ void Block_manager::update_block(Block * b)
 	std::size_t pos = (b->physical_address / BLOCK_SIZE);
 	active_cost.replace(active_cost.begin()+pos, b);
 }
+
+bool Block_manager::is_map_block(ulong blockNumber) const
+{
+	return directoryStride != 0 && blockNumber % directoryStride == directoryStride - 1 && blockNumber / directoryStride < directoryBlocks.size();
+}
+
+/*
+ * Record a block map change of a logical block. The directory page of the
+ * logical block is brought into SRAM, writing out the cached page first,
+ * and is written after MAP_DIRECTORY_BATCH updates.
+ */
+void Block_manager::update_map_directory(Event &event, long lbn)
+{
+	long page = lbn / directoryPerPage;
+
+	numDirectoryUpdates++;
+
+	if (page != directoryCachedPage)
+	{
+		flush_map_directory(event);
+
+		if (directoryPages[page] != -1)
+		{
+			Event readEvent = Event(READ, event.get_logical_address(), 1, event.get_start_time()+event.get_time_taken());
+			readEvent.set_address(Address(directoryPages[page], PAGE));
+			if (ftl->controller.issue(readEvent) == FAILURE) { assert(false); }
+
+			event.incr_time_taken(readEvent.get_time_taken());
+			ftl->controller.stats.numFTLRead++;
+			numDirectoryReads++;
+		}
+
+		directoryCachedPage = page;
+	}
+
+	event.incr_time_taken(RAM_WRITE_DELAY);
+	ftl->controller.stats.numMemoryWrite++;
+
+	if (++directoryPending >= MAP_DIRECTORY_BATCH)
+		flush_map_directory(event);
+}
+
+/*
+ * Write the cached directory page to the next free directory page.
+ */
+void Block_manager::flush_map_directory(Event &event)
+{
+	if (directoryPending == 0)
+		return;
+
+	if (directoryCurrentPage == BLOCK_SIZE)
+		clean_map_directory(event);
+
+	long ppn = directoryBlocks[directoryCurrentBlock] + directoryCurrentPage++;
+
+	Event writeEvent = Event(WRITE, event.get_logical_address(), 1, event.get_start_time()+event.get_time_taken());
+	writeEvent.set_address(Address(ppn, PAGE));
+	if (directoryPages[directoryCachedPage] != -1)
+		writeEvent.set_replace_address(Address(directoryPages[directoryCachedPage], PAGE));
+
+	if (ftl->controller.issue(writeEvent) == FAILURE) { assert(false); }
+
+	event.incr_time_taken(writeEvent.get_time_taken());
+
+	directoryPages[directoryCachedPage] = ppn;
+	directoryPending = 0;
+
+	numDirectoryWrites++;
+	ftl->controller.stats.numMapWrite++;
+	ftl->controller.stats.numFTLWrite++;
+}
+
+/*
+ * Continue in the directory block with the fewest valid directory pages.
+ * Its valid pages are read into SRAM, the block is erased and the pages
+ * are written back to the start of the block.
+ */
+void Block_manager::clean_map_directory(Event &event)
+{
+	uint victim = 0;
+	uint victimValid = BLOCK_SIZE + 1;
+
+	for (uint i=0;i<directoryBlocks.size();i++)
+	{
+		Block *b = ftl->get_block_pointer(Address(directoryBlocks[i], PAGE));
+		uint valid = b->get_pages_valid() - b->get_pages_invalid();
+		if (valid < victimValid)
+		{
+			victim = i;
+			victimValid = valid;
+		}
+	}
+
+	assert(victimValid < BLOCK_SIZE);
+
+	Address victimAddress = Address(directoryBlocks[victim], BLOCK);
+	Block *victimBlock = ftl->get_block_pointer(victimAddress);
+
+	std::vector<long> moved;
+	for (uint i=0;i<directoryPages.size();i++)
+	{
+		if (directoryPages[i] == -1 || (ulong)directoryPages[i] / BLOCK_SIZE != directoryBlocks[victim] / BLOCK_SIZE)
+			continue;
+
+		Event readEvent = Event(READ, event.get_logical_address(), 1, event.get_start_time()+event.get_time_taken());
+		readEvent.set_address(Address(directoryPages[i], PAGE));
+		if (ftl->controller.issue(readEvent) == FAILURE) { assert(false); }
+
+		event.incr_time_taken(readEvent.get_time_taken());
+		ftl->controller.stats.numFTLRead++;
+		moved.push_back(i);
+	}
+
+	if (victimBlock->get_pages_valid() != 0)
+	{
+		Event eraseEvent = Event(ERASE, event.get_logical_address(), 1, event.get_start_time()+event.get_time_taken());
+		eraseEvent.set_address(victimAddress);
+		if (ftl->controller.issue(eraseEvent) == FAILURE) { assert(false); }
+
+		event.incr_time_taken(eraseEvent.get_time_taken());
+		ftl->controller.stats.numFTLErase++;
+	}
+
+	directoryCurrentBlock = victim;
+	directoryCurrentPage = 0;
+
+	for (uint i=0;i<moved.size();i++)
+	{
+		long ppn = directoryBlocks[victim] + directoryCurrentPage++;
+
+		Event writeEvent = Event(WRITE, event.get_logical_address(), 1, event.get_start_time()+event.get_time_taken());
+		writeEvent.set_address(Address(ppn, PAGE));
+		if (ftl->controller.issue(writeEvent) == FAILURE) { assert(false); }
+
+		event.incr_time_taken(writeEvent.get_time_taken());
+		ftl->controller.stats.numMapWrite++;
+		ftl->controller.stats.numFTLWrite++;
+
+		directoryPages[moved[i]] = ppn;
+	}
+
+	numDirectoryCleans++;
+}
+
+/*
+ * Save or load the block lists and the map directory. Blocks are stored
+ * by physical address. Blocks of equal cost are picked as victims in the
+ * order they entered the cost index, so the index is stored in cost order
+ * and rebuilt in that order, then the sequence index is brought back to
+ * block number order.
+ */
+void Block_manager::checkpoint(Checkpoint &cp)
+{
+	cp.section("block_manager");
+
+	cp.value(data_active);
+	cp.value(log_active);
+	cp.value(logseq_active);
+
+	std::vector<Block*> *lists[] = {&active_list, &free_list, &invalid_list};
+	for (uint i=0;i<3;i++)
+	{
+		ulong count = lists[i]->size();
+		cp.value(count);
+		if (cp.is_loading())
+			lists[i]->assign(count, NULL);
+
+		for (ulong j=0;j<count;j++)
+			ftl->checkpoint_block(cp, (*lists[i])[j]);
+	}
+
+	std::vector<long> costOrder;
+	if (!cp.is_loading())
+		for (ActiveByCost::iterator it = active_cost.get<1>().begin(); it != active_cost.get<1>().end(); ++it)
+			costOrder.push_back((*it)->physical_address);
+
+	cp.vector(costOrder);
+
+	if (cp.is_loading())
+		rebuild_cost(costOrder);
+
+	cp.value(directoryCurrentPage);
+	cp.value(directoryCachedPage);
+	cp.vector(directoryBlocks);
+	cp.vector(directoryPages);
+	cp.value(directoryCurrentBlock);
+	cp.value(directoryPending);
+	cp.value(numDirectoryUpdates);
+	cp.value(numDirectoryReads);
+	cp.value(numDirectoryWrites);
+	cp.value(numDirectoryCleans);
+
+	cp.value(simpleCurrentFree);
+	cp.vector(dieCurrentFree);
+	cp.value(num_insert_events);
+	cp.value(current_writing_block);
+	cp.value(out_of_blocks);
+}
+
+/*
+ * Rebuild the cost index from the blocks (by physical address) in cost
+ * order, then bring the sequence index back to block number order.
+ */
+void Block_manager::rebuild_cost(const std::vector<long> &costOrder)
+{
+	active_cost.clear();
+	for (ulong i=0;i<costOrder.size();i++)
+		active_cost.push_back(ftl->get_block_pointer(Address(costOrder[i], BLOCK)));
+
+	std::vector<Block* const*> order(active_cost.size());
+	for (ActiveBySeq::iterator it = active_cost.begin(); it != active_cost.end(); ++it)
+		order[(*it)->physical_address / BLOCK_SIZE] = &*it;
+	active_cost.rearrange(boost::make_indirect_iterator(order.begin()));
+}
+
+/*
+ * Take over the block lists of the preconditioning. Every block it
+ * allocated is an active data block.
+ */
+void Block_manager::precondition(const Precondition &state)
+{
+	data_active = state.allocations;
+	log_active = 0;
+
+	free_list.clear();
+	for (ulong i=0;i<state.freeList.size();i++)
+		free_list.push_back(ftl->get_block_pointer(Address(state.freeList[i] * BLOCK_SIZE, BLOCK)));
+	invalid_list.clear();
+
+	std::vector<long> costOrder;
+	for (ulong i=0;i<state.costOrder.size();i++)
+		costOrder.push_back(state.costOrder[i] * BLOCK_SIZE);
+	rebuild_cost(costOrder);
+
+	simpleCurrentFree = state.simpleCurrentFree;
+	dieCurrentFree = state.dieCurrentFree;
+	current_writing_block = state.currentWritingBlock;
+	out_of_blocks = false;
+}
@@ -132,3 +132,9 @@ double Bus::ready_time(uint channel)
 	assert(channels != NULL && channel < num_channels);
 	return channels[channel].ready_time();
 }
+
+void Bus::checkpoint(Checkpoint &cp)
+{
+	for (uint i=0;i<num_channels;i++)
+		channels[i].checkpoint(cp);
+}
@@ -217,3 +217,15 @@ double Channel::ready_time(void)
 	return ready_at;
 }
 
+
+/*
+ * Save or load the scheduling table. The connections are set up when the
+ * SSD is built and are not part of the state.
+ */
+void Channel::checkpoint(Checkpoint &cp)
+{
+	cp.vector(timings);
+	cp.value(table_entries);
+	cp.value(selected_entry);
+	cp.value(ready_at);
+}
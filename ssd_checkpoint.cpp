@@ -0,0 +1,364 @@
+/* Copyright 2011 Matias Bjørling */
+
+/* ssd_checkpoint.cpp  */
+
+/* FlashSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version. */
+
+/* FlashSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. */
+
+/* You should have received a copy of the GNU General Public License
+ * along with FlashSim.  If not, see <http://www.gnu.org/licenses/>. */
+
+/****************************************************************************/
+
+/* Checkpoint class
+ *
+ * A checkpoint file starts with the magic "FLASHSIM" and the format
+ * version, followed by the state of the SSD in the order the checkpoint
+ * methods visit it. Each part starts with a section tag, so a file that
+ * does not match the code is detected where it diverges instead of being
+ * loaded as garbage.
+ *
+ * The file is written to <path>.tmp and renamed when it is complete, so an
+ * existing checkpoint is never left half written. It is read through a
+ * read-only mapping; arrays (maps, page states, page data) are 8 byte
+ * aligned in the file and copied with a single memcpy each.
+ *
+ * A checkpoint in memory is written to a memory stream and read back from
+ * its buffer by reopen. It has no path and nothing is left behind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ssd.h"
+
+using namespace ssd;
+
+static const char CHECKPOINT_MAGIC[8] = {'F', 'L', 'A', 'S', 'H', 'S', 'I', 'M'};
+static const uint CHECKPOINT_VERSION = 4;
+static const uint SECTION_BYTES = 16;
+
+Checkpoint::Checkpoint(void):
+	loading(false),
+	failed(false),
+	file(NULL),
+	image(NULL),
+	size(0),
+	offset(0),
+	in_memory(false),
+	memory(NULL),
+	memory_size(0)
+{
+	return;
+}
+
+Checkpoint::~Checkpoint(void)
+{
+	if (file != NULL)
+	{
+		fclose(file);
+		if (!in_memory)
+			unlink((path + ".tmp").c_str());
+	}
+
+	if (image != NULL && !in_memory)
+		munmap(image, size);
+
+	free(memory);
+}
+
+/*
+ * Start writing a checkpoint to path.
+ */
+enum status Checkpoint::create(const char *path)
+{
+	this->path = path;
+	loading = false;
+	offset = 0;
+
+	if ((file = fopen((this->path + ".tmp").c_str(), "wb")) == NULL)
+	{
+		fprintf(stderr, "Checkpoint error: %s: unable to create %s.tmp: %s\n", __func__, path, strerror(errno));
+		return FAILURE;
+	}
+
+	char magic[8];
+	memcpy(magic, CHECKPOINT_MAGIC, sizeof(magic));
+	uint version = CHECKPOINT_VERSION;
+	array(magic, sizeof(magic));
+	value(version);
+
+	return SUCCESS;
+}
+
+/*
+ * Start writing a checkpoint to memory.
+ */
+enum status Checkpoint::create(void)
+{
+	path = "memory";
+	loading = false;
+	in_memory = true;
+	offset = 0;
+
+	if ((file = open_memstream(&memory, &memory_size)) == NULL)
+	{
+		fprintf(stderr, "Checkpoint error: %s: unable to create a checkpoint in memory: %s\n", __func__, strerror(errno));
+		return FAILURE;
+	}
+
+	char magic[8];
+	memcpy(magic, CHECKPOINT_MAGIC, sizeof(magic));
+	uint version = CHECKPOINT_VERSION;
+	array(magic, sizeof(magic));
+	value(version);
+
+	return SUCCESS;
+}
+
+/*
+ * Start reading the checkpoint at path.
+ */
+enum status Checkpoint::open(const char *path)
+{
+	this->path = path;
+	loading = true;
+	offset = 0;
+
+	int fd = ::open(path, O_RDONLY);
+	if (fd == -1)
+	{
+		fprintf(stderr, "Checkpoint error: %s: unable to open %s: %s\n", __func__, path, strerror(errno));
+		return FAILURE;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t)(sizeof(CHECKPOINT_MAGIC) + sizeof(uint)))
+	{
+		fprintf(stderr, "Checkpoint error: %s: %s is not a checkpoint.\n", __func__, path);
+		::close(fd);
+		return FAILURE;
+	}
+
+	size = st.st_size;
+	image = (char *) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if (image == MAP_FAILED)
+	{
+		fprintf(stderr, "Checkpoint error: %s: unable to map %s: %s\n", __func__, path, strerror(errno));
+		image = NULL;
+		return FAILURE;
+	}
+
+	// The whole image is read front to back.
+	madvise(image, size, MADV_SEQUENTIAL);
+
+	return check_header();
+}
+
+/*
+ * Finish writing the checkpoint in memory and start reading it back.
+ */
+enum status Checkpoint::reopen(void)
+{
+	if (!in_memory || file == NULL)
+		return FAILURE;
+
+	if (fclose(file) != 0)
+		failed = true;
+	file = NULL;
+
+	if (failed)
+	{
+		fprintf(stderr, "Checkpoint error: %s: unable to write the checkpoint in memory.\n", __func__);
+		return FAILURE;
+	}
+
+	loading = true;
+	image = memory;
+	size = memory_size;
+	offset = 0;
+
+	return check_header();
+}
+
+enum status Checkpoint::check_header(void)
+{
+	char magic[8];
+	uint version;
+	array(magic, sizeof(magic));
+	value(version);
+
+	if (memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0)
+	{
+		fprintf(stderr, "Checkpoint error: %s: %s is not a checkpoint.\n", __func__, path.c_str());
+		return FAILURE;
+	}
+
+	if (version != CHECKPOINT_VERSION)
+	{
+		fprintf(stderr, "Checkpoint error: %s: %s has version %u, expected %u.\n", __func__, path.c_str(), version, CHECKPOINT_VERSION);
+		return FAILURE;
+	}
+
+	return SUCCESS;
+}
+
+/*
+ * Finish the checkpoint. A written checkpoint replaces the file at path
+ * only if every write succeeded.
+ */
+enum status Checkpoint::close(void)
+{
+	if (image != NULL)
+	{
+		if (!in_memory)
+			munmap(image, size);
+		image = NULL;
+		return SUCCESS;
+	}
+
+	if (in_memory)
+		return FAILURE;
+
+	if (file == NULL)
+		return FAILURE;
+
+	std::string temporary = path + ".tmp";
+	if (fflush(file) != 0 || fsync(fileno(file)) != 0)
+		failed = true;
+	if (fclose(file) != 0)
+		failed = true;
+	file = NULL;
+
+	if (failed || rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		fprintf(stderr, "Checkpoint error: %s: unable to write %s: %s\n", __func__, path.c_str(), strerror(errno));
+		unlink(temporary.c_str());
+		return FAILURE;
+	}
+
+	return SUCCESS;
+}
+
+bool Checkpoint::is_loading(void) const
+{
+	return loading;
+}
+
+bool Checkpoint::is_in_memory(void) const
+{
+	return in_memory;
+}
+
+/*
+ * Tag the start of a part of the state. Loading stops if the tag in the
+ * file is not the expected one.
+ */
+void Checkpoint::section(const char *name)
+{
+	char tag[SECTION_BYTES];
+	memset(tag, 0, sizeof(tag));
+	strncpy(tag, name, sizeof(tag) - 1);
+
+	char found[SECTION_BYTES];
+	memcpy(found, tag, sizeof(found));
+	array(found, sizeof(found));
+
+	if (loading && memcmp(found, tag, sizeof(tag)) != 0)
+	{
+		found[SECTION_BYTES - 1] = '\0';
+		fprintf(stderr, "Checkpoint error: %s: %s: expected section %s at offset %lu, found %s.\n", __func__, path.c_str(), tag, offset - SECTION_BYTES, found);
+		exit(FILE_ERR);
+	}
+}
+
+void Checkpoint::address(Address &address)
+{
+	value(address.package);
+	value(address.die);
+	value(address.plane);
+	value(address.block);
+	value(address.page);
+	value(address.real_address);
+	value(address.valid);
+}
+
+void Checkpoint::bits(std::vector<bool> &bits)
+{
+	ulong count = bits.size();
+	value(count);
+
+	std::vector<unsigned char> bytes((count + 7) / 8, 0);
+	if (!loading)
+		for (ulong i=0;i<count;i++)
+			if (bits[i])
+				bytes[i / 8] |= 1 << (i % 8);
+
+	vector(bytes);
+
+	if (loading)
+	{
+		bits.assign(count, false);
+		for (ulong i=0;i<count;i++)
+			bits[i] = (bytes[i / 8] >> (i % 8)) & 1;
+	}
+}
+
+void Checkpoint::transfer(void *data, ulong bytes)
+{
+	if (bytes == 0)
+		return;
+
+	if (!loading)
+	{
+		if (!failed && fwrite(data, 1, bytes, file) != bytes)
+			failed = true;
+		offset += bytes;
+		return;
+	}
+
+	if (offset + bytes > size)
+	{
+		fprintf(stderr, "Checkpoint error: %s: %s is truncated.\n", __func__, path.c_str());
+		exit(FILE_ERR);
+	}
+
+	memcpy(data, image + offset, bytes);
+	offset += bytes;
+}
+
+/*
+ * Pad to the next 8 byte boundary of the file.
+ */
+void Checkpoint::align(void)
+{
+	static const char zeros[8] = {0};
+	ulong padding = (8 - offset % 8) % 8;
+
+	if (!loading)
+	{
+		if (!failed && padding > 0 && fwrite(zeros, 1, padding, file) != padding)
+			failed = true;
+	}
+	else if (offset + padding > size)
+	{
+		fprintf(stderr, "Checkpoint error: %s: %s is truncated.\n", __func__, path.c_str());
+		exit(FILE_ERR);
+	}
+
+	offset += padding;
+}
@@ -32,6 +32,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <string>
+#include <vector>
 
 /* using namespace ssd; */
 namespace ssd {
@@ -57,12 +59,14 @@ typedef unsigned long ulong;
  * 	in case of config file error.  The values defined below are overwritten
  * 	when defined in the config file.
  * We do not want a class here because we want to use the configuration
- * 	variables in the same was as macros. */
+ * 	variables in the same was as macros.
+ * The variables are thread local. Each thread loads its own configuration,
+ * 	so simulations with different configurations can run in parallel. */
 
 /* Ram class:
  * 	delay to read from and write to the RAM for 1 page of data */
-double RAM_READ_DELAY = 0.00000001;
-double RAM_WRITE_DELAY = 0.00000001;
+__thread double RAM_READ_DELAY = 0.00000001;
+__thread double RAM_WRITE_DELAY = 0.00000001;
 
 /* Bus class:
  * 	delay to communicate over bus
@@ -71,24 +75,24 @@ double RAM_WRITE_DELAY = 0.00000001;
  * 	value used as a flag to indicate channel is free
  * 		(use a value not used as a delay value - e.g. -1.0)
  * 	number of simultaneous communication channels - defined by SSD_SIZE */
-double BUS_CTRL_DELAY = 0.000000005;
-double BUS_DATA_DELAY = 0.00000001;
-uint BUS_MAX_CONNECT = 8;
-uint BUS_TABLE_SIZE = 64;
-double BUS_CHANNEL_FREE_FLAG = -1.0;
+__thread double BUS_CTRL_DELAY = 0.000000005;
+__thread double BUS_DATA_DELAY = 0.00000001;
+__thread uint BUS_MAX_CONNECT = 8;
+__thread uint BUS_TABLE_SIZE = 64;
+__thread double BUS_CHANNEL_FREE_FLAG = -1.0;
 /* uint BUS_CHANNELS = 4; same as # of Packages, defined by SSD_SIZE */
 
 /* Ssd class:
  * 	number of Packages per Ssd (size) */
-uint SSD_SIZE = 4;
+__thread uint SSD_SIZE = 4;
 
 /* Package class:
  * 	number of Dies per Package (size) */
-uint PACKAGE_SIZE = 8;
+__thread uint PACKAGE_SIZE = 8;
 
 /* Die class:
  * 	number of Planes per Die (size) */
-uint DIE_SIZE = 2;
+__thread uint DIE_SIZE = 2;
 
 /* Plane class:
  * 	number of Blocks per Plane (size)
@@ -96,81 +100,327 @@ uint DIE_SIZE = 2;
  * 	delay for writing to plane register
  * 	delay for merging is based on read, write, reg_read, reg_write 
  * 		and does not need to be explicitly defined */
-uint PLANE_SIZE = 64;
-double PLANE_REG_READ_DELAY = 0.0000000001;
-double PLANE_REG_WRITE_DELAY = 0.0000000001;
+__thread uint PLANE_SIZE = 64;
+__thread double PLANE_REG_READ_DELAY = 0.0000000001;
+__thread double PLANE_REG_WRITE_DELAY = 0.0000000001;
 
 /* Block class:
  * 	number of Pages per Block (size)
  * 	number of erases in lifetime of block
  * 	delay for erasing block */
-uint BLOCK_SIZE = 16;
-uint BLOCK_ERASES = 1048675;
-double BLOCK_ERASE_DELAY = 0.001;
+__thread uint BLOCK_SIZE = 16;
+__thread uint BLOCK_ERASES = 1048675;
+__thread double BLOCK_ERASE_DELAY = 0.001;
 
 /* Page class:
  * 	delay for Page reads
  * 	delay for Page writes */
-double PAGE_READ_DELAY = 0.000001;
-double PAGE_WRITE_DELAY = 0.00001;
+__thread double PAGE_READ_DELAY = 0.000001;
+__thread double PAGE_WRITE_DELAY = 0.00001;
 
 /* Page data memory allocation
  *
  */
-uint PAGE_SIZE = 4096;
-bool PAGE_ENABLE_DATA = true;
+__thread uint PAGE_SIZE = 4096;
+__thread bool PAGE_ENABLE_DATA = true;
+
+/* Page data:
+ * 	File that backs the page data, such that it is kept between runs. The
+ * 	page data is only kept in memory when empty.
+ * 	1 -> Use transparent huge pages for the page data
+ * 	Access advice (0 -> none, 1 -> random, 2 -> sequential, 3 -> will need) */
+__thread char PAGE_DATA_FILE[128] = "";
+__thread uint PAGE_DATA_HUGE_PAGES = 0;
+__thread uint PAGE_DATA_ADVICE = 0;
 
 /*
- * Memory area to support pages with data.
+ * Memory area to support pages with data. Points to the pages of the Ssd
+ * that is serving a request on this thread.
  */
-void *page_data;
+__thread void *page_data;
 
 /*
  * Number of blocks to reserve for mappings. e.g. map directory in BAST.
+ * 0 simulates each map update as a single write. At least the blocks
+ * the directory pages fill plus one spare for cleaning are reserved.
  */
-uint MAP_DIRECTORY_SIZE = 0;
+__thread uint MAP_DIRECTORY_SIZE = 0;
 
 /*
- * Implementation to use (0 -> Page, 1 -> BAST, 2 -> FAST, 3 -> DFTL, 4 -> BiModal
+ * Block map updates collected in the directory page cached in SRAM before
+ * the page is written to the map directory (BAST and FAST).
  */
-uint FTL_IMPLEMENTATION = 0;
+__thread uint MAP_DIRECTORY_BATCH = 8;
+
+/*
+ * Implementation to use (0 -> Page, 1 -> BAST, 2 -> FAST, 3 -> DFTL, 4 -> BiModal, 5 -> LeaFTL
+ */
+__thread uint FTL_IMPLEMENTATION = 0;
 
 /*
  * Limit of LOG pages (for use in BAST)
  */
-uint BAST_LOG_BLOCK_LIMIT = 100;
+__thread uint BAST_LOG_BLOCK_LIMIT = 100;
+
+/*
+ * LOG block to merge when BAST runs out of log blocks.
+ * 0 -> Random
+ * 1 -> Least recently used
+ * 2 -> Oldest allocated
+ * 3 -> Cheapest merge (switch, then partial, then fewest live pages)
+ */
+__thread uint BAST_LOG_VICTIM = 0;
 
 
 /*
  * Limit of LOG pages (for use in FAST)
  */
-uint FAST_LOG_BLOCK_LIMIT = 4;
+__thread uint FAST_LOG_BLOCK_LIMIT = 4;
+
+/*
+ * Number of sequential (SW) log blocks in FAST. Each follows one sequential
+ * stream. The least recently used one is closed for a new stream.
+ */
+__thread uint FAST_SEQUENTIAL_LOG_BLOCKS = 1;
 
 /*
  * Number of pages allowed to be in DFTL Cached Mapping Table.
  * (Size equals CACHE_BLOCK_LIMIT * block size * page size)
  *
  */
-uint CACHE_DFTL_LIMIT = 8;
+__thread uint CACHE_DFTL_LIMIT = 8;
+
+/*
+ * Number of pages in the DFTL mapping update journal.
+ * 0 -> Dirty mappings are written back as full translation pages.
+ */
+__thread uint DFTL_JOURNAL_SIZE = 0;
+
+/*
+ * Compressed DFTL Cached Mapping Table.
+ * 0 -> One entry per cached mapping
+ * 1 -> Contiguous mappings are cached as (LPN, PPN, length) extents
+ *      within the same number of bytes
+ */
+__thread uint CACHE_DFTL_EXTENTS = 0;
+
+/*
+ * Host Memory Buffer mapping cache for DRAM-less drives.
+ * Mappings evicted from the on-device CMT are kept in host memory
+ * before falling back to translation pages on flash.
+ * HMB_DFTL_LIMIT is the HMB size in pages of mappings (0 -> off).
+ * The delays include the PCIe round-trip.
+ */
+__thread uint HMB_DFTL_LIMIT = 0;
+__thread double HMB_READ_DELAY = 0.000001;
+__thread double HMB_WRITE_DELAY = 0.000001;
+
+/*
+ * LeaFTL learned page map.
+ * LEAFTL_GAMMA is the error bound of a segment in pages.
+ * LEAFTL_BUFFER_SIZE is the number of mapping updates that are
+ * buffered in SRAM before they are learned into segments.
+ */
+__thread uint LEAFTL_GAMMA = 4;
+__thread uint LEAFTL_BUFFER_SIZE = 256;
+
+/*
+ * BDFTL re-promotion. Number of page mapped logical blocks that are
+ * followed at a time while they are rewritten sequentially. Each one
+ * holds a free block. 0 -> off
+ */
+__thread uint BDFTL_SEQUENTIAL_REWRITES = 0;
+
+/*
+ * GC relocation order for the page FTL, DFTL, BDFTL and LeaFTL.
+ * 0 -> Valid pages are relocated in physical order
+ * 1 -> Valid pages of a victim are relocated in LPN order
+ * n -> Valid pages of up to n victims are gathered and relocated in LPN order
+ */
+__thread uint GC_SORT_BY_LPN = 0;
+
+/*
+ * Write frontiers of the page FTL. Host writes go round robin to this
+ * many open data blocks, each allocated in a different die.
+ * 0 -> One per die
+ */
+__thread uint PAGE_WRITE_FRONTIERS = 0;
+
+/*
+ * Pages in the controller write buffer. Buffered pages are grouped by
+ * logical block and evicted as whole, padded blocks (BPLRU). 0 -> Off
+ */
+__thread uint WRITE_BUFFER_SIZE = 0;
 
 /*
  * Parallelism mode.
  * 0 -> Normal
  * 1 -> Striping
  * 2 -> Logical Address Space Parallelism (LASP)
+ * 3 -> RAID-5 (RaidSsd)
+ * 4 -> RAID-6 (RaidSsd)
  */
-uint PARALLELISM_MODE = 0;
+__thread uint PARALLELISM_MODE = 0;
 
 /* Virtual block size (as a multiple of the physical block size) */
-uint VIRTUAL_BLOCK_SIZE = 1;
+__thread uint VIRTUAL_BLOCK_SIZE = 1;
 
 /* Virtual page size (as a multiple of the physical page size) */
-uint VIRTUAL_PAGE_SIZE = 1;
+__thread uint VIRTUAL_PAGE_SIZE = 1;
 
-uint NUMBER_OF_ADDRESSABLE_BLOCKS = 0;
+__thread uint NUMBER_OF_ADDRESSABLE_BLOCKS = 0;
 
 /* RAISSDs: Number of physical SSDs */
-uint RAID_NUMBER_OF_PHYSICAL_SSDS = 0;
+__thread uint RAID_NUMBER_OF_PHYSICAL_SSDS = 0;
+
+/* RAISSDs: Pages per chunk when the address space is split over the SSDs */
+__thread uint RAID_CHUNK_SIZE = 1;
+
+/* RAISSDs: 0 -> The SSDs serve a request one after another
+ *          1 -> Each SSD is driven by its own worker thread */
+__thread uint RAID_PARALLEL = 1;
+
+/* RAISSDs: Parity update of RAID-5/6 writes
+ * 0 -> The one that reads the fewest pages
+ * 1 -> Read-modify-write: read the old data and parity
+ * 2 -> Reconstruct-write: read the data not written */
+__thread uint RAID_PARITY_UPDATE = 0;
+
+/* RAISSDs: Time to fold one page into a parity page */
+__thread double RAID_PARITY_DELAY = 0.0;
+
+/* RAISSDs: Failed SSD of a degraded RAID-5/6 (-1 -> none) */
+__thread int RAID_FAILED_SSD = -1;
+
+/* RAISSDs: Second failed SSD of a degraded RAID-6 (-1 -> none) */
+__thread int RAID_FAILED_SSD2 = -1;
+
+/* RAISSDs: Reconstruct RAID-5/6 reads of an SSD that is busy, e.g. with
+ * garbage collection, from the rest of the row (0 -> off) */
+__thread uint RAID_READ_AROUND_BUSY = 0;
+
+/* RAISSDs: Start garbage collection on one SSD at a time, once it has this
+ * many free blocks left (0 -> the SSDs collect on their own) */
+__thread uint RAID_GC_FREE_BLOCKS = 0;
+
+/* Preconditioning (Ssd::precondition): Fraction of the logical pages
+ * written in order */
+__thread double PRECONDITION_FILL = 0.0;
+
+/* Preconditioning: Random overwrites of the filled pages, as a multiple of
+ * the pages filled */
+__thread double PRECONDITION_PASSES = 1.0;
+
+/* Preconditioning: Fraction of the filled pages that are hot (0 -> the
+ * overwrites are uniform) */
+__thread double PRECONDITION_HOT_SPACE = 0.0;
+
+/* Preconditioning: Fraction of the overwrites that go to the hot pages */
+__thread double PRECONDITION_HOT_WRITES = 0.0;
+
+/* Preconditioning: Seed of the overwrites */
+__thread uint PRECONDITION_SEED = 1;
+
+/* Functional mode of a new SSD (Ssd::set_functional): the FTL, garbage
+ * collection and wear leveling run as usual, but requests skip the bus, RAM
+ * and flash timing and take no time (0 -> timed) */
+__thread uint FUNCTIONAL_MODE = 0;
+
+/* Entries loaded on this thread, such that the configuration can be
+ * repeated on another thread. */
+static thread_local std::vector<std::pair<std::string, double> > loaded_entries;
+static thread_local std::vector<std::pair<std::string, std::string> > loaded_text_entries;
+
+/* Identifies the SimConfig applied on this thread (0 -> none, or changed
+ * since by load_entry). */
+static thread_local ulong config_id = 0;
+
+/* Set the configuration of this thread back to the defaults above. A new
+ * variable needs a line here too. */
+void reset_config(void) {
+	RAM_READ_DELAY = 0.00000001;
+	RAM_WRITE_DELAY = 0.00000001;
+	BUS_CTRL_DELAY = 0.000000005;
+	BUS_DATA_DELAY = 0.00000001;
+	BUS_MAX_CONNECT = 8;
+	BUS_TABLE_SIZE = 64;
+	BUS_CHANNEL_FREE_FLAG = -1.0;
+	SSD_SIZE = 4;
+	PACKAGE_SIZE = 8;
+	DIE_SIZE = 2;
+	PLANE_SIZE = 64;
+	PLANE_REG_READ_DELAY = 0.0000000001;
+	PLANE_REG_WRITE_DELAY = 0.0000000001;
+	BLOCK_SIZE = 16;
+	BLOCK_ERASES = 1048675;
+	BLOCK_ERASE_DELAY = 0.001;
+	PAGE_READ_DELAY = 0.000001;
+	PAGE_WRITE_DELAY = 0.00001;
+	PAGE_SIZE = 4096;
+	PAGE_ENABLE_DATA = true;
+	PAGE_DATA_FILE[0] = '\0';
+	PAGE_DATA_HUGE_PAGES = 0;
+	PAGE_DATA_ADVICE = 0;
+	MAP_DIRECTORY_SIZE = 0;
+	MAP_DIRECTORY_BATCH = 8;
+	FTL_IMPLEMENTATION = 0;
+	BAST_LOG_BLOCK_LIMIT = 100;
+	BAST_LOG_VICTIM = 0;
+	FAST_LOG_BLOCK_LIMIT = 4;
+	FAST_SEQUENTIAL_LOG_BLOCKS = 1;
+	CACHE_DFTL_LIMIT = 8;
+	DFTL_JOURNAL_SIZE = 0;
+	CACHE_DFTL_EXTENTS = 0;
+	HMB_DFTL_LIMIT = 0;
+	HMB_READ_DELAY = 0.000001;
+	HMB_WRITE_DELAY = 0.000001;
+	LEAFTL_GAMMA = 4;
+	LEAFTL_BUFFER_SIZE = 256;
+	BDFTL_SEQUENTIAL_REWRITES = 0;
+	GC_SORT_BY_LPN = 0;
+	PAGE_WRITE_FRONTIERS = 0;
+	WRITE_BUFFER_SIZE = 0;
+	PARALLELISM_MODE = 0;
+	VIRTUAL_BLOCK_SIZE = 1;
+	VIRTUAL_PAGE_SIZE = 1;
+	NUMBER_OF_ADDRESSABLE_BLOCKS = 0;
+	RAID_NUMBER_OF_PHYSICAL_SSDS = 0;
+	RAID_CHUNK_SIZE = 1;
+	RAID_PARALLEL = 1;
+	RAID_PARITY_UPDATE = 0;
+	RAID_PARITY_DELAY = 0.0;
+	RAID_FAILED_SSD = -1;
+	RAID_FAILED_SSD2 = -1;
+	RAID_READ_AROUND_BUSY = 0;
+	RAID_GC_FREE_BLOCKS = 0;
+	PRECONDITION_FILL = 0.0;
+	PRECONDITION_PASSES = 1.0;
+	PRECONDITION_HOT_SPACE = 0.0;
+	PRECONDITION_HOT_WRITES = 0.0;
+	PRECONDITION_SEED = 1;
+	FUNCTIONAL_MODE = 0;
+
+	loaded_entries.clear();
+	loaded_text_entries.clear();
+	config_id = 0;
+}
+
+ulong get_config_id(void) {
+	return config_id;
+}
+
+void set_config_id(ulong id) {
+	config_id = id;
+}
+
+/* Entries of a config file are parsed before they are loaded, so they
+ * are loaded without their line number. */
+static void print_entry_error(const char *name, uint line_number) {
+	if (line_number != 0)
+		fprintf(stderr, "Config file parsing error on line %u\n", line_number);
+	else
+		fprintf(stderr, "Config file parsing error: unknown entry %s\n", name);
+}
 
 void load_entry(char *name, double value, uint line_number) {
 	/* cheap implementation - go through all possibilities and match entry */
@@ -214,16 +464,48 @@ void load_entry(char *name, double value, uint line_number) {
 		FTL_IMPLEMENTATION = value;
 	else if (!strcmp(name, "PAGE_ENABLE_DATA"))
 		PAGE_ENABLE_DATA = (value == 1);
+	else if (!strcmp(name, "PAGE_DATA_HUGE_PAGES"))
+		PAGE_DATA_HUGE_PAGES = value;
+	else if (!strcmp(name, "PAGE_DATA_ADVICE"))
+		PAGE_DATA_ADVICE = value;
 	else if (!strcmp(name, "MAP_DIRECTORY_SIZE"))
 		MAP_DIRECTORY_SIZE = value;
+	else if (!strcmp(name, "MAP_DIRECTORY_BATCH"))
+		MAP_DIRECTORY_BATCH = value;
 	else if (!strcmp(name, "FTL_IMPLEMENTATION"))
 		FTL_IMPLEMENTATION = value;
 	else if (!strcmp(name, "BAST_LOG_BLOCK_LIMIT"))
 		BAST_LOG_BLOCK_LIMIT = value;
+	else if (!strcmp(name, "BAST_LOG_VICTIM"))
+		BAST_LOG_VICTIM = value;
 	else if (!strcmp(name, "FAST_LOG_BLOCK_LIMIT"))
 		FAST_LOG_BLOCK_LIMIT = value;
+	else if (!strcmp(name, "FAST_SEQUENTIAL_LOG_BLOCKS"))
+		FAST_SEQUENTIAL_LOG_BLOCKS = value;
 	else if (!strcmp(name, "CACHE_DFTL_LIMIT"))
 		CACHE_DFTL_LIMIT = value;
+	else if (!strcmp(name, "DFTL_JOURNAL_SIZE"))
+		DFTL_JOURNAL_SIZE = value;
+	else if (!strcmp(name, "CACHE_DFTL_EXTENTS"))
+		CACHE_DFTL_EXTENTS = value;
+	else if (!strcmp(name, "HMB_DFTL_LIMIT"))
+		HMB_DFTL_LIMIT = value;
+	else if (!strcmp(name, "HMB_READ_DELAY"))
+		HMB_READ_DELAY = value;
+	else if (!strcmp(name, "HMB_WRITE_DELAY"))
+		HMB_WRITE_DELAY = value;
+	else if (!strcmp(name, "LEAFTL_GAMMA"))
+		LEAFTL_GAMMA = value;
+	else if (!strcmp(name, "LEAFTL_BUFFER_SIZE"))
+		LEAFTL_BUFFER_SIZE = value;
+	else if (!strcmp(name, "BDFTL_SEQUENTIAL_REWRITES"))
+		BDFTL_SEQUENTIAL_REWRITES = value;
+	else if (!strcmp(name, "GC_SORT_BY_LPN"))
+		GC_SORT_BY_LPN = value;
+	else if (!strcmp(name, "PAGE_WRITE_FRONTIERS"))
+		PAGE_WRITE_FRONTIERS = value;
+	else if (!strcmp(name, "WRITE_BUFFER_SIZE"))
+		WRITE_BUFFER_SIZE = value;
 	else if (!strcmp(name, "PARALLELISM_MODE"))
 		PARALLELISM_MODE = value;
 	else if (!strcmp(name, "VIRTUAL_BLOCK_SIZE"))
@@ -232,13 +514,110 @@ void load_entry(char *name, double value, uint line_number) {
 		VIRTUAL_PAGE_SIZE = value;
 	else if (!strcmp(name, "RAID_NUMBER_OF_PHYSICAL_SSDS"))
 		RAID_NUMBER_OF_PHYSICAL_SSDS = value;
+	else if (!strcmp(name, "RAID_CHUNK_SIZE"))
+		RAID_CHUNK_SIZE = value;
+	else if (!strcmp(name, "RAID_PARALLEL"))
+		RAID_PARALLEL = value;
+	else if (!strcmp(name, "RAID_PARITY_UPDATE"))
+		RAID_PARITY_UPDATE = value;
+	else if (!strcmp(name, "RAID_PARITY_DELAY"))
+		RAID_PARITY_DELAY = value;
+	else if (!strcmp(name, "RAID_FAILED_SSD"))
+		RAID_FAILED_SSD = value;
+	else if (!strcmp(name, "RAID_FAILED_SSD2"))
+		RAID_FAILED_SSD2 = value;
+	else if (!strcmp(name, "RAID_READ_AROUND_BUSY"))
+		RAID_READ_AROUND_BUSY = value;
+	else if (!strcmp(name, "RAID_GC_FREE_BLOCKS"))
+		RAID_GC_FREE_BLOCKS = value;
+	else if (!strcmp(name, "PRECONDITION_FILL"))
+		PRECONDITION_FILL = value;
+	else if (!strcmp(name, "PRECONDITION_PASSES"))
+		PRECONDITION_PASSES = value;
+	else if (!strcmp(name, "PRECONDITION_HOT_SPACE"))
+		PRECONDITION_HOT_SPACE = value;
+	else if (!strcmp(name, "PRECONDITION_HOT_WRITES"))
+		PRECONDITION_HOT_WRITES = value;
+	else if (!strcmp(name, "PRECONDITION_SEED"))
+		PRECONDITION_SEED = value;
+	else if (!strcmp(name, "FUNCTIONAL_MODE"))
+		FUNCTIONAL_MODE = value;
 	else
-		fprintf(stderr, "Config file parsing error on line %u\n", line_number);
+	{
+		print_entry_error(name, line_number);
+		return;
+	}
+
+	loaded_entries.push_back(std::make_pair(std::string(name), value));
+	config_id = 0;
 	return;
 }
 
+/* Entries with a text value, e.g. a file name */
+void load_text_entry(char *name, const char *value, uint line_number) {
+	if (!strcmp(name, "PAGE_DATA_FILE"))
+	{
+		strncpy(PAGE_DATA_FILE, value, sizeof(PAGE_DATA_FILE) - 1);
+		PAGE_DATA_FILE[sizeof(PAGE_DATA_FILE) - 1] = '\0';
+	}
+	else
+	{
+		print_entry_error(name, line_number);
+		return;
+	}
+
+	loaded_text_entries.push_back(std::make_pair(std::string(name), std::string(value)));
+	config_id = 0;
+	return;
+}
+
+void get_config_entries(std::vector<std::pair<std::string, double> > &entries) {
+	entries = loaded_entries;
+}
+
+void get_config_text_entries(std::vector<std::pair<std::string, std::string> > &entries) {
+	entries = loaded_text_entries;
+}
+
+void load_config(const char *config_name);
+void read_config(const char *config_name, std::vector<std::pair<std::string, double> > &entries, std::vector<std::pair<std::string, std::string> > &text_entries);
+void update_config(void);
+
 void load_config(void) {
-	const char * const config_name = "ssd.conf";
+	load_config("ssd.conf");
+}
+
+void load_config(const char *config_name) {
+	std::vector<std::pair<std::string, double> > entries;
+	std::vector<std::pair<std::string, std::string> > text_entries;
+	char name[128];
+
+	read_config(config_name, entries, text_entries);
+
+	/* The file replaces the configuration, entries not in it keep their
+	 * default */
+	reset_config();
+
+	for (uint i = 0; i < entries.size(); i++) {
+		strncpy(name, entries[i].first.c_str(), sizeof(name) - 1);
+		name[sizeof(name) - 1] = '\0';
+		load_entry(name, entries[i].second, 0);
+	}
+
+	for (uint i = 0; i < text_entries.size(); i++) {
+		strncpy(name, text_entries[i].first.c_str(), sizeof(name) - 1);
+		name[sizeof(name) - 1] = '\0';
+		load_text_entry(name, text_entries[i].second.c_str(), 0);
+	}
+
+	update_config();
+
+	return;
+}
+
+/* Parse the entries of a config file without loading them, so that a
+ * SimConfig reads its file once and not each time it is applied. */
+void read_config(const char *config_name, std::vector<std::pair<std::string, double> > &entries, std::vector<std::pair<std::string, std::string> > &text_entries) {
 	FILE *config_file = NULL;
 
 	/* update sscanf line below with max name length (%s) if changing sizes */
@@ -247,6 +626,7 @@ void load_config(void) {
 	uint line_number;
 
 	char name[line_size];
+	char text[line_size];
 	double value;
 
 	if ((config_file = fopen(config_name, "r")) == NULL) {
@@ -254,6 +634,9 @@ void load_config(void) {
 		exit(FILE_ERR);
 	}
 
+	entries.clear();
+	text_entries.clear();
+
 	for (line_number = 1; fgets(line, line_size, config_file) != NULL; line_number++) {
 		line[line_size - 1] = '\0';
 
@@ -264,16 +647,21 @@ void load_config(void) {
 		/* read lines with entries (name value) */
 		if (sscanf(line, "%127s %lf", name, &value) == 2) {
 			name[line_size - 1] = '\0';
-			load_entry(name, value, line_number);
+			entries.push_back(std::make_pair(std::string(name), value));
+		} else if (sscanf(line, "%127s %127s", name, text) == 2) {
+			name[line_size - 1] = '\0';
+			text[line_size - 1] = '\0';
+			text_entries.push_back(std::make_pair(std::string(name), std::string(text)));
 		} else
 			fprintf(stderr, "Config file parsing error on line %u\n",
 					line_number);
 	}
 	fclose(config_file);
+}
 
+/* Recompute the values derived from other configuration values */
+void update_config(void) {
 	NUMBER_OF_ADDRESSABLE_BLOCKS = (SSD_SIZE * PACKAGE_SIZE * DIE_SIZE * PLANE_SIZE) / VIRTUAL_PAGE_SIZE;
-
-	return;
 }
 
 void print_config(FILE *stream) {
@@ -298,10 +686,41 @@ void print_config(FILE *stream) {
 	fprintf(stream, "PAGE_WRITE_DELAY: %.16lf\n", PAGE_WRITE_DELAY);
 	fprintf(stream, "PAGE_SIZE: %u\n", PAGE_SIZE);
 	fprintf(stream, "PAGE_ENABLE_DATA: %i\n", PAGE_ENABLE_DATA);
+	fprintf(stream, "PAGE_DATA_FILE: %s\n", PAGE_DATA_FILE);
+	fprintf(stream, "PAGE_DATA_HUGE_PAGES: %u\n", PAGE_DATA_HUGE_PAGES);
+	fprintf(stream, "PAGE_DATA_ADVICE: %u\n", PAGE_DATA_ADVICE);
 	fprintf(stream, "MAP_DIRECTORY_SIZE: %i\n", MAP_DIRECTORY_SIZE);
+	fprintf(stream, "MAP_DIRECTORY_BATCH: %u\n", MAP_DIRECTORY_BATCH);
 	fprintf(stream, "FTL_IMPLEMENTATION: %i\n", FTL_IMPLEMENTATION);
+	fprintf(stream, "BAST_LOG_VICTIM: %u\n", BAST_LOG_VICTIM);
+	fprintf(stream, "FAST_SEQUENTIAL_LOG_BLOCKS: %u\n", FAST_SEQUENTIAL_LOG_BLOCKS);
+	fprintf(stream, "DFTL_JOURNAL_SIZE: %u\n", DFTL_JOURNAL_SIZE);
+	fprintf(stream, "CACHE_DFTL_EXTENTS: %u\n", CACHE_DFTL_EXTENTS);
+	fprintf(stream, "HMB_DFTL_LIMIT: %u\n", HMB_DFTL_LIMIT);
+	fprintf(stream, "HMB_READ_DELAY: %.16lf\n", HMB_READ_DELAY);
+	fprintf(stream, "HMB_WRITE_DELAY: %.16lf\n", HMB_WRITE_DELAY);
+	fprintf(stream, "LEAFTL_GAMMA: %u\n", LEAFTL_GAMMA);
+	fprintf(stream, "LEAFTL_BUFFER_SIZE: %u\n", LEAFTL_BUFFER_SIZE);
+	fprintf(stream, "BDFTL_SEQUENTIAL_REWRITES: %u\n", BDFTL_SEQUENTIAL_REWRITES);
+	fprintf(stream, "GC_SORT_BY_LPN: %u\n", GC_SORT_BY_LPN);
+	fprintf(stream, "PAGE_WRITE_FRONTIERS: %u\n", PAGE_WRITE_FRONTIERS);
+	fprintf(stream, "WRITE_BUFFER_SIZE: %u\n", WRITE_BUFFER_SIZE);
 	fprintf(stream, "PARALLELISM_MODE: %i\n", PARALLELISM_MODE);
 	fprintf(stream, "RAID_NUMBER_OF_PHYSICAL_SSDS: %i\n", RAID_NUMBER_OF_PHYSICAL_SSDS);
+	fprintf(stream, "RAID_CHUNK_SIZE: %u\n", RAID_CHUNK_SIZE);
+	fprintf(stream, "RAID_PARALLEL: %u\n", RAID_PARALLEL);
+	fprintf(stream, "RAID_PARITY_UPDATE: %u\n", RAID_PARITY_UPDATE);
+	fprintf(stream, "RAID_PARITY_DELAY: %.16lf\n", RAID_PARITY_DELAY);
+	fprintf(stream, "RAID_FAILED_SSD: %i\n", RAID_FAILED_SSD);
+	fprintf(stream, "RAID_FAILED_SSD2: %i\n", RAID_FAILED_SSD2);
+	fprintf(stream, "RAID_READ_AROUND_BUSY: %u\n", RAID_READ_AROUND_BUSY);
+	fprintf(stream, "RAID_GC_FREE_BLOCKS: %u\n", RAID_GC_FREE_BLOCKS);
+	fprintf(stream, "PRECONDITION_FILL: %.16lf\n", PRECONDITION_FILL);
+	fprintf(stream, "PRECONDITION_PASSES: %.16lf\n", PRECONDITION_PASSES);
+	fprintf(stream, "PRECONDITION_HOT_SPACE: %.16lf\n", PRECONDITION_HOT_SPACE);
+	fprintf(stream, "PRECONDITION_HOT_WRITES: %.16lf\n", PRECONDITION_HOT_WRITES);
+	fprintf(stream, "PRECONDITION_SEED: %u\n", PRECONDITION_SEED);
+	fprintf(stream, "FUNCTIONAL_MODE: %u\n", FUNCTIONAL_MODE);
 
 	return;
 }
@@ -29,62 +29,172 @@
  *
  * The controller also provides an interface for the FTL to collect wear
  * information to perform wear-leveling.
+ *
+ * With WRITE_BUFFER_SIZE set, requests pass through a BPLRU write buffer
+ * before they reach the FTL.
  */
 
 #include <new>
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "ssd.h"
 
 using namespace ssd;
 
+/* One entry per FTL_IMPLEMENTATION. A new FTL only needs a line here. */
+struct Controller::FtlEntry
+{
+	uint implementation;
+	FtlParent *(*create)(Controller &controller);
+	enum status (*serve)(Controller &controller, Event &event);
+};
+
+#define FTL_ENTRY(implementation, FTL) \
+	{implementation, &Controller::create_ftl<FTL>, &Controller::serve_ftl<FTL>}
+
+const Controller::FtlEntry Controller::ftl_registry[] =
+{
+	FTL_ENTRY(IMPL_PAGE, FtlImpl_Page),
+	FTL_ENTRY(IMPL_BAST, FtlImpl_Bast),
+	FTL_ENTRY(IMPL_FAST, FtlImpl_Fast),
+	FTL_ENTRY(IMPL_DFTL, FtlImpl_Dftl),
+	FTL_ENTRY(IMPL_BIMODAL, FtlImpl_BDftl),
+	FTL_ENTRY(IMPL_LEAFTL, FtlImpl_LeaFtl),
+};
+
+template <class FTL>
+FtlParent *Controller::create_ftl(Controller &controller)
+{
+	return new FTL(controller);
+}
+
+/* The FTL classes are final, so the request path instantiated for one
+ * calls its read, write, trim and resolve_batch directly. */
+template <class FTL>
+enum status Controller::serve_ftl(Controller &controller, Event &event)
+{
+	return controller.serve(static_cast<FTL &>(*controller.ftl), event);
+}
+
 Controller::Controller(Ssd &parent):
 	ssd(parent)
 {
-	switch (FTL_IMPLEMENTATION)
+	ftl = NULL;
+	ftl_serve = NULL;
+	for (uint i = 0; i < sizeof(ftl_registry) / sizeof(ftl_registry[0]); i++)
 	{
-	case 0:
-		ftl = new FtlImpl_Page(*this);
-		break;
-	case 1:
-		ftl = new FtlImpl_Bast(*this);
-		break;
-	case 2:
-		ftl = new FtlImpl_Fast(*this);
-		break;
-	case 3:
-		ftl = new FtlImpl_Dftl(*this);
-		break;
-	case 4:
-		ftl = new FtlImpl_BDftl(*this);
-		break;
+		if (ftl_registry[i].implementation == FTL_IMPLEMENTATION)
+		{
+			ftl = ftl_registry[i].create(*this);
+			ftl_serve = ftl_registry[i].serve;
+		}
+	}
+
+	if (ftl == NULL)
+	{
+		fprintf(stderr, "Controller: %s: Unknown FTL_IMPLEMENTATION %u\n", __func__, FTL_IMPLEMENTATION);
+		exit(1);
 	}
+
+	buffer = NULL;
+	if (WRITE_BUFFER_SIZE > 0)
+		buffer = new WriteBuffer(*this);
 	return;
 }
 
 Controller::~Controller(void)
 {
+	delete buffer;
 	delete ftl;
 	return;
 }
 
+/* the FTL type is resolved once, when the controller is created */
 enum status Controller::event_arrive(Event &event)
 {
+	return ftl_serve(*this, event);
+}
+
+template <class FTL>
+enum status Controller::serve(FTL &ftl, Event &event)
+{
+	if(event.get_size() > 1)
+		return serve_range(ftl, event);
+
+	if(buffer != NULL)
+	{
+		if(event.get_event_type() == READ)
+			return buffer->read(event);
+		else if(event.get_event_type() == WRITE)
+			return buffer->write(event);
+		else if(event.get_event_type() == TRIM)
+			return buffer->trim(event);
+	}
+
 	if(event.get_event_type() == READ)
-		return ftl->read(event);
+		return ftl.read(event);
 	else if(event.get_event_type() == WRITE)
-		return ftl->write(event);
+		return ftl.write(event);
 	else if(event.get_event_type() == TRIM)
-		return ftl->trim(event);
+		return ftl.trim(event);
 	else
 		fprintf(stderr, "Controller: %s: Invalid event type\n", __func__);
 	return FAILURE;
 }
 
+/* write the pages held in the write buffer to the FTL */
+enum status Controller::flush(Event &event)
+{
+	if(buffer == NULL)
+		return SUCCESS;
+
+	return buffer->flush(event);
+}
+
+/* split a multi-page request into single page events
+ * the FTL is handed the whole range first, so that it can resolve the
+ * mappings of all pages together before the pages are served
+ * the request completes when the slowest page completes */
+template <class FTL>
+enum status Controller::serve_range(FTL &ftl, Event &event)
+{
+	std::vector<long> lpns;
+	lpns.reserve(event.get_size());
+	for(uint i = 0; i < event.get_size(); i++)
+		lpns.push_back(event.get_logical_address() + i);
+
+	/* buffered writes reach the FTL later, one block at a time */
+	if(event.get_event_type() == READ || (event.get_event_type() == WRITE && buffer == NULL))
+		ftl.resolve_batch(event, lpns, event.get_event_type() == WRITE);
+
+	double resolve_time = event.get_time_taken();
+	double max_time = 0.0;
+
+	for(uint i = 0; i < event.get_size(); i++)
+	{
+		Event page_event(event.get_event_type(), lpns[i], 1, event.get_start_time() + resolve_time);
+		if(event.get_payload() != NULL)
+			page_event.set_payload((char*)event.get_payload() + i * PAGE_SIZE);
+
+		if(serve(ftl, page_event) == FAILURE)
+			return FAILURE;
+
+		if(page_event.get_time_taken() > max_time)
+			max_time = page_event.get_time_taken();
+	}
+
+	event.incr_time_taken(max_time);
+	return SUCCESS;
+}
+
 enum status Controller::issue(Event &event_list)
 {
 	Event *cur;
 
+	if (ssd.functional)
+		return issue_functional(event_list);
+
 	/* go through event list and issue each to the hardware
 	 * stop processing events and return failure status if any event in the 
 	 *    list fails */
@@ -142,6 +252,57 @@ enum status Controller::issue(Event &event_list)
 	return SUCCESS;
 }
 
+/*
+ * Issue the event list without the bus and RAM. The events change the
+ * state of the flash as in issue, only their time is not modelled.
+ */
+enum status Controller::issue_functional(Event &event_list)
+{
+	Event *cur;
+
+	for(cur = &event_list; cur != NULL; cur = cur -> get_next()){
+		if(cur -> get_size() != 1){
+			fprintf(stderr, "Controller: %s: Received non-single-page-sized event from FTL.\n", __func__);
+			return FAILURE;
+		}
+		else if(cur -> get_event_type() == READ)
+		{
+			assert(cur -> get_address().valid > NONE);
+			if(ssd.read(*cur) == FAILURE || ssd.replace(*cur) == FAILURE)
+				return FAILURE;
+		}
+		else if(cur -> get_event_type() == WRITE)
+		{
+			assert(cur -> get_address().valid > NONE);
+			if(ssd.write(*cur) == FAILURE || ssd.replace(*cur) == FAILURE)
+				return FAILURE;
+		}
+		else if(cur -> get_event_type() == ERASE)
+		{
+			assert(cur -> get_address().valid > NONE);
+			if(ssd.erase(*cur) == FAILURE)
+				return FAILURE;
+		}
+		else if(cur -> get_event_type() == MERGE)
+		{
+			assert(cur -> get_address().valid > NONE);
+			assert(cur -> get_merge_address().valid > NONE);
+			if(ssd.merge(*cur) == FAILURE)
+				return FAILURE;
+		}
+		else if(cur -> get_event_type() == TRIM)
+		{
+			return SUCCESS;
+		}
+		else
+		{
+			fprintf(stderr, "Controller: %s: Invalid event type\n", __func__);
+			return FAILURE;
+		}
+	}
+	return SUCCESS;
+}
+
 void Controller::translate_address(Address &address)
 {
 	if (PARALLELISM_MODE != 1)
@@ -215,5 +376,23 @@ const FtlParent &Controller::get_ftl(void) const
 
 void Controller::print_ftl_statistics()
 {
+	if (buffer != NULL)
+		buffer->print_statistics();
+
 	ftl->print_ftl_statistics();
 }
+
+void Controller::checkpoint(Checkpoint &cp)
+{
+	cp.section("controller");
+	stats.checkpoint(cp);
+	ftl->checkpoint(cp);
+
+	if (buffer != NULL)
+		buffer->checkpoint(cp);
+}
+
+enum status Controller::precondition(Precondition &state)
+{
+	return ftl->precondition(state);
+}
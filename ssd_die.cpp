@@ -243,3 +243,21 @@ Block *Die::get_block_pointer(const Address & address)
 	assert(address.valid >= PLANE);
 	return data[address.plane].get_block_pointer(address);
 }
+
+void Die::checkpoint(Checkpoint &cp)
+{
+	cp.value(least_worn);
+	cp.value(erases_remaining);
+	cp.value(last_erase_time);
+
+	for (uint i=0;i<size;i++)
+		data[i].checkpoint(cp);
+}
+
+void Die::precondition(const Precondition &state)
+{
+	for (uint i=0;i<size;i++)
+		data[i].precondition(state);
+
+	update_wear_stats(Address());
+}
@@ -26,7 +26,7 @@
 using namespace ssd;
 
 // Initialization of the block layer.
-Block_manager *Block_manager::inst = NULL;
+__thread Block_manager *Block_manager::inst = NULL;
 
 FtlParent::FtlParent(Controller &controller) : controller(controller)
 {
@@ -69,7 +69,39 @@ void FtlParent::cleanup_block(Event &event, Block *block)
 	return;
 }
 
+/*
+ * Called by garbage collection when several victims are cleaned together.
+ * FTLs that can relocate the valid pages of all victims at once override it.
+ */
+void FtlParent::cleanup_blocks(Event &event, const std::vector<Block*> &blocks)
+{
+	for (uint i=0;i<blocks.size();i++)
+		cleanup_block(event, blocks[i]);
+}
+
+/*
+ * Called with all the logical pages of a multi-page request before the
+ * pages are served one by one. FTLs that cache mappings can use it to
+ * fetch the mappings together.
+ */
+void FtlParent::resolve_batch(Event &event, const std::vector<long> &lpns, bool isWrite)
+{
+	return;
+}
+
 void FtlParent::print_ftl_statistics()
 {
 	return;
 }
+
+/*
+ * Save or load a block pointer as the physical address of the block.
+ */
+void FtlParent::checkpoint_block(Checkpoint &cp, Block *&block)
+{
+	long address = block == NULL ? -1 : block->get_physical_address();
+	cp.value(address);
+
+	if (cp.is_loading())
+		block = address == -1 ? NULL : get_block_pointer(Address(address, BLOCK));
+}
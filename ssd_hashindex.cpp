@@ -0,0 +1,142 @@
+/* Copyright 2011 Matias Bjørling */
+
+/* ssd_hashindex.cpp  */
+
+/* FlashSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version. */
+
+/* FlashSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. */
+
+/* You should have received a copy of the GNU General Public License
+ * along with FlashSim.  If not, see <http://www.gnu.org/licenses/>. */
+
+/****************************************************************************/
+
+/* Hash index
+ *
+ * Fixed size open addressing hash table from a non-negative key to a value.
+ * Used by the log block FTLs to find the log block or log page of a logical
+ * address without walking a tree. Collisions are resolved by linear probing
+ * and erase shifts the following entries back, such that no tombstones are
+ * needed.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include "ssd.h"
+
+using namespace ssd;
+
+HashIndex::HashIndex(uint entries):
+	bits(1),
+	count(0)
+{
+	// Keep the load factor at or below one half.
+	while ((1ul << bits) < (ulong)entries * 2)
+		bits++;
+
+	mask = (1ul << bits) - 1;
+
+	keys = new long[mask + 1];
+	values = new long[mask + 1];
+
+	for (ulong i=0;i<=mask;i++)
+		keys[i] = -1;
+}
+
+HashIndex::~HashIndex(void)
+{
+	delete [] keys;
+	delete [] values;
+}
+
+/* Fibonacci hashing of the key to its home slot. */
+ulong HashIndex::home(long key) const
+{
+	return ((ulong)key * 11400714819323198485ul) >> (64 - bits);
+}
+
+long HashIndex::find(long key) const
+{
+	for (ulong i=home(key);keys[i] != -1;i = (i + 1) & mask)
+		if (keys[i] == key)
+			return values[i];
+
+	return -1;
+}
+
+void HashIndex::insert(long key, long value)
+{
+	assert(key >= 0);
+
+	ulong i = home(key);
+	while (keys[i] != -1 && keys[i] != key)
+		i = (i + 1) & mask;
+
+	if (keys[i] == -1)
+	{
+		assert(count < mask);
+		count++;
+	}
+
+	keys[i] = key;
+	values[i] = value;
+}
+
+void HashIndex::erase(long key)
+{
+	ulong i = home(key);
+	while (keys[i] != key)
+	{
+		if (keys[i] == -1)
+			return;
+		i = (i + 1) & mask;
+	}
+
+	// Move later entries of the probe sequence into the hole.
+	ulong j = i;
+	while (true)
+	{
+		j = (j + 1) & mask;
+		if (keys[j] == -1)
+			break;
+
+		ulong h = home(keys[j]);
+		if (((j - h) & mask) >= ((j - i) & mask))
+		{
+			keys[i] = keys[j];
+			values[i] = values[j];
+			i = j;
+		}
+	}
+
+	keys[i] = -1;
+	count--;
+}
+
+void HashIndex::clear(void)
+{
+	for (ulong i=0;i<=mask;i++)
+		keys[i] = -1;
+	count = 0;
+}
+
+uint HashIndex::size(void) const
+{
+	return count;
+}
+
+/*
+ * Save or load the table as is, so the probe sequences are kept.
+ */
+void HashIndex::checkpoint(Checkpoint &cp)
+{
+	cp.value(count);
+	cp.array(keys, mask + 1);
+	cp.array(values, mask + 1);
+}
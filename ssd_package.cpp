@@ -209,3 +209,21 @@ Block *Package::get_block_pointer(const Address & address)
 	assert(address.valid >= DIE);
 	return data[address.die].get_block_pointer(address);
 }
+
+void Package::checkpoint(Checkpoint &cp)
+{
+	cp.value(least_worn);
+	cp.value(erases_remaining);
+	cp.value(last_erase_time);
+
+	for (uint i=0;i<size;i++)
+		data[i].checkpoint(cp);
+}
+
+void Package::precondition(const Precondition &state)
+{
+	for (uint i=0;i<size;i++)
+		data[i].precondition(state);
+
+	update_wear_stats(Address());
+}
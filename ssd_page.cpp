@@ -34,7 +34,7 @@ namespace ssd {
 	/*
 	 * Buffer used for accessing data pages.
 	 */
-	void *global_buffer;
+	__thread void *global_buffer;
 
 }
 
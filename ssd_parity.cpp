@@ -0,0 +1,160 @@
+/* Copyright 2011 Matias Bjørling */
+
+/* ssd_parity.cpp  */
+
+/* FlashSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version. */
+
+/* FlashSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. */
+
+/* You should have received a copy of the GNU General Public License
+ * along with FlashSim.  If not, see <http://www.gnu.org/licenses/>. */
+
+/****************************************************************************/
+
+/* Parity kernels for the RAID-5/6 modes of RaidSsd
+ *
+ * P is the XOR of the data pages of a stripe row. Q is the sum of
+ * g^j * D_j over GF(2^8) with the generator g = 2 and the polynomial
+ * x^8 + x^4 + x^3 + x^2 + 1 (0x11d), as in Linux md.
+ *
+ * The kernels work on 16 byte vectors (GCC vector extensions), which the
+ * compiler maps to SSE/NEON registers where available. Multiplication by
+ * g is done on all bytes of a vector at once: shift every byte left and
+ * reduce the bytes that overflowed with 0x1d.
+ *
+ * Two lost data pages x < y of a row are recovered from the syndromes
+ * P' = Dx + Dy and Q' = g^x * Dx + g^y * Dy, i.e. P and Q with the other
+ * data pages folded out: Dx = (g^y * P' + Q') / (g^x + g^y), Dy = P' + Dx.
+ * Every non-zero element is a power of g, so the division is a
+ * multiplication by a power of g as well.
+ */
+
+#include <string.h>
+#include <vector>
+#include "ssd.h"
+
+using namespace ssd;
+
+typedef unsigned long long parity_vector __attribute__ ((vector_size (16)));
+
+static const uint VECTOR_BYTES = sizeof(parity_vector);
+
+static inline parity_vector load(const char *p)
+{
+	parity_vector v;
+	memcpy(&v, p, VECTOR_BYTES);
+	return v;
+}
+
+static inline void store(char *p, parity_vector v)
+{
+	memcpy(p, &v, VECTOR_BYTES);
+}
+
+/*
+ * Multiply each byte of v by g = 2.
+ */
+static inline parity_vector mul2(parity_vector v)
+{
+	const parity_vector low = {0x7f7f7f7f7f7f7f7fULL, 0x7f7f7f7f7f7f7f7fULL};
+	const parity_vector high = {0x0101010101010101ULL, 0x0101010101010101ULL};
+	const parity_vector poly = {0x1d, 0x1d};
+
+	return ((v & low) << 1) ^ (((v >> 7) & high) * poly);
+}
+
+/*
+ * g^exponent
+ */
+static unsigned char power(uint exponent)
+{
+	unsigned char b = 1;
+	for (uint e=0;e<exponent % 255;e++)
+		b = (b << 1) ^ ((b & 0x80) ? 0x1d : 0);
+	return b;
+}
+
+/*
+ * The exponent e of a non-zero b = g^e.
+ */
+static uint logarithm(unsigned char b)
+{
+	uint e = 0;
+	while (power(e) != b)
+		e++;
+	return e;
+}
+
+namespace ssd {
+
+/*
+ * dst ^= src
+ */
+void parity_xor(char *dst, const char *src, uint bytes)
+{
+	uint i = 0;
+	for (;i + VECTOR_BYTES <= bytes;i += VECTOR_BYTES)
+		store(dst + i, load(dst + i) ^ load(src + i));
+
+	for (;i<bytes;i++)
+		dst[i] ^= src[i];
+}
+
+/*
+ * dst ^= g^exponent * src
+ */
+void parity_mul_xor(char *dst, const char *src, uint exponent, uint bytes)
+{
+	exponent %= 255;
+
+	uint i = 0;
+	for (;i + VECTOR_BYTES <= bytes;i += VECTOR_BYTES)
+	{
+		parity_vector v = load(src + i);
+		for (uint e=0;e<exponent;e++)
+			v = mul2(v);
+		store(dst + i, load(dst + i) ^ v);
+	}
+
+	for (;i<bytes;i++)
+	{
+		unsigned char b = src[i];
+		for (uint e=0;e<exponent;e++)
+			b = (b << 1) ^ ((b & 0x80) ? 0x1d : 0);
+		dst[i] ^= b;
+	}
+}
+
+/*
+ * Recover the lost data page x from q, Q with the other data pages folded
+ * out: dst = g^-x * q.
+ */
+void parity_recover_q(char *dst, const char *q, uint x, uint bytes)
+{
+	memset(dst, 0, bytes);
+	parity_mul_xor(dst, q, 255 - x % 255, bytes);
+}
+
+/*
+ * Recover the lost data pages x and y of a row. On entry dx and dy hold
+ * the syndromes P' and Q', on return the data pages.
+ */
+void parity_recover_pq(char *dx, char *dy, uint x, uint y, uint bytes)
+{
+	std::vector<char> sum(dy, dy + bytes);
+	parity_mul_xor(&sum[0], dx, y, bytes);
+
+	// dy = Dy = P' + Dx, dx = Dx
+	memcpy(dy, dx, bytes);
+	memset(dx, 0, bytes);
+	parity_mul_xor(dx, &sum[0], 255 - logarithm(power(x) ^ power(y)), bytes);
+	parity_xor(dy, dx, bytes);
+}
+
+}
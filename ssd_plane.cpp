@@ -403,3 +403,28 @@ Block *Plane::get_block_pointer(const Address & address)
 	assert(address.valid >= PLANE);
 	return data[address.block].get_pointer();
 }
+
+void Plane::checkpoint(Checkpoint &cp)
+{
+	cp.value(least_worn);
+	cp.value(erases_remaining);
+	cp.value(last_erase_time);
+	cp.address(next_page);
+	cp.value(free_blocks);
+
+	for (uint i=0;i<size;i++)
+		data[i].checkpoint(cp);
+}
+
+void Plane::precondition(const Precondition &state)
+{
+	free_blocks = 0;
+	for (uint i=0;i<size;i++)
+	{
+		data[i].precondition(state);
+		if (data[i].get_state() == FREE)
+			free_blocks++;
+	}
+
+	update_wear_stats();
+}
@@ -0,0 +1,500 @@
+/* Copyright 2011 Matias Bjørling */
+
+/* ssd_precondition.cpp  */
+
+/* FlashSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version. */
+
+/* FlashSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. */
+
+/* You should have received a copy of the GNU General Public License
+ * along with FlashSim.  If not, see <http://www.gnu.org/licenses/>. */
+
+/****************************************************************************/
+
+/* Precondition class
+ *
+ * Measurements are only meaningful once the device is in steady state,
+ * i.e. after it has been filled and overwritten a few times over, which
+ * takes hours when replayed through the event path. The preconditioning
+ * workload is instead played against a model of the block allocation and
+ * GC of Block_manager that keeps nothing but counters and maps:
+ *
+ * The PRECONDITION_FILL fraction of the logical pages is written in order,
+ * followed by PRECONDITION_PASSES times as many random overwrites. With
+ * PRECONDITION_HOT_SPACE set, PRECONDITION_HOT_WRITES of the overwrites go
+ * to that fraction of the filled pages.
+ *
+ * Page mapped FTLs are modelled page by page: blocks are handed out as by
+ * get_page_block, GC starts at the same utilisation, picks victims from
+ * an index ordered like the cost index and relocates their valid pages as
+ * cleanup_blocks does. A page FTL preconditioned this way ends up in the
+ * state the same writes would leave through event_arrive.
+ *
+ * The log block FTLs (BAST, FAST) get the state after all logs have been
+ * merged: every logical block in one data block, pages at their offsets.
+ * The erases of the overwrites are spread over the data blocks, one per
+ * BLOCK_SIZE overwritten pages, which is the least the merges cost.
+ *
+ * BDFTL is not modelled: which logical blocks it maps as blocks depends on
+ * the order of its writes and GC, which the page model does not follow.
+ * Ssd::precondition replays the workload through the FTL instead.
+ */
+
+#include <stdio.h>
+#include <assert.h>
+#include <random>
+#include <algorithm>
+#include "ssd.h"
+
+using namespace ssd;
+
+Precondition::Precondition(const Block_manager &manager):
+	gcFrontier(-1),
+	gcDie(0),
+	simpleCurrentFree(0),
+	allocations(0),
+	currentWritingBlock(-2),
+	hostWrites(0),
+	gcWrites(0),
+	numErases(0),
+	manager(manager),
+	blocks(manager.max_blocks),
+	span(0),
+	full(false),
+	cleaning(false),
+	outOfBlocks(false),
+	merged(false),
+	nextFrontier(0),
+	ownGcFrontier(false),
+	freeCount(0),
+	freeClock(0)
+{
+	ulong pages = blocks * BLOCK_SIZE;
+
+	map.assign(pages, -1);
+	reverse.assign(pages, -1);
+	written.assign(blocks, 0);
+	invalid.assign(blocks, 0);
+	erases.assign(blocks, 0);
+
+	// Blocks enter the cost index in block order, as they are created.
+	cost.reserve(blocks);
+	for (ulong i=0;i<blocks;i++)
+		cost.push_back(0);
+
+	for (uint i=0;i<manager.dieCurrentFree.size();i++)
+	{
+		dieCurrentFree.push_back((ulong)i * manager.dieBlocks * BLOCK_SIZE);
+		skip_map_blocks(i);
+	}
+
+	freeDies.resize(dieCurrentFree.size());
+	freeStamp.assign(blocks, 0);
+
+	span = (ulong)(PRECONDITION_FILL * pages);
+	if (span > pages)
+		span = pages;
+}
+
+/*
+ * Precondition a page mapped FTL. The host writes go round robin to one
+ * frontier per entry of dies, each taking its blocks from that die (-1 ->
+ * any die). GC relocates to a frontier of its own, taken from the dies in
+ * turn, or else to the first host frontier.
+ */
+enum status Precondition::run_page_mapped(const std::vector<int> &dies, bool gcFrontier)
+{
+	assert(dies.size() > 0);
+
+	frontierDies = dies;
+	frontiers.assign(dies.size(), -1);
+	ownGcFrontier = gcFrontier;
+
+	if (run() == FAILURE)
+		return FAILURE;
+
+	return finish();
+}
+
+/*
+ * Precondition a log block FTL. Logical block n of the filled range is
+ * kept in the n-th data block handed out.
+ */
+enum status Precondition::run_block_mapped(void)
+{
+	ulong lbns = (span + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	ulong overwrites = (ulong)(PRECONDITION_PASSES * span);
+
+	merged = true;
+
+	for (ulong lbn=0;lbn<lbns;lbn++)
+	{
+		long block = allocate(-1);
+		if (block == -1)
+		{
+			fprintf(stderr, "Precondition error: %s: the fill of %.2f does not fit the device.\n", __func__, PRECONDITION_FILL);
+			return FAILURE;
+		}
+
+		for (uint i=0;i<BLOCK_SIZE && lbn * BLOCK_SIZE + i < span;i++)
+		{
+			program(block + i, lbn * BLOCK_SIZE + i);
+			hostWrites++;
+		}
+	}
+
+	// One merge at least per BLOCK_SIZE overwritten pages.
+	ulong merges = overwrites / BLOCK_SIZE;
+	for (ulong lbn=0;lbn<lbns;lbn++)
+	{
+		ulong block = map[lbn * BLOCK_SIZE] / BLOCK_SIZE;
+		erases[block] = merges / lbns + (lbn < merges % lbns ? 1 : 0);
+	}
+
+	hostWrites += overwrites;
+	numErases = lbns == 0 ? 0 : merges;
+
+	return finish();
+}
+
+enum status Precondition::run(void)
+{
+	for (ulong lpn=0;lpn<span && !full;lpn++)
+		write(lpn);
+
+	ulong overwrites = (ulong)(PRECONDITION_PASSES * span);
+
+	std::mt19937_64 generator(PRECONDITION_SEED);
+	for (ulong i=0;i<overwrites && !full && span > 0;i++)
+		write(overwrite(generator, span));
+
+	if (full)
+	{
+		fprintf(stderr, "Precondition error: %s: out of free blocks, the fill of %.2f leaves GC no room.\n", __func__, PRECONDITION_FILL);
+		return FAILURE;
+	}
+
+	return SUCCESS;
+}
+
+/*
+ * Next page of the overwrites of the span filled pages.
+ */
+long Precondition::overwrite(std::mt19937_64 &generator, ulong span)
+{
+	ulong hot = (ulong)(PRECONDITION_HOT_SPACE * span);
+
+	if (hot == 0 || hot >= span)
+		return generator() % span;
+	else if ((generator() >> 11) * (1.0 / 9007199254740992.0) < PRECONDITION_HOT_WRITES)
+		return generator() % hot;
+	else
+		return hot + generator() % (span - hot);
+}
+
+/*
+ * Put the block lists in the order Block_manager keeps them. Fails if a
+ * block would be worn out.
+ */
+enum status Precondition::finish(void)
+{
+	for (ulong i=0;i<blocks;i++)
+	{
+		if (erases[i] >= BLOCK_ERASES)
+		{
+			fprintf(stderr, "Precondition error: %s: the workload wears out block %lu.\n", __func__, i);
+			return FAILURE;
+		}
+	}
+
+	// The erased blocks in the order they were freed.
+	for (uint d=0;d<freeDies.size();d++)
+		freeList.insert(freeList.end(), freeDies[d].begin(), freeDies[d].end());
+	std::sort(freeList.begin(), freeList.end(), [this](ulong a, ulong b) { return freeStamp[a] < freeStamp[b]; });
+
+	for (CostByInvalid::iterator it = cost.get<1>().begin(); it != cost.get<1>().end(); ++it)
+		costOrder.push_back(block_of(it));
+
+	return SUCCESS;
+}
+
+/*
+ * A host write, in the order of FtlImpl_Page::write: take the page (which
+ * may start GC), then retire the old version.
+ */
+void Precondition::write(long lpn)
+{
+	uint frontier = nextFrontier;
+	nextFrontier = (nextFrontier + 1) % frontiers.size();
+
+	long ppn = next_page(frontiers[frontier], frontierDies[frontier], true);
+	if (full)
+		return;
+
+	if (map[lpn] != -1)
+		invalidate(map[lpn]);
+
+	program(ppn, lpn);
+	hostWrites++;
+}
+
+/*
+ * The get_free_data_page of the page mapped FTLs.
+ */
+long Precondition::next_page(long &frontier, int die, bool collect)
+{
+	if (frontier == -1 || (frontier % BLOCK_SIZE == BLOCK_SIZE -1 && collect))
+		this->collect();
+
+	if (frontier == -1 || frontier % BLOCK_SIZE == BLOCK_SIZE -1)
+	{
+		long block = allocate(die);
+		if (block == -1)
+			return -1;
+		frontier = block;
+	}
+	else
+		frontier++;
+
+	return frontier;
+}
+
+/*
+ * Block_manager::get_page_block. Returns the first page of the block, or
+ * -1 if no block is left.
+ */
+long Precondition::allocate(int die)
+{
+	long address;
+
+	if (simpleCurrentFree < blocks*BLOCK_SIZE)
+	{
+		uint d = 0;
+		if (die >= 0 && (uint)die < dieCurrentFree.size() && dieCurrentFree[die] < die_end(die))
+			d = die;
+		while (dieCurrentFree[d] == die_end(d))
+			d++;
+
+		address = dieCurrentFree[d];
+		dieCurrentFree[d] += BLOCK_SIZE;
+		simpleCurrentFree += BLOCK_SIZE;
+		skip_map_blocks(d);
+	}
+	else
+	{
+		if (freeCount <= 1 && !outOfBlocks)
+		{
+			outOfBlocks = true;
+			collect();
+		}
+
+		if (freeCount == 0)
+		{
+			full = true;
+			return -1;
+		}
+
+		// The oldest erased block of the die, else the oldest of all.
+		std::deque<ulong> *queue = NULL;
+		if (die >= 0 && (uint)die < freeDies.size() && !freeDies[die].empty())
+			queue = &freeDies[die];
+		else
+			for (uint d=0;d<freeDies.size();d++)
+				if (!freeDies[d].empty() && (queue == NULL || freeStamp[freeDies[d].front()] < freeStamp[queue->front()]))
+					queue = &freeDies[d];
+
+		address = queue->front() * BLOCK_SIZE;
+		queue->pop_front();
+		freeCount--;
+		outOfBlocks = false;
+	}
+
+	currentWritingBlock = address;
+	allocations++;
+
+	return address;
+}
+
+ulong Precondition::die_end(uint die) const
+{
+	return (ulong)(die + 1) * manager.dieBlocks * BLOCK_SIZE;
+}
+
+void Precondition::skip_map_blocks(uint die)
+{
+	while (dieCurrentFree[die] < die_end(die) && manager.is_map_block(dieCurrentFree[die] / BLOCK_SIZE))
+	{
+		dieCurrentFree[die] += BLOCK_SIZE;
+		simpleCurrentFree += BLOCK_SIZE;
+	}
+}
+
+ulong Precondition::num_free_blocks(void) const
+{
+	return blocks - std::min(blocks, simpleCurrentFree / BLOCK_SIZE) + freeCount;
+}
+
+ulong Precondition::block_of(CostByInvalid::iterator it) const
+{
+	return cost.project<0>(it) - cost.begin();
+}
+
+/*
+ * Block_manager::insert_events and select_victims for the page mapped
+ * FTLs. Every allocated block counts as active, as data_active is not
+ * lowered by their GC.
+ */
+void Precondition::collect(void)
+{
+	float used = (int)allocations - (int)freeCount;
+	float total = blocks;
+	float ratio = used/total;
+
+	if (ratio < 0.90 || cleaning)
+		return;
+
+	uint num_to_erase = 5;
+
+	cleaning = true;
+
+	CostByInvalid::iterator it = cost.get<1>().end();
+	--it;
+
+	while (num_to_erase != 0 && *it > 0 && written[block_of(it)] == BLOCK_SIZE && !full)
+	{
+		if (currentWritingBlock != (long)(block_of(it) * BLOCK_SIZE))
+		{
+			std::vector<ulong> victims(1, block_of(it));
+
+			int toMove = written[victims[0]] - invalid[victims[0]];
+			int freePages = ((int)num_free_blocks() - 1) * BLOCK_SIZE;
+
+			CostByInvalid::iterator next = it;
+			while (victims.size() < GC_SORT_BY_LPN && victims.size() < num_to_erase && next != cost.get<1>().begin())
+			{
+				--next;
+
+				if (*next == 0 || written[block_of(next)] != BLOCK_SIZE)
+					break;
+
+				if (currentWritingBlock == (long)(block_of(next) * BLOCK_SIZE))
+					continue;
+
+				toMove += BLOCK_SIZE - *next;
+				if (toMove > freePages)
+					break;
+
+				victims.push_back(block_of(next));
+			}
+
+			relocate(victims);
+
+			for (uint i=0;i<victims.size();i++)
+				erase(victims[i]);
+
+			num_to_erase -= victims.size() - 1;
+		}
+
+		it = cost.get<1>().end();
+		--it;
+
+		if (currentWritingBlock == (long)(block_of(it) * BLOCK_SIZE))
+			--it;
+
+		num_to_erase--;
+	}
+
+	cleaning = false;
+}
+
+/*
+ * Move the valid pages of the victims, in LPN order with GC_SORT_BY_LPN.
+ */
+void Precondition::relocate(const std::vector<ulong> &victims)
+{
+	std::vector<std::pair<long, long> > pages;
+	for (uint b=0;b<victims.size();b++)
+		for (uint i=0;i<BLOCK_SIZE;i++)
+		{
+			long ppn = victims[b] * BLOCK_SIZE + i;
+			if (reverse[ppn] != -1)
+				pages.push_back(std::make_pair(reverse[ppn], ppn));
+		}
+
+	if (GC_SORT_BY_LPN > 0)
+		std::sort(pages.begin(), pages.end());
+
+	for (uint i=0;i<pages.size() && !full;i++)
+	{
+		long ppn;
+		if (ownGcFrontier)
+		{
+			if (gcFrontier == -1 || gcFrontier % BLOCK_SIZE == BLOCK_SIZE -1)
+				gcDie = (gcDie + 1) % dieCurrentFree.size();
+			ppn = next_page(gcFrontier, gcDie, false);
+		}
+		else
+			ppn = next_page(frontiers[0], frontierDies[0], false);
+
+		if (full)
+			return;
+
+		invalidate(pages[i].second);
+		program(ppn, pages[i].first);
+		gcWrites++;
+	}
+}
+
+void Precondition::program(long ppn, long lpn)
+{
+	map[lpn] = ppn;
+	reverse[ppn] = lpn;
+	written[ppn / BLOCK_SIZE]++;
+}
+
+void Precondition::invalidate(long ppn)
+{
+	ulong block = ppn / BLOCK_SIZE;
+
+	reverse[ppn] = -1;
+	invalid[block]++;
+	cost.replace(cost.begin() + block, invalid[block]);
+}
+
+void Precondition::erase(ulong block)
+{
+	written[block] = 0;
+	invalid[block] = 0;
+	erases[block]++;
+	numErases++;
+
+	cost.replace(cost.begin() + block, 0);
+
+	freeDies[block / manager.dieBlocks].push_back(block);
+	freeStamp[block] = freeClock++;
+	freeCount++;
+}
+
+void Precondition::print_statistics(void)
+{
+	ulong valid = 0;
+	ulong used = 0;
+	for (ulong i=0;i<blocks;i++)
+		if (written[i] == BLOCK_SIZE)
+		{
+			valid += written[i] - invalid[i];
+			used++;
+		}
+
+	if (merged)
+		printf("Precondition: Host writes: %lu Erases: %lu (logs merged, least number of merges)\n", hostWrites, numErases);
+	else
+		printf("Precondition: Host writes: %lu GC writes: %lu WAF: %.3f Erases: %lu\n", hostWrites, gcWrites, hostWrites == 0 ? 0.0 : (double)(hostWrites + gcWrites) / hostWrites, numErases);
+	printf("Precondition: Full blocks: %lu Valid pages per full block: %.2f Free blocks: %lu\n", used, used == 0 ? 0.0 : (double)valid / used, num_free_blocks());
+}
@@ -23,8 +23,11 @@
 
 #include <cmath>
 #include <new>
+#include <map>
+#include <algorithm>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 #include "ssd.h"
 #include <sys/mman.h>
 #include <stdlib.h>
@@ -38,7 +41,16 @@ using namespace ssd;
  * occurs in the order of declaration in the class definition and not in the
  * order listed here */
 RaidSsd::RaidSsd(uint ssd_size):
-	size(ssd_size)
+	size(ssd_size),
+	last(0),
+	result(NULL),
+	parityTime(0.0),
+	collecting(0.0),
+	config(SimConfig::current()),
+	round(0),
+	pending(0),
+	start(0.0),
+	stop(false)
 {
 /*
  * Idea
@@ -49,18 +61,210 @@ RaidSsd::RaidSsd(uint ssd_size):
  *
  * 1. Striping
  * 2. Address splitting.
- * 3. Complete control
+ * 3. RAID-5
+ * 4. RAID-6
+ * 5. Complete control
  */
-	Ssds = new Ssd[RAID_NUMBER_OF_PHYSICAL_SSDS];
+	assert(RAID_NUMBER_OF_PHYSICAL_SSDS > get_parity_ssds());
+	assert(RAID_FAILED_SSD < (int)RAID_NUMBER_OF_PHYSICAL_SSDS);
+	assert(RAID_FAILED_SSD2 < (int)RAID_NUMBER_OF_PHYSICAL_SSDS);
+
+	// Only RAID-6 survives a second failed SSD.
+	assert(RAID_FAILED_SSD2 < 0 || (PARALLELISM_MODE == 4 && RAID_FAILED_SSD >= 0 && RAID_FAILED_SSD2 != RAID_FAILED_SSD));
+
+	/* malloc the array and use placement new as the Ssd does for its
+	 * packages, the constructor takes the index of the SSD */
+	Ssds = (Ssd *) malloc(RAID_NUMBER_OF_PHYSICAL_SSDS * sizeof(Ssd));
+	if (Ssds == NULL)
+	{
+		fprintf(stderr, "RaidSsd error: %s: constructor unable to allocate the SSDs\n", __func__);
+		exit(MEM_ERR);
+	}
+	for (uint i=0;i<RAID_NUMBER_OF_PHYSICAL_SSDS;i++)
+		(void) new (&Ssds[i]) Ssd(SSD_SIZE, true, i);
+
+	requests.resize(RAID_NUMBER_OF_PHYSICAL_SSDS);
+	work.resize(RAID_NUMBER_OF_PHYSICAL_SSDS);
+	assigned.resize(RAID_NUMBER_OF_PHYSICAL_SSDS, 0);
+	latency.resize(RAID_NUMBER_OF_PHYSICAL_SSDS);
+	numParityReads.resize(RAID_NUMBER_OF_PHYSICAL_SSDS, 0);
+	numParityWrites.resize(RAID_NUMBER_OF_PHYSICAL_SSDS, 0);
+	numBusyReads.resize(RAID_NUMBER_OF_PHYSICAL_SSDS, 0);
+	numCoordinatedGC.resize(RAID_NUMBER_OF_PHYSICAL_SSDS, 0);
+	page.resize(PAGE_SIZE);
+
+	if (RAID_PARALLEL)
+	{
+		for (uint i=0;i<RAID_NUMBER_OF_PHYSICAL_SSDS;i++)
+			workers.push_back(std::thread(&RaidSsd::run_worker, this, i));
+	}
 
 	return;
 }
 
 RaidSsd::~RaidSsd(void)
 {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stop = true;
+	}
+	wake.notify_all();
+
+	for (uint i=0;i<workers.size();i++)
+		workers[i].join();
+
+	for (uint i=0;i<requests.size();i++)
+		Ssds[i].~Ssd();
+	free(Ssds);
 	return;
 }
 
+/*
+ * Worker thread of an SSD. The configuration is thread local, so it is
+ * loaded again before the SSD is driven from this thread.
+ */
+void RaidSsd::run_worker(uint ssd)
+{
+	config.apply();
+
+	ulong seen = 0;
+	for (;;)
+	{
+		double start_time;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			while (!stop && assigned[ssd] == seen)
+				wake.wait(guard);
+
+			if (stop)
+				return;
+
+			seen = assigned[ssd];
+			start_time = start;
+		}
+
+		serve(ssd, work[ssd], start_time);
+		work[ssd].clear();
+
+		std::lock_guard<std::mutex> guard(lock);
+		if (--pending == 0)
+			done.notify_one();
+	}
+}
+
+/*
+ * Serve the requests of an SSD. They arrive together, the SSD is done when
+ * the slowest completes.
+ */
+void RaidSsd::serve(uint ssd, const std::vector<Request> &list, double start_time)
+{
+	latency[ssd] = 0.0;
+	for (uint i=0;i<list.size();i++)
+	{
+		const Request &r = list[i];
+		if (r.result == NULL)
+		{
+			double time = Ssds[ssd].event_arrive(r.type, r.logical_address, r.size, start_time, r.buffer);
+			if (time > latency[ssd])
+				latency[ssd] = time;
+			continue;
+		}
+
+		// Pages that are kept are read one by one, the result buffer
+		// holds the last page read.
+		for (uint p=0;p<r.size;p++)
+		{
+			double time = Ssds[ssd].event_arrive(r.type, r.logical_address + p, 1, start_time, r.buffer);
+			if (time > latency[ssd])
+				latency[ssd] = time;
+
+			void *data = Ssds[ssd].get_result_buffer();
+			if (data == NULL)
+				memset(r.result + p * PAGE_SIZE, 0, PAGE_SIZE);
+			else
+				memcpy(r.result + p * PAGE_SIZE, data, PAGE_SIZE);
+		}
+	}
+}
+
+/*
+ * Queue a part of the request for an SSD. Parts that continue the previous
+ * part of the SSD, on the SSD and in the buffers, are merged.
+ */
+void RaidSsd::add_request(uint ssd, enum event_type type, ulong logical_address, uint size, void *buffer, char *result)
+{
+	std::vector<Request> &list = requests[ssd];
+	if (!list.empty())
+	{
+		Request &prev = list.back();
+		if (prev.type == type && prev.logical_address + prev.size == logical_address
+			&& (buffer == NULL ? prev.buffer == NULL : (char*)prev.buffer + prev.size * PAGE_SIZE == buffer)
+			&& (result == NULL ? prev.result == NULL : prev.result + prev.size * PAGE_SIZE == result))
+		{
+			prev.size += size;
+			return;
+		}
+	}
+
+	Request r = {type, logical_address, size, buffer, result};
+	list.push_back(r);
+}
+
+/*
+ * Serve the queued requests, the SSDs in parallel. Returns the time of the
+ * slowest SSD.
+ */
+double RaidSsd::run_round(double start_time)
+{
+	uint busy = 0;
+	for (uint i=0;i<RAID_NUMBER_OF_PHYSICAL_SSDS;i++)
+	{
+		latency[i] = 0.0;
+		if (!requests[i].empty())
+		{
+			busy++;
+			last = i;
+		}
+	}
+
+	if (busy > 1 && !workers.empty())
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		start = start_time;
+		pending = busy;
+		round++;
+		for (uint i=0;i<RAID_NUMBER_OF_PHYSICAL_SSDS;i++)
+		{
+			if (requests[i].empty())
+				continue;
+
+			work[i].swap(requests[i]);
+			assigned[i] = round;
+		}
+		wake.notify_all();
+
+		while (pending != 0)
+			done.wait(guard);
+	}
+	else
+	{
+		// A single SSD is served on the calling thread.
+		for (uint i=0;i<RAID_NUMBER_OF_PHYSICAL_SSDS;i++)
+			if (!requests[i].empty())
+				serve(i, requests[i], start_time);
+	}
+
+	double time = 0.0;
+	for (uint i=0;i<RAID_NUMBER_OF_PHYSICAL_SSDS;i++)
+	{
+		if (latency[i] > time)
+			time = latency[i];
+		requests[i].clear();
+	}
+
+	return time;
+}
+
 double RaidSsd::event_arrive(enum event_type type, ulong logical_address, uint size, double start_time)
 {
 	return event_arrive(type, logical_address, size, start_time, NULL);
@@ -71,52 +275,541 @@ double RaidSsd::event_arrive(enum event_type type, ulong logical_address, uint s
  * 	logical_address (page number), size of request in pages, and the start
  * 	time (arrive time) of the request
  * The SSD will process the request and return the time taken to process the
- * 	request.  Remember to use the same time units as in the config file. */
+ * 	request.  Remember to use the same time units as in the config file.
+ * The SSDs serve their parts of the request in parallel, the request
+ * 	completes when the slowest SSD completes. */
 double RaidSsd::event_arrive(enum event_type type, ulong logical_address, uint size, double start_time, void *buffer)
 {
-	if (type == WRITE)
-		printf("Writing to logical address: %lu\n", logical_address);
-	else if (type == READ)
-		printf("Read from logical address: %lu\n", logical_address);
+	for (uint i=0;i<RAID_NUMBER_OF_PHYSICAL_SSDS;i++)
+		requests[i].clear();
 
 	if (PARALLELISM_MODE == 1) // Striping
 	{
-		double timings[RAID_NUMBER_OF_PHYSICAL_SSDS];
-		for (int i=0;i<RAID_NUMBER_OF_PHYSICAL_SSDS;i++)
+		for (uint i=0;i<RAID_NUMBER_OF_PHYSICAL_SSDS;i++)
+			add_request(i, type, logical_address, size, buffer == NULL ? NULL : (char*)buffer + (i*PAGE_SIZE));
+	}
+	else if (PARALLELISM_MODE == 2) // Splitted address space
+	{
+		// Chunks of RAID_CHUNK_SIZE pages go round robin over the SSDs.
+		for (uint i=0;i<size;)
+		{
+			ulong lpn = logical_address + i;
+			ulong chunk = lpn / RAID_CHUNK_SIZE;
+			ulong offset = lpn % RAID_CHUNK_SIZE;
+			uint pages = RAID_CHUNK_SIZE - offset;
+			if (pages > size - i)
+				pages = size - i;
+
+			add_request(chunk % RAID_NUMBER_OF_PHYSICAL_SSDS, type, (chunk / RAID_NUMBER_OF_PHYSICAL_SSDS) * RAID_CHUNK_SIZE + offset, pages, buffer == NULL ? NULL : (char*)buffer + i * PAGE_SIZE);
+			i += pages;
+		}
+	}
+	else if (PARALLELISM_MODE == 3 || PARALLELISM_MODE == 4) // RAID-5/6
+	{
+		if (type == READ)
+			return parity_read(logical_address, size, start_time);
+		else if (type == WRITE)
+			return parity_write(logical_address, size, start_time, buffer);
+		return 0;
+	}
+	else
+		return 0;
+
+	return run_round(start_time);
+}
+
+/*
+ * RAID-5/6 layout
+ *
+ * A stripe holds one chunk of RAID_CHUNK_SIZE pages on every SSD. One
+ * chunk (two with RAID-6) is parity, the others hold data. The parity
+ * rotates over the SSDs from stripe to stripe, the data chunks follow the
+ * parity (left symmetric). Page o of the chunks of a stripe form a row:
+ * the parity page of a row covers the data pages of the row, P as their
+ * XOR and Q as their Reed-Solomon syndrome.
+ */
+uint RaidSsd::get_parity_ssds(void) const
+{
+	if (PARALLELISM_MODE == 3)
+		return 1;
+	else if (PARALLELISM_MODE == 4)
+		return 2;
+	return 0;
+}
+
+uint RaidSsd::get_parity_ssd(ulong stripe, uint parity) const
+{
+	uint n = RAID_NUMBER_OF_PHYSICAL_SSDS;
+	return (n - 1 - stripe % n + parity) % n;
+}
+
+uint RaidSsd::get_data_ssd(ulong stripe, uint chunk) const
+{
+	return get_parity_ssd(stripe, get_parity_ssds() + chunk);
+}
+
+bool RaidSsd::is_failed(uint ssd) const
+{
+	return (int)ssd == RAID_FAILED_SSD || (int)ssd == RAID_FAILED_SSD2;
+}
+
+/*
+ * Recover the lost data chunks of a row, one or two, in place. slot holds
+ * the pages of the row read: the data chunks, then P and Q. A single lost
+ * chunk is recovered from Q if q is set, else from P. Returns the parity
+ * computation time; with no slot only the time is counted.
+ */
+double RaidSsd::recover(char *slot, uint chunks, const std::vector<uint> &lost, bool q)
+{
+	bool two = lost.size() == 2;
+	char *p = slot == NULL ? NULL : slot + chunks * PAGE_SIZE;
+	uint folds = 0;
+
+	// Fold the data read out of the parity used.
+	for (uint j=0;j<chunks;j++)
+	{
+		if (std::find(lost.begin(), lost.end(), j) != lost.end())
+			continue;
+
+		if (two || !q)
+		{
+			if (slot != NULL)
+				parity_xor(p, slot + j * PAGE_SIZE, PAGE_SIZE);
+			folds++;
+		}
+		if (two || q)
+		{
+			if (slot != NULL)
+				parity_mul_xor(p + PAGE_SIZE, slot + j * PAGE_SIZE, j, PAGE_SIZE);
+			folds++;
+		}
+	}
+
+	if (two)
+	{
+		if (slot != NULL)
+		{
+			memcpy(slot + lost[0] * PAGE_SIZE, p, PAGE_SIZE);
+			memcpy(slot + lost[1] * PAGE_SIZE, p + PAGE_SIZE, PAGE_SIZE);
+			parity_recover_pq(slot + lost[0] * PAGE_SIZE, slot + lost[1] * PAGE_SIZE, lost[0], lost[1], PAGE_SIZE);
+		}
+		folds += 2;
+	}
+	else if (q)
+	{
+		if (slot != NULL)
+			parity_recover_q(slot + lost[0] * PAGE_SIZE, p + PAGE_SIZE, lost[0], PAGE_SIZE);
+		folds++;
+	}
+	else if (slot != NULL)
+		memcpy(slot + lost[0] * PAGE_SIZE, p, PAGE_SIZE);
+
+	return folds * RAID_PARITY_DELAY;
+}
+
+/*
+ * A read is served around its SSD when the SSD is predicted to be busy for
+ * longer than each SSD holding the rest of the row, e.g. while it collects
+ * garbage. A degraded array cannot serve reads around an SSD.
+ */
+bool RaidSsd::is_busy(ulong stripe, uint chunk, double start_time)
+{
+	if (!RAID_READ_AROUND_BUSY || RAID_FAILED_SSD >= 0)
+		return false;
+
+	double wait = Ssds[get_data_ssd(stripe, chunk)].ready_at() - start_time;
+	if (wait <= 0.0)
+		return false;
+
+	uint chunks = RAID_NUMBER_OF_PHYSICAL_SSDS - get_parity_ssds();
+	for (uint j=0;j<=chunks;j++)
+	{
+		if (j == chunk)
+			continue;
+
+		uint source = j == chunks ? get_parity_ssd(stripe, 0) : get_data_ssd(stripe, j);
+		if (Ssds[source].ready_at() - start_time >= wait)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Every stripe spans all SSDs, so collecting on one SSD at a time keeps
+ * the rest of each row available to read around it. The SSD with the
+ * fewest free blocks at or below RAID_GC_FREE_BLOCKS collects when no
+ * other collection is in progress. An SSD that runs out of free blocks
+ * still collects on its own.
+ */
+void RaidSsd::coordinate_gc(double start_time)
+{
+	if (RAID_GC_FREE_BLOCKS == 0 || collecting > start_time)
+		return;
+
+	int ssd = -1;
+	uint fewest = RAID_GC_FREE_BLOCKS + 1;
+	for (uint i=0;i<RAID_NUMBER_OF_PHYSICAL_SSDS;i++)
+	{
+		if (is_failed(i))
+			continue;
+
+		uint blocks = Ssds[i].get_free_blocks();
+		if (blocks < fewest)
+		{
+			fewest = blocks;
+			ssd = i;
+		}
+	}
+
+	if (ssd == -1)
+		return;
+
+	double time = Ssds[ssd].collect_garbage(start_time);
+	if (time > 0.0)
+	{
+		collecting = start_time + time;
+		numCoordinatedGC[ssd]++;
+	}
+}
+
+/*
+ * Read from RAID-5/6. Pages of a failed SSD, or of an SSD that is busy, are
+ * reconstructed from the other data pages and P of their row. When P is
+ * lost as well, Q is used, and two lost data pages are recovered from P
+ * and Q together.
+ */
+double RaidSsd::parity_read(ulong logical_address, uint size, double start_time)
+{
+	uint chunks = RAID_NUMBER_OF_PHYSICAL_SSDS - get_parity_ssds();
+	uint parities = get_parity_ssds();
+	std::vector<char> slots;
+	std::vector<uint> lost;
+	uint kept = 0;
+	bool q = false;
+
+	result = NULL;
+	for (uint i=0;i<size;i++)
+	{
+		ulong chunk = (logical_address + i) / RAID_CHUNK_SIZE;
+		ulong stripe = chunk / chunks;
+		uint index = chunk % chunks;
+		ulong lpn = stripe * RAID_CHUNK_SIZE + (logical_address + i) % RAID_CHUNK_SIZE;
+		uint ssd = get_data_ssd(stripe, index);
+
+		// Only the last page is returned by get_result_buffer
+		bool keep = PAGE_ENABLE_DATA && i == size - 1;
+
+		if (!is_failed(ssd))
 		{
-			if (buffer == NULL)
+			if (!is_busy(stripe, index, start_time))
 			{
-				printf("Executing stage: %i\n", i);
-				timings[i] = Ssds[i].event_arrive(type, logical_address, size, start_time, NULL);
+				add_request(ssd, READ, lpn, 1, NULL, keep ? &page[0] : NULL);
+				continue;
 			}
+			numBusyReads[ssd]++;
+		}
+
+		// The data chunks of the row that cannot be read. One is recovered
+		// from P, or from Q if P failed too, two from P and Q.
+		lost.clear();
+		for (uint j=0;j<chunks;j++)
+			if (j == index || is_failed(get_data_ssd(stripe, j)))
+				lost.push_back(j);
+		q = lost.size() == 1 && is_failed(get_parity_ssd(stripe, 0));
+
+		if (keep)
+		{
+			slots.assign((chunks + parities) * PAGE_SIZE, 0);
+			kept = index;
+		}
+
+		for (uint j=0;j<chunks + parities;j++)
+		{
+			if (std::find(lost.begin(), lost.end(), j) != lost.end())
+				continue;
+			if (lost.size() == 1 && j == (q ? chunks : chunks + 1))
+				continue;
+
+			uint source = j < chunks ? get_data_ssd(stripe, j) : get_parity_ssd(stripe, j - chunks);
+			add_request(source, READ, lpn, 1, NULL, keep ? &slots[j * PAGE_SIZE] : NULL);
+			numParityReads[source]++;
+		}
+	}
+
+	double time = run_round(start_time);
+
+	if (!slots.empty())
+	{
+		double cpu = recover(&slots[0], chunks, lost, q);
+		memcpy(&page[0], &slots[kept * PAGE_SIZE], PAGE_SIZE);
+		parityTime += cpu;
+		time += cpu;
+	}
+
+	if (PAGE_ENABLE_DATA)
+		result = &page[0];
+
+	return time;
+}
+
+/*
+ * Write to RAID-5/6. The parity of each row written is updated either by
+ * read-modify-write, reading the old data written and the old parity, or
+ * by reconstruct-write, reading the data of the row not written. The
+ * reads are served first, then the parity is computed and the data and
+ * parity are written.
+ *
+ * A degraded array keeps the parity consistent without reading the failed
+ * SSDs: read-modify-write is used when the failed SSDs hold data that is
+ * not written, reconstruct-write otherwise. When RAID-6 lost two data
+ * chunks of a row and only one of them is written, the old data of the
+ * other is first recovered from the rest of the row and P and Q. Rows
+ * whose parity SSDs all failed get no parity.
+ */
+double RaidSsd::parity_write(ulong logical_address, uint size, double start_time, void *buffer)
+{
+	uint chunks = RAID_NUMBER_OF_PHYSICAL_SSDS - get_parity_ssds();
+	uint parities = get_parity_ssds();
+	uint slots = chunks + parities;
+	bool data = PAGE_ENABLE_DATA && buffer != NULL;
+
+	// The rows written, the page written to each data chunk of a row
+	// (-1 -> not written), the parity update used and the data chunks on
+	// a failed SSD
+	struct Row {
+		ulong stripe;
+		ulong lpn;
+		std::vector<long> pages;
+		uint written;
+		bool rmw;
+		bool recover;
+		bool parity;
+		std::vector<uint> lost;
+	};
+
+	std::vector<Row> rows;
+	std::map<std::pair<ulong, ulong>, uint> index;
+	for (uint i=0;i<size;i++)
+	{
+		ulong chunk = (logical_address + i) / RAID_CHUNK_SIZE;
+		ulong stripe = chunk / chunks;
+		ulong lpn = stripe * RAID_CHUNK_SIZE + (logical_address + i) % RAID_CHUNK_SIZE;
 
+		std::map<std::pair<ulong, ulong>, uint>::iterator it = index.find(std::make_pair(stripe, lpn));
+		if (it == index.end())
+		{
+			Row row;
+			row.stripe = stripe;
+			row.lpn = lpn;
+			row.pages.assign(chunks, -1);
+			row.written = 0;
+			row.rmw = false;
+			row.recover = false;
+			row.parity = true;
+			it = index.insert(std::make_pair(std::make_pair(stripe, lpn), (uint)rows.size())).first;
+			rows.push_back(row);
+		}
+
+		Row &row = rows[it->second];
+		row.pages[chunk % chunks] = i;
+		row.written++;
+	}
+
+	// Old contents read, slots of a row: the data chunks, then P and Q.
+	std::vector<char> old;
+	std::vector<char> parity;
+	if (data)
+	{
+		old.assign(rows.size() * slots * PAGE_SIZE, 0);
+		parity.assign(rows.size() * parities * PAGE_SIZE, 0);
+	}
+
+	for (uint r=0;r<rows.size();r++)
+	{
+		Row &row = rows[r];
+
+		uint lostWritten = 0;
+		uint parityFailed = 0;
+		for (uint p=0;p<parities;p++)
+			if (is_failed(get_parity_ssd(row.stripe, p)))
+				parityFailed++;
+		for (uint j=0;j<chunks;j++)
+		{
+			if (!is_failed(get_data_ssd(row.stripe, j)))
+				continue;
+			row.lost.push_back(j);
+			if (row.pages[j] != -1)
+				lostWritten++;
+		}
+
+		row.parity = parityFailed < parities;
+		if (!row.lost.empty() && lostWritten == 0)
+			row.rmw = true;
+		else if (!row.lost.empty() && lostWritten == row.lost.size())
+			row.rmw = false;
+		else if (!row.lost.empty())
+		{
+			row.rmw = false;
+			row.recover = true;
+		}
+		else if (parityFailed > 0)
+			row.rmw = false;
+		else if (RAID_PARITY_UPDATE == 1)
+			row.rmw = true;
+		else if (RAID_PARITY_UPDATE == 2)
+			row.rmw = false;
+		else
+			row.rmw = row.written + parities < chunks - row.written;
+
+		if (row.rmw && row.written == chunks)
+			row.rmw = false;
+
+		char *slot = data ? &old[r * slots * PAGE_SIZE] : NULL;
+		for (uint j=0;j<slots;j++)
+		{
+			bool read;
+			if (row.recover)
+				read = true;
+			else if (j >= chunks)
+				read = row.rmw;
 			else
-				timings[i] = Ssds[i].event_arrive(type, logical_address, size, start_time, (char*)buffer +(i*PAGE_SIZE));
+				read = row.rmw ? row.pages[j] != -1 : row.pages[j] == -1;
+
+			uint ssd = j < chunks ? get_data_ssd(row.stripe, j) : get_parity_ssd(row.stripe, j - chunks);
+			if (!read || !row.parity || is_failed(ssd))
+				continue;
 
+			add_request(ssd, READ, row.lpn, 1, NULL, data ? slot + j * PAGE_SIZE : NULL);
+			numParityReads[ssd]++;
 		}
+	}
+
+	double time = run_round(start_time);
+
+	// Fold the pages into the parity of each row. Data chunk j is
+	// multiplied by g^j for Q.
+	double cpu = 0.0;
+	for (uint r=0;r<rows.size();r++)
+	{
+		const Row &row = rows[r];
+		char *slot = data ? &old[r * slots * PAGE_SIZE] : NULL;
 
-		for (int i=0;i<RAID_NUMBER_OF_PHYSICAL_SSDS-1;i++)
+		if (!row.parity)
+			continue;
+
+		if (row.recover)
+			cpu += recover(slot, chunks, row.lost, false);
+
+		for (uint p=0;p<parities;p++)
 		{
-			if (timings[i] != timings[i+1])
-				fprintf(stderr, "ERROR: Timings are not the same. %d %d\n", timings[i], timings[i+1]);
+			char *dst = data ? &parity[(p * rows.size() + r) * PAGE_SIZE] : NULL;
+			if (data && row.rmw)
+				memcpy(dst, slot + (chunks + p) * PAGE_SIZE, PAGE_SIZE);
+
+			for (uint j=0;j<chunks;j++)
+			{
+				const char *fresh = row.pages[j] == -1 || !data ? NULL : (char*)buffer + row.pages[j] * PAGE_SIZE;
+				if (row.rmw && row.pages[j] == -1)
+					continue;
+
+				// Read-modify-write removes the old data and adds the new.
+				uint folds = row.rmw ? 2 : 1;
+				cpu += folds * RAID_PARITY_DELAY;
+				if (!data)
+					continue;
+
+				const char *sources[2] = {row.rmw || fresh == NULL ? slot + j * PAGE_SIZE : fresh, fresh};
+				for (uint f=0;f<folds;f++)
+				{
+					if (p == 0)
+						parity_xor(dst, sources[f], PAGE_SIZE);
+					else
+						parity_mul_xor(dst, sources[f], j, PAGE_SIZE);
+				}
+			}
 		}
+	}
+	parityTime += cpu;
+	time += cpu;
+
+	// Write the data, then the parity of the rows. Consecutive pages of a
+	// chunk, and the parity of consecutive rows, are merged.
+	for (uint i=0;i<size;i++)
+	{
+		ulong chunk = (logical_address + i) / RAID_CHUNK_SIZE;
+		ulong stripe = chunk / chunks;
+		ulong lpn = stripe * RAID_CHUNK_SIZE + (logical_address + i) % RAID_CHUNK_SIZE;
+		uint ssd = get_data_ssd(stripe, chunk % chunks);
 
-		return timings[0];
+		if (!is_failed(ssd))
+			add_request(ssd, WRITE, lpn, 1, buffer == NULL ? NULL : (char*)buffer + i * PAGE_SIZE);
 	}
-	else if (PARALLELISM_MODE == 2) // Splitted address space
+
+	for (uint p=0;p<parities;p++)
 	{
-		return Ssds[logical_address%RAID_NUMBER_OF_PHYSICAL_SSDS].event_arrive(type, logical_address, size, start_time, (char*)buffer);
+		for (uint r=0;r<rows.size();r++)
+		{
+			uint ssd = get_parity_ssd(rows[r].stripe, p);
+			if (is_failed(ssd))
+				continue;
+
+			add_request(ssd, WRITE, rows[r].lpn, 1, data ? &parity[(p * rows.size() + r) * PAGE_SIZE] : NULL);
+			numParityWrites[ssd]++;
+		}
 	}
 
-	return 0;
+	time += run_round(start_time + time);
+
+	coordinate_gc(start_time + time);
+
+	return time;
 }
 
 /*
- * Returns a pointer to the global buffer of the Ssd.
- * It is up to the user to not read out of bound and only
+ * Returns a pointer to the result buffer of the last SSD that served a
+ * request. It is up to the user to not read out of bound and only
  * read the intended size. i.e. the page size.
  */
 void *RaidSsd::get_result_buffer()
 {
-	return global_buffer;
+	if (PARALLELISM_MODE == 3 || PARALLELISM_MODE == 4)
+		return result;
+	return Ssds[last].get_result_buffer();
+}
+
+/*
+ * The statistics of each SSD, with the reads and writes it served for
+ * parity.
+ */
+void RaidSsd::print_statistics()
+{
+	for (uint i=0;i<RAID_NUMBER_OF_PHYSICAL_SSDS;i++)
+	{
+		printf("SSD %u: parity reads %lu, parity writes %lu, reads served around %lu, coordinated GC %lu\n", i, numParityReads[i], numParityWrites[i], numBusyReads[i], numCoordinatedGC[i]);
+		Ssds[i].print_statistics();
+	}
+	printf("Parity computation time: %f\n", parityTime);
+}
+
+void RaidSsd::print_ftl_statistics()
+{
+	for (uint i=0;i<RAID_NUMBER_OF_PHYSICAL_SSDS;i++)
+		Ssds[i].print_ftl_statistics();
+}
+
+/*
+ * Switch every SSD between timed and functional simulation (see
+ * Ssd::set_functional). Only RAID_PARITY_DELAY is still counted in
+ * functional mode. Must not be called while a request is in progress.
+ */
+void RaidSsd::set_functional(bool functional)
+{
+	for (uint i=0;i<RAID_NUMBER_OF_PHYSICAL_SSDS;i++)
+		Ssds[i].set_functional(functional);
+}
+
+bool RaidSsd::is_functional(void) const
+{
+	return Ssds[0].is_functional();
 }
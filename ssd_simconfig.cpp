@@ -0,0 +1,149 @@
+/* Copyright 2011 Matias Bjørling */
+
+/* ssd_simconfig.cpp  */
+
+/* FlashSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version. */
+
+/* FlashSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. */
+
+/* You should have received a copy of the GNU General Public License
+ * along with FlashSim.  If not, see <http://www.gnu.org/licenses/>. */
+
+/****************************************************************************/
+
+/* Simulation configuration
+ *
+ * The configuration variables of ssd_config.cpp are thread local. A
+ * SimConfig names a config file and the entries that override it, and is
+ * applied on the thread that builds and drives the Ssd. Simulations with
+ * different configurations can therefore run on separate threads of one
+ * process.
+ *
+ * The config file is read once, when the SimConfig is created; applying
+ * it again, e.g. when two Ssds with different configurations take turns
+ * on one thread, only loads the values.
+ *
+ * Each SimConfig has an id that changes with its entries. The thread
+ * remembers the id of the SimConfig it applied, so an Ssd can check
+ * cheaply whether its configuration is the one in effect.
+ */
+
+#include <string.h>
+#include <atomic>
+#include "ssd.h"
+
+using namespace ssd;
+
+SimConfig::SimConfig(const char *config_name):
+	id(next_id()),
+	config_name(config_name)
+{
+	if (!this->config_name.empty())
+		read_config(config_name, file_entries, file_text_entries);
+	return;
+}
+
+SimConfig::~SimConfig(void)
+{
+	return;
+}
+
+/*
+ * The configuration loaded on the calling thread, to apply it on another
+ * thread.
+ */
+SimConfig SimConfig::current(void)
+{
+	SimConfig config("");
+	get_config_entries(config.entries);
+	get_config_text_entries(config.text_entries);
+
+	// The entries are what is loaded, so the config counts as applied.
+	if (get_config_id() != 0)
+		config.id = get_config_id();
+	else
+		set_config_id(config.id);
+	return config;
+}
+
+/*
+ * Override an entry of the config file, e.g. set("CACHE_DFTL_LIMIT", 1024).
+ */
+void SimConfig::set(const char *name, double value)
+{
+	entries.push_back(std::make_pair(std::string(name), value));
+	id = next_id();
+}
+
+/*
+ * Override an entry with a text value, e.g. set_text("PAGE_DATA_FILE", "ssd.img").
+ */
+void SimConfig::set_text(const char *name, const char *value)
+{
+	text_entries.push_back(std::make_pair(std::string(name), std::string(value)));
+	id = next_id();
+}
+
+/*
+ * Set the configuration of the calling thread to the defaults, then load
+ * the entries of the config file, read when the SimConfig was created, and
+ * the entries that override them.
+ */
+void SimConfig::apply(void) const
+{
+	reset_config();
+
+	char name[128];
+	for (uint i=0;i<file_entries.size();i++)
+	{
+		strncpy(name, file_entries[i].first.c_str(), sizeof(name) - 1);
+		name[sizeof(name) - 1] = '\0';
+		load_entry(name, file_entries[i].second, 0);
+	}
+
+	for (uint i=0;i<file_text_entries.size();i++)
+	{
+		strncpy(name, file_text_entries[i].first.c_str(), sizeof(name) - 1);
+		name[sizeof(name) - 1] = '\0';
+		load_text_entry(name, file_text_entries[i].second.c_str(), 0);
+	}
+
+	for (uint i=0;i<entries.size();i++)
+	{
+		strncpy(name, entries[i].first.c_str(), sizeof(name) - 1);
+		name[sizeof(name) - 1] = '\0';
+		load_entry(name, entries[i].second, 0);
+	}
+
+	for (uint i=0;i<text_entries.size();i++)
+	{
+		strncpy(name, text_entries[i].first.c_str(), sizeof(name) - 1);
+		name[sizeof(name) - 1] = '\0';
+		load_text_entry(name, text_entries[i].second.c_str(), 0);
+	}
+
+	update_config();
+	set_config_id(id);
+}
+
+bool SimConfig::is_applied(void) const
+{
+	return get_config_id() == id;
+}
+
+ulong SimConfig::next_id(void)
+{
+	static std::atomic<ulong> ids(1);
+	return ids++;
+}
+
+const char *SimConfig::get_name(void) const
+{
+	return config_name.c_str();
+}
@@ -35,13 +35,31 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <limits.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 
 using namespace ssd;
 
 /* use caution when editing the initialization list - initialization actually
  * occurs in the order of declaration in the class definition and not in the
  * order listed here */
-Ssd::Ssd(uint ssd_size): 
+Ssd::Ssd(const SimConfig &config):
+	Ssd(apply_config(config))
+{
+	return;
+}
+
+Ssd::Ssd(uint ssd_size):
+	Ssd(ssd_size, true)
+{
+	return;
+}
+
+/* A clone is built without page data, it maps the page data of the SSD it
+ * is cloned from (see clone). The SSDs of a RAID are built with their index
+ * as member, each keeps its page data in a file of its own. */
+Ssd::Ssd(uint ssd_size, bool map_data, int member): 
 	size(ssd_size), 
 	controller(*this), 
 	ram(RAM_READ_DELAY, RAM_WRITE_DELAY), 
@@ -60,7 +78,20 @@ Ssd::Ssd(uint ssd_size):
 	least_worn(0), 
 
 	/* assume hardware created at time 0 and had an implied free erasure */
-	last_erase_time(0.0)
+	last_erase_time(0.0),
+
+	pages(NULL),
+	result(NULL),
+	pages_bytes(0),
+	pages_file(-1),
+
+	pages_name(PAGE_DATA_FILE),
+
+	functional(FUNCTIONAL_MODE != 0),
+
+	pages_base(-1),
+
+	config(SimConfig::current())
 {
 	uint i;
 
@@ -87,37 +118,128 @@ Ssd::Ssd(uint ssd_size):
 		exit(MEM_ERR);
 	}
 
-	if (PAGE_ENABLE_DATA)
+	if (member >= 0 && !pages_name.empty())
+		pages_name += "." + std::to_string(member);
+
+	if (PAGE_ENABLE_DATA && map_data)
 	{
 		/* Allocate memory for data pages */
 		ulong pageSize = ((ulong)(SSD_SIZE * PACKAGE_SIZE * DIE_SIZE * PLANE_SIZE * BLOCK_SIZE)) * (ulong)PAGE_SIZE;
+		map_pages(pageSize);
+	}
+
+	assert(VIRTUAL_BLOCK_SIZE > 0);
+	assert(VIRTUAL_PAGE_SIZE > 0);
+
+	// The controller created the block manager of this SSD.
+	block_manager = Block_manager::instance();
+	activate();
+
+	return;
+}
+
+/*
+ * Map the page data. Without PAGE_DATA_FILE the pages are anonymous memory
+ * and every run starts from an empty device. With it, the file is mapped
+ * shared: the page data of an earlier run is read back and the pages
+ * written are kept in the file. The file is locked, two SSDs cannot share
+ * it; the SSDs of a RAID each use PAGE_DATA_FILE.<index>.
+ */
+void Ssd::map_pages(ulong bytes)
+{
+	int flags = MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE;
+
+	if (!pages_name.empty())
+	{
+		if ((pages_file = open(pages_name.c_str(), O_RDWR|O_CREAT, 0644)) == -1)
+		{
+			fprintf(stderr, "Ssd error: %s: unable to open page data file %s: %s\n", __func__, pages_name.c_str(), strerror(errno));
+			exit(FILE_ERR);
+		}
+
+		if (flock(pages_file, LOCK_EX|LOCK_NB) == -1)
+		{
+			fprintf(stderr, "Ssd error: %s: page data file %s is in use.\n", __func__, pages_name.c_str());
+			exit(FILE_ERR);
+		}
+
+		struct stat st;
+		if (fstat(pages_file, &st) == -1 || (st.st_size != 0 && (ulong)st.st_size != bytes))
+		{
+			fprintf(stderr, "Ssd error: %s: page data file %s does not match the size of the SSD (%lu bytes).\n", __func__, pages_name.c_str(), bytes);
+			exit(FILE_ERR);
+		}
+
+		if (st.st_size == 0 && ftruncate(pages_file, bytes) == -1)
+		{
+			fprintf(stderr, "Ssd error: %s: unable to size page data file %s: %s\n", __func__, pages_name.c_str(), strerror(errno));
+			exit(FILE_ERR);
+		}
+
+		flags = MAP_SHARED;
+	}
+
 #ifdef __APPLE__
-		page_data = mmap(NULL, pageSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+	pages = mmap(NULL, bytes, PROT_READ|PROT_WRITE, flags, pages_file, 0);
 #else
-		page_data = mmap64(NULL, pageSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1 ,0);
+	pages = mmap64(NULL, bytes, PROT_READ|PROT_WRITE, flags, pages_file, 0);
 #endif
 
-		if (page_data == MAP_FAILED)
-		{
-			fprintf(stderr, "Ssd error: %s: constructor unable to allocate page data.\n", __func__);
-			switch (errno)
-			{
-			case EACCES:
-				break;
-			}
-			printf("%i\n",errno);
-			exit(MEM_ERR);
-		}
+	if (pages == MAP_FAILED)
+	{
+		fprintf(stderr, "Ssd error: %s: constructor unable to allocate page data.\n", __func__);
+		printf("%i\n",errno);
+		exit(MEM_ERR);
 	}
 
-	assert(VIRTUAL_BLOCK_SIZE > 0);
-	assert(VIRTUAL_PAGE_SIZE > 0);
+	pages_bytes = bytes;
+	advise_pages(bytes);
+}
 
-	return;
+/* The hints are best effort, e.g. huge pages are not available for files
+ * on every file system. */
+void Ssd::advise_pages(ulong bytes)
+{
+#ifdef MADV_HUGEPAGE
+	if (PAGE_DATA_HUGE_PAGES)
+		madvise(pages, bytes, MADV_HUGEPAGE);
+#endif
+
+	if (PAGE_DATA_ADVICE == 1)
+		madvise(pages, bytes, MADV_RANDOM);
+	else if (PAGE_DATA_ADVICE == 2)
+		madvise(pages, bytes, MADV_SEQUENTIAL);
+	else if (PAGE_DATA_ADVICE == 3)
+		madvise(pages, bytes, MADV_WILLNEED);
+}
+
+/* Apply the configuration to the calling thread before the SSD is built. */
+ssd::uint Ssd::apply_config(const SimConfig &config)
+{
+	config.apply();
+	return SSD_SIZE;
+}
+
+/* Make the configuration, block manager, page data and result buffer of
+ * this SSD the ones used by the calling thread. */
+void Ssd::activate(void)
+{
+	if (!config.is_applied())
+		config.apply();
+
+	Block_manager::inst = block_manager;
+	page_data = pages;
+	global_buffer = result;
 }
 
 Ssd::~Ssd(void)
 {
+	// The hardware is torn down with the configuration of this SSD.
+	activate();
+
+	// Buffered writes reach flash and the page data file before they close.
+	flush(0.0);
+
 	/* explicitly call destructors and use free
 	 * since we used malloc and placement new */
 	for (uint i = 0; i < size; i++)
@@ -125,8 +247,22 @@ Ssd::~Ssd(void)
 		data[i].~Package();
 	}
 	free(data);
-	ulong pageSize = ((ulong)(SSD_SIZE * PACKAGE_SIZE * DIE_SIZE * PLANE_SIZE * BLOCK_SIZE)) * (ulong)PAGE_SIZE;
-	munmap(page_data, pageSize);
+	if (pages != NULL)
+	{
+		// Write the page data back to its file before it is closed.
+		if (pages_file != -1 && msync(pages, pages_bytes, MS_SYNC) == -1)
+			fprintf(stderr, "Ssd error: %s: unable to flush page data file %s: %s\n", __func__, pages_name.c_str(), strerror(errno));
+		munmap(pages, pages_bytes);
+	}
+
+	if (pages_file != -1)
+		close(pages_file);
+
+	unshare_pages();
+
+	if (Block_manager::inst == block_manager)
+		Block_manager::inst = NULL;
+	delete block_manager;
 
 	return;
 }
@@ -163,14 +299,23 @@ double Ssd::event_arrive(enum event_type type, ulong logical_address, uint size,
 
 	event->set_payload(buffer);
 
+	activate();
+	unshare_pages();
+
+	// A read of pages that were never written returns no buffer.
+	if (type == READ)
+		global_buffer = NULL;
+
 	if(controller.event_arrive(*event) != SUCCESS)
 	{
 		fprintf(stderr, "Ssd error: %s: request failed:\n", __func__);
 		event -> print(stderr);
 	}
 
+	result = global_buffer;
+
 	/* use start_time as a temporary for returning time taken to service event */
-	start_time = event -> get_time_taken();
+	start_time = functional ? 0.0 : event -> get_time_taken();
 	delete event;
 	return start_time;
 }
@@ -182,7 +327,7 @@ double Ssd::event_arrive(enum event_type type, ulong logical_address, uint size,
  */
 void *Ssd::get_result_buffer()
 {
-	return global_buffer;
+	return result;
 }
 
 /* read write erase and merge should only pass on the event
@@ -336,6 +481,7 @@ void Ssd::write_statistics(FILE *stream)
 
 void Ssd::print_ftl_statistics()
 {
+	activate();
 	controller.print_ftl_statistics();
 }
 
@@ -375,3 +521,425 @@ double Ssd::ready_at(void)
 	else
 		return next_ready_time;
 }
+
+ssd::uint Ssd::get_free_blocks(void)
+{
+	return block_manager->get_num_free_blocks();
+}
+
+/*
+ * Run garbage collection now instead of when the SSD runs out of free
+ * blocks. The blocks are cleaned on the channels as usual, so the SSD is
+ * busy until the returned time has passed. The round runs even when the SSD
+ * is not yet full enough for the collector to start by itself.
+ */
+double Ssd::collect_garbage(double start_time)
+{
+	Event event(ERASE, 0, 1, start_time);
+
+	activate();
+	unshare_pages();
+	block_manager->insert_events(event, true);
+
+	return functional ? 0.0 : event.get_time_taken();
+}
+
+/*
+ * Write the pages held in the write buffer to flash, e.g. before the
+ * statistics are read. The SSD is busy until the returned time has passed.
+ */
+double Ssd::flush(double start_time)
+{
+	Event event(WRITE, 0, 1, start_time);
+
+	activate();
+	if (WRITE_BUFFER_SIZE == 0)
+		return 0.0;
+
+	unshare_pages();
+	if (controller.flush(event) == FAILURE)
+		fprintf(stderr, "Ssd error: %s: unable to flush the write buffer.\n", __func__);
+
+	return functional ? 0.0 : event.get_time_taken();
+}
+
+/*
+ * Switch between timed and functional simulation. In functional mode the
+ * FTL, garbage collection and wear leveling run as usual, but requests
+ * do not lock the bus or pass through RAM and event_arrive returns 0. The
+ * FTLs still order their mappings by the start time of each request (e.g.
+ * the DFTL cache), so the caller keeps advancing it, e.g. with the arrival
+ * times of a trace. The mode can be switched between requests, e.g. to
+ * warm up functionally and measure timed. The channels are left as they
+ * were, so the first timed request starts on idle channels.
+ */
+void Ssd::set_functional(bool functional)
+{
+	this->functional = functional;
+}
+
+bool Ssd::is_functional(void) const
+{
+	return functional;
+}
+
+/*
+ * Write the state of the SSD to a checkpoint at path. An existing
+ * checkpoint at path is only replaced once the new one is complete.
+ */
+enum status Ssd::save_checkpoint(const char *path)
+{
+	Checkpoint cp;
+
+	activate();
+
+	if (cp.create(path) == FAILURE)
+		return FAILURE;
+
+	if (checkpoint(cp) == FAILURE)
+		return FAILURE;
+
+	return cp.close();
+}
+
+/*
+ * Replace the state of the SSD with the checkpoint at path. The SSD must
+ * be configured with the same geometry and FTL as the SSD that saved it,
+ * otherwise the SSD is left as it is. Delays, GC and other policies may
+ * differ.
+ */
+enum status Ssd::load_checkpoint(const char *path)
+{
+	Checkpoint cp;
+
+	activate();
+	unshare_pages();
+
+	if (cp.open(path) == FAILURE)
+		return FAILURE;
+
+	if (checkpoint(cp) == FAILURE)
+		return FAILURE;
+
+	return cp.close();
+}
+
+enum status Ssd::checkpoint(Checkpoint &cp)
+{
+	/* Configuration that decides the shape of the state */
+	const char *names[] = {"SSD_SIZE", "PACKAGE_SIZE", "DIE_SIZE", "PLANE_SIZE", "BLOCK_SIZE", "PAGE_SIZE",
+		"PAGE_ENABLE_DATA", "BUS_TABLE_SIZE", "FTL_IMPLEMENTATION", "VIRTUAL_BLOCK_SIZE", "VIRTUAL_PAGE_SIZE",
+		"NUMBER_OF_ADDRESSABLE_BLOCKS", "WRITE_BUFFER_SIZE", "BAST_LOG_BLOCK_LIMIT", "FAST_LOG_BLOCK_LIMIT",
+		"FAST_SEQUENTIAL_LOG_BLOCKS", "MAP_DIRECTORY_SIZE", "PAGE_WRITE_FRONTIERS", "DFTL_JOURNAL_SIZE",
+		"HMB_DFTL_LIMIT", "CACHE_DFTL_EXTENTS", "LEAFTL_GAMMA", "LEAFTL_BUFFER_SIZE"};
+	ulong layout[] = {SSD_SIZE, PACKAGE_SIZE, DIE_SIZE, PLANE_SIZE, BLOCK_SIZE, PAGE_SIZE,
+		PAGE_ENABLE_DATA, BUS_TABLE_SIZE, FTL_IMPLEMENTATION, VIRTUAL_BLOCK_SIZE, VIRTUAL_PAGE_SIZE,
+		NUMBER_OF_ADDRESSABLE_BLOCKS, WRITE_BUFFER_SIZE, BAST_LOG_BLOCK_LIMIT, FAST_LOG_BLOCK_LIMIT,
+		FAST_SEQUENTIAL_LOG_BLOCKS, MAP_DIRECTORY_SIZE, PAGE_WRITE_FRONTIERS, DFTL_JOURNAL_SIZE,
+		HMB_DFTL_LIMIT, CACHE_DFTL_EXTENTS, LEAFTL_GAMMA, LEAFTL_BUFFER_SIZE};
+	uint count = sizeof(layout) / sizeof(layout[0]);
+
+	std::vector<ulong> saved(layout, layout + count);
+	cp.section("layout");
+	cp.vector(saved);
+
+	if (saved.size() != count)
+	{
+		fprintf(stderr, "Ssd error: %s: checkpoint does not match this version of the simulator.\n", __func__);
+		return FAILURE;
+	}
+
+	for (uint i=0;i<count;i++)
+	{
+		if (saved[i] != layout[i])
+		{
+			fprintf(stderr, "Ssd error: %s: checkpoint was saved with %s %lu, the SSD has %lu.\n", __func__, names[i], saved[i], layout[i]);
+			return FAILURE;
+		}
+	}
+
+	cp.section("ssd");
+	cp.value(erases_remaining);
+	cp.value(least_worn);
+	cp.value(last_erase_time);
+
+	for (uint i=0;i<size;i++)
+		data[i].checkpoint(cp);
+
+	bus.checkpoint(cp);
+
+	// The cost index holds the blocks, so it follows their state.
+	block_manager->checkpoint(cp);
+	controller.checkpoint(cp);
+
+	// A clone maps the page data instead of copying it.
+	if (!PAGE_ENABLE_DATA || cp.is_in_memory())
+		return SUCCESS;
+
+	/* Page data is kept in the checkpoint for the valid pages only. A page
+	 * data file already holds it and is flushed instead. */
+	ulong numPages = (ulong)SSD_SIZE * PACKAGE_SIZE * DIE_SIZE * PLANE_SIZE * BLOCK_SIZE;
+
+	cp.section("page_data");
+	bool inFile = pages_file != -1;
+	cp.value(inFile);
+
+	if (inFile)
+	{
+		if (!cp.is_loading() && msync(pages, numPages * PAGE_SIZE, MS_SYNC) == -1)
+		{
+			fprintf(stderr, "Ssd error: %s: unable to flush page data file %s: %s\n", __func__, pages_name.c_str(), strerror(errno));
+			return FAILURE;
+		}
+
+		if (cp.is_loading() && pages_file == -1)
+			fprintf(stderr, "Ssd warning: %s: the page data of the checkpoint is in a page data file, set PAGE_DATA_FILE to use it.\n", __func__);
+
+		return SUCCESS;
+	}
+
+	for (ulong i=0;i<numPages;i++)
+		if (get_state(Address(i, PAGE)) == VALID)
+			cp.array((char*)pages + i * PAGE_SIZE, PAGE_SIZE);
+
+	return SUCCESS;
+}
+
+/*
+ * Bring an unused SSD to the steady state of the PRECONDITION_* workload
+ * without replaying it (see ssd_precondition.cpp). The maps, the block
+ * states, the wear and the block lists end up as after the workload. The
+ * statistics are left at zero and the pages read back as zeros. BDFTL has
+ * no model, its workload is replayed in functional mode.
+ */
+enum status Ssd::precondition(void)
+{
+	activate();
+
+	if (VIRTUAL_BLOCK_SIZE != 1 || VIRTUAL_PAGE_SIZE != 1)
+	{
+		fprintf(stderr, "Ssd error: %s: preconditioning needs VIRTUAL_BLOCK_SIZE and VIRTUAL_PAGE_SIZE of 1.\n", __func__);
+		return FAILURE;
+	}
+
+	if (controller.stats.numFTLWrite != 0 || controller.stats.numFTLTrim != 0)
+	{
+		fprintf(stderr, "Ssd error: %s: only an unused SSD can be preconditioned.\n", __func__);
+		return FAILURE;
+	}
+
+	if (FTL_IMPLEMENTATION == IMPL_BIMODAL)
+		return replay_precondition();
+
+	Precondition state(*block_manager);
+	if (controller.precondition(state) == FAILURE)
+		return FAILURE;
+
+	for (uint i=0;i<size;i++)
+		data[i].precondition(state);
+	update_wear_stats(Address());
+
+	// The cost index holds the blocks, so it follows their state.
+	block_manager->precondition(state);
+
+	state.print_statistics();
+
+	return SUCCESS;
+}
+
+/*
+ * Write the PRECONDITION_* workload through the FTL, as Precondition::run
+ * does in its model. The writes are functional and one time unit apart,
+ * the statistics are reset afterwards.
+ */
+enum status Ssd::replay_precondition(void)
+{
+	ulong pages = (ulong)NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE;
+	ulong span = (ulong)(PRECONDITION_FILL * pages);
+	if (span > pages)
+		span = pages;
+
+	bool wasFunctional = functional;
+	functional = true;
+
+	// The DFTL cache orders its mappings by the start time of the writes.
+	double time = 0;
+	for (ulong lpn=0;lpn<span;lpn++)
+		event_arrive(WRITE, lpn, 1, time++);
+
+	ulong overwrites = (ulong)(PRECONDITION_PASSES * span);
+
+	std::mt19937_64 generator(PRECONDITION_SEED);
+	for (ulong i=0;i<overwrites && span > 0;i++)
+		event_arrive(WRITE, Precondition::overwrite(generator, span), 1, time++);
+
+	functional = wasFunctional;
+
+	const Stats &stats = controller.stats;
+	ulong hostWrites = span + overwrites;
+	printf("Precondition: Host writes: %lu Flash writes: %li WAF: %.3f Erases: %li (replayed)\n", hostWrites, stats.numFTLWrite, hostWrites == 0 ? 0.0 : (double)stats.numFTLWrite / hostWrites, stats.numFTLErase);
+	reset_statistics();
+
+	return SUCCESS;
+}
+
+/*
+ * Create an independent SSD in the state of this one. Only the page data
+ * is shared copy-on-write: both SSDs map it (see share_pages), so a page is
+ * only duplicated once one of them writes it. Everything else, the
+ * hardware and block state, the block manager, the FTL maps, the write
+ * buffer, statistics and mode, is copied in full through a checkpoint in
+ * memory, so each clone costs the time and memory of those copies. A clone
+ * of an SSD with a page data file keeps its pages in memory and leaves the
+ * file alone.
+ *
+ * The clone is built with the configuration of the calling thread, which
+ * must be the one of this SSD. It may serve its requests on another thread
+ * that applied the same configuration, e.g. to run several workloads from
+ * one preconditioned state in parallel. Returns NULL on failure.
+ */
+Ssd *Ssd::clone(void)
+{
+	Ssd *copy = new Ssd(size, false);
+	ulong bytes = (ulong)SSD_SIZE * PACKAGE_SIZE * DIE_SIZE * PLANE_SIZE * BLOCK_SIZE * PAGE_SIZE;
+
+	activate();
+
+	if (PAGE_ENABLE_DATA)
+	{
+		int base = share_pages();
+		if (base == -1)
+		{
+			delete copy;
+			return NULL;
+		}
+
+		copy->pages = mmap(NULL, bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_NORESERVE, base, 0);
+		if (copy->pages == MAP_FAILED)
+		{
+			fprintf(stderr, "Ssd error: %s: unable to map the page data: %s\n", __func__, strerror(errno));
+			copy->pages = NULL;
+			delete copy;
+			return NULL;
+		}
+		copy->pages_bytes = bytes;
+		copy->advise_pages(bytes);
+	}
+
+	copy->functional = functional;
+
+	Checkpoint cp;
+	if (cp.create() == FAILURE || checkpoint(cp) == FAILURE || cp.reopen() == FAILURE)
+	{
+		delete copy;
+		return NULL;
+	}
+
+	copy->activate();
+	enum status loaded = copy->checkpoint(cp);
+	cp.close();
+	activate();
+
+	if (loaded == FAILURE)
+	{
+		delete copy;
+		return NULL;
+	}
+
+	return copy;
+}
+
+/* Memory file for the shared page data. */
+static int create_pages_base(void)
+{
+#ifdef __linux__
+	return memfd_create("flashsim-pages", MFD_CLOEXEC);
+#else
+	char name[] = "/tmp/flashsim-pages-XXXXXX";
+	int fd = mkstemp(name);
+	if (fd != -1)
+		unlink(name);
+	return fd;
+#endif
+}
+
+/*
+ * Write the page data to a memory file that the clones of this SSD map
+ * copy-on-write, and return the file. Only the valid pages are written,
+ * the others read back as zeros. Unless the pages are kept in a page data
+ * file, this SSD maps the memory file copy-on-write too, so the pages are
+ * held once for the SSD and all its clones. The file is reused for further
+ * clones until this SSD serves a request. Returns -1 on failure.
+ */
+int Ssd::share_pages(void)
+{
+	if (pages_base != -1)
+		return pages_base;
+
+	ulong numPages = (ulong)SSD_SIZE * PACKAGE_SIZE * DIE_SIZE * PLANE_SIZE * BLOCK_SIZE;
+	ulong bytes = numPages * PAGE_SIZE;
+
+	int fd = create_pages_base();
+	if (fd == -1 || ftruncate(fd, bytes) == -1)
+	{
+		fprintf(stderr, "Ssd error: %s: unable to create the shared page data: %s\n", __func__, strerror(errno));
+		if (fd != -1)
+			close(fd);
+		return -1;
+	}
+
+	// Runs of valid pages are written at once.
+	for (ulong i=0;i<numPages;)
+	{
+		if (get_state(Address(i, PAGE)) != VALID)
+		{
+			i++;
+			continue;
+		}
+
+		ulong first = i;
+		while (i < numPages && get_state(Address(i, PAGE)) == VALID)
+			i++;
+
+		char *from = (char*)pages + first * PAGE_SIZE;
+		ulong length = (i - first) * PAGE_SIZE;
+		off_t at = first * PAGE_SIZE;
+		while (length > 0)
+		{
+			ssize_t written = pwrite(fd, from, length, at);
+			if (written <= 0)
+			{
+				fprintf(stderr, "Ssd error: %s: unable to write the shared page data: %s\n", __func__, strerror(errno));
+				close(fd);
+				return -1;
+			}
+			from += written;
+			at += written;
+			length -= written;
+		}
+	}
+
+	if (pages_file == -1)
+	{
+		if (mmap(pages, bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_NORESERVE|MAP_FIXED, fd, 0) == MAP_FAILED)
+		{
+			fprintf(stderr, "Ssd error: %s: unable to map the shared page data: %s\n", __func__, strerror(errno));
+			exit(MEM_ERR);
+		}
+		advise_pages(bytes);
+	}
+
+	pages_base = fd;
+	return fd;
+}
+
+/* The page data is about to change, so the next clone needs a new copy of
+ * it. The mappings of the old one keep it alive. */
+void Ssd::unshare_pages(void)
+{
+	if (pages_base != -1)
+	{
+		close(pages_base);
+		pages_base = -1;
+	}
+}
@@ -64,6 +64,9 @@ void Stats::reset()
 	numCacheHits = 0;
 	numCacheFaults = 0;
 
+	// Block map updates
+	numMapWrite = 0;
+
 	// Memory consumptions (Bytes)
 	numMemoryTranslation = 0;
 	numMemoryCache = 0;
@@ -79,12 +82,12 @@ void Stats::reset_statistics()
 
 void Stats::write_header(FILE *stream)
 {
-	fprintf(stream, "numFTLRead;numFTLWrite;numFTLErase;numFTLTrim;numGCRead;numGCWrite;numGCErase;numWLRead;numWLWrite;numWLErase;numLogMergeSwitch;numLogMergePartial;numLogMergeFull;numPageBlockToPageConversion;numCacheHits;numCacheFaults;numMemoryTranslation;numMemoryCache;numMemoryRead;numMemoryWrite\n");
+	fprintf(stream, "numFTLRead;numFTLWrite;numFTLErase;numFTLTrim;numGCRead;numGCWrite;numGCErase;numWLRead;numWLWrite;numWLErase;numLogMergeSwitch;numLogMergePartial;numLogMergeFull;numPageBlockToPageConversion;numCacheHits;numCacheFaults;numMemoryTranslation;numMemoryCache;numMemoryRead;numMemoryWrite;numMapWrite\n");
 }
 
 void Stats::write_statistics(FILE *stream)
 {
-	fprintf(stream, "%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;\n",
+	fprintf(stream, "%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;%li;\n",
 			numFTLRead, numFTLWrite, numFTLErase, numFTLTrim,
 			numGCRead, numGCWrite, numGCErase,
 			numWLRead, numWLWrite, numWLErase,
@@ -93,7 +96,8 @@ void Stats::write_statistics(FILE *stream)
 			numCacheHits, numCacheFaults,
 			numMemoryTranslation,
 			numMemoryCache,
-			numMemoryRead,numMemoryWrite);
+			numMemoryRead,numMemoryWrite,
+			numMapWrite);
 
 	//print_statistics();
 }
@@ -107,9 +111,35 @@ void Stats::print_statistics()
 	printf("WL  Reads: %li\t Writes: %li\t Erases: %li\n", numWLRead, numWLWrite, numWLErase);
 	printf("Log FTL Switch: %li Partial: %li Full: %li\n", numLogMergeSwitch, numLogMergePartial, numLogMergeFull);
 	printf("Page FTL Convertions: %li\n", numPageBlockToPageConversion);
+	printf("Map Writes: %li\n", numMapWrite);
 	printf("Cache Hits: %li Faults: %li Hit Ratio: %f\n", numCacheHits, numCacheFaults, (double)numCacheHits/(double)(numCacheHits+numCacheFaults));
 	printf("Memory Consumption:\n");
 	printf("Tranlation: %li Cache: %li\n", numMemoryTranslation, numMemoryCache);
 	printf("Reads: %li \tWrites: %li\n", numMemoryRead, numMemoryWrite);
 	printf("-----------\n");
 }
+
+void Stats::checkpoint(Checkpoint &cp)
+{
+	cp.value(numFTLRead);
+	cp.value(numFTLWrite);
+	cp.value(numFTLErase);
+	cp.value(numFTLTrim);
+	cp.value(numGCRead);
+	cp.value(numGCWrite);
+	cp.value(numGCErase);
+	cp.value(numWLRead);
+	cp.value(numWLWrite);
+	cp.value(numWLErase);
+	cp.value(numLogMergeSwitch);
+	cp.value(numLogMergePartial);
+	cp.value(numLogMergeFull);
+	cp.value(numPageBlockToPageConversion);
+	cp.value(numCacheHits);
+	cp.value(numCacheFaults);
+	cp.value(numMemoryTranslation);
+	cp.value(numMemoryCache);
+	cp.value(numMemoryRead);
+	cp.value(numMemoryWrite);
+	cp.value(numMapWrite);
+}
@@ -0,0 +1,340 @@
+/* Copyright 2011 Matias Bjørling */
+
+/* ssd_writebuffer.cpp  */
+
+/* FlashSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version. */
+
+/* FlashSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. */
+
+/* You should have received a copy of the GNU General Public License
+ * along with FlashSim.  If not, see <http://www.gnu.org/licenses/>. */
+
+/****************************************************************************/
+
+/* Write buffer
+ *
+ * Controller side write buffer with Block Padding LRU (BPLRU) replacement as
+ * described in "BPLRU: A Buffer Management Scheme for Improving Random
+ * Writes in Flash Storage by Kim et. al.".
+ *
+ * Buffered pages are grouped by logical block and the blocks are kept in LRU
+ * order. When the buffer is full, the least recently used block is written
+ * to the FTL in page order, and pages missing from the buffer are read from
+ * flash and written along, or written empty if they hold no data (block
+ * padding). A log block FTL then receives a
+ * full sequential block that it can switch instead of merge. Blocks that
+ * become complete in the buffer are moved to the LRU end, as they will not
+ * gain from staying (LRU compensation).
+ *
+ * Padding only helps log block FTLs. Page mapped FTLs get the evicted pages
+ * without padding.
+ */
+
+#include <new>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include "ssd.h"
+
+using namespace ssd;
+
+WriteBuffer::WriteBuffer(Controller &controller):
+	controller(controller),
+	numHits(0),
+	numEvictions(0),
+	numPadded(0)
+{
+	padding = (FTL_IMPLEMENTATION == IMPL_BAST || FTL_IMPLEMENTATION == IMPL_FAST);
+
+	written.resize((ulong)NUMBER_OF_ADDRESSABLE_BLOCKS * BLOCK_SIZE, false);
+
+	// Page frames are allocated once and handed out from a free stack.
+	data = NULL;
+	if (PAGE_ENABLE_DATA)
+		data = new char[(ulong)WRITE_BUFFER_SIZE * PAGE_SIZE];
+
+	free_frames.reserve(WRITE_BUFFER_SIZE);
+	for (uint i=WRITE_BUFFER_SIZE;i>0;i--)
+		free_frames.push_back(i-1);
+
+	printf("Using BPLRU write buffer of %u pages.\n", WRITE_BUFFER_SIZE);
+}
+
+WriteBuffer::~WriteBuffer(void)
+{
+	for (std::unordered_map<long, BufferedBlock>::iterator it = blocks.begin(); it != blocks.end(); ++it)
+		delete [] (*it).second.frames;
+
+	delete [] data;
+}
+
+char *WriteBuffer::frame_data(int frame)
+{
+	return data + (ulong)frame * PAGE_SIZE;
+}
+
+enum status WriteBuffer::read(Event &event)
+{
+	long lbn = event.get_logical_address() / BLOCK_SIZE;
+	uint offset = event.get_logical_address() % BLOCK_SIZE;
+
+	std::unordered_map<long, BufferedBlock>::iterator it = blocks.find(lbn);
+	if (it == blocks.end() || (*it).second.frames[offset] == -1)
+		return controller.ftl->read(event);
+
+	if (PAGE_ENABLE_DATA)
+		global_buffer = frame_data((*it).second.frames[offset]);
+
+	event.incr_time_taken(RAM_READ_DELAY);
+	numHits++;
+
+	return SUCCESS;
+}
+
+enum status WriteBuffer::write(Event &event)
+{
+	long lbn = event.get_logical_address() / BLOCK_SIZE;
+	uint offset = event.get_logical_address() % BLOCK_SIZE;
+
+	std::unordered_map<long, BufferedBlock>::iterator it = blocks.find(lbn);
+
+	if (it == blocks.end() || (*it).second.frames[offset] == -1)
+	{
+		// Make room for the page. The block itself is not a victim.
+		if (it != blocks.end())
+		{
+			lru.erase((*it).second.position);
+			(*it).second.position = lru.insert(lru.end(), lbn);
+		}
+
+		while (free_frames.empty())
+			if (evict_block(event) == FAILURE)
+				return FAILURE;
+
+		it = blocks.find(lbn);
+		if (it == blocks.end())
+		{
+			BufferedBlock block;
+			block.frames = new int[BLOCK_SIZE];
+			for (uint i=0;i<BLOCK_SIZE;i++)
+				block.frames[i] = -1;
+			block.pages = 0;
+			block.position = lru.insert(lru.end(), lbn);
+
+			it = blocks.insert(std::make_pair(lbn, block)).first;
+		}
+
+		BufferedBlock &block = (*it).second;
+		block.frames[offset] = free_frames.back();
+		free_frames.pop_back();
+		block.pages++;
+	}
+	else
+		numHits++;
+
+	BufferedBlock &block = (*it).second;
+
+	if (PAGE_ENABLE_DATA && event.get_payload() != NULL)
+		memcpy(frame_data(block.frames[offset]), event.get_payload(), PAGE_SIZE);
+
+	written[event.get_logical_address()] = true;
+
+	// Most recently used, unless the block is complete.
+	lru.erase(block.position);
+	if (block.pages == BLOCK_SIZE)
+		block.position = lru.insert(lru.begin(), lbn);
+	else
+		block.position = lru.insert(lru.end(), lbn);
+
+	event.incr_time_taken(RAM_WRITE_DELAY);
+
+	return SUCCESS;
+}
+
+enum status WriteBuffer::trim(Event &event)
+{
+	long lbn = event.get_logical_address() / BLOCK_SIZE;
+	uint offset = event.get_logical_address() % BLOCK_SIZE;
+
+	std::unordered_map<long, BufferedBlock>::iterator it = blocks.find(lbn);
+	if (it != blocks.end() && (*it).second.frames[offset] != -1)
+	{
+		BufferedBlock &block = (*it).second;
+
+		free_frames.push_back(block.frames[offset]);
+		block.frames[offset] = -1;
+		block.pages--;
+
+		if (block.pages == 0)
+		{
+			lru.erase(block.position);
+			delete [] block.frames;
+			blocks.erase(it);
+		}
+	}
+
+	written[event.get_logical_address()] = false;
+
+	return controller.ftl->trim(event);
+}
+
+/*
+ * Write the least recently used block to the FTL. For a log block FTL the
+ * block is written whole and in order: pages only in flash are read and
+ * written along, pages that hold no data are written empty.
+ */
+enum status WriteBuffer::evict_block(Event &event)
+{
+	assert(!lru.empty());
+
+	long lbn = lru.front();
+	std::unordered_map<long, BufferedBlock>::iterator it = blocks.find(lbn);
+	BufferedBlock &block = (*it).second;
+
+	char *padPage = PAGE_ENABLE_DATA ? new char[PAGE_SIZE] : NULL;
+
+	for (uint i=0;i<BLOCK_SIZE;i++)
+	{
+		long lpn = lbn * BLOCK_SIZE + i;
+		void *payload = NULL;
+
+		if (block.frames[i] != -1)
+		{
+			if (PAGE_ENABLE_DATA)
+				payload = frame_data(block.frames[i]);
+		}
+		else if (padding && written[lpn])
+		{
+			Event readEvent = Event(READ, lpn, 1, event.get_start_time() + event.get_time_taken());
+			if (controller.ftl->read(readEvent) == FAILURE)
+			{
+				delete [] padPage;
+				return FAILURE;
+			}
+
+			event.incr_time_taken(readEvent.get_time_taken());
+
+			if (PAGE_ENABLE_DATA)
+			{
+				memcpy(padPage, global_buffer, PAGE_SIZE);
+				payload = padPage;
+			}
+
+			numPadded++;
+		}
+		else if (padding)
+		{
+			// Never written or trimmed, padded with an empty page.
+			if (PAGE_ENABLE_DATA)
+			{
+				memset(padPage, 0, PAGE_SIZE);
+				payload = padPage;
+			}
+
+			written[lpn] = true;
+			numPadded++;
+		}
+		else
+			continue; // Never written
+
+		Event writeEvent = Event(WRITE, lpn, 1, event.get_start_time() + event.get_time_taken());
+		writeEvent.set_payload(payload);
+		if (controller.ftl->write(writeEvent) == FAILURE)
+		{
+			delete [] padPage;
+			return FAILURE;
+		}
+
+		event.incr_time_taken(writeEvent.get_time_taken());
+	}
+
+	delete [] padPage;
+
+	for (uint i=0;i<BLOCK_SIZE;i++)
+		if (block.frames[i] != -1)
+			free_frames.push_back(block.frames[i]);
+
+	lru.erase(block.position);
+	delete [] block.frames;
+	blocks.erase(it);
+
+	numEvictions++;
+
+	return SUCCESS;
+}
+
+/*
+ * Write every buffered block to the FTL, least recently used first.
+ */
+enum status WriteBuffer::flush(Event &event)
+{
+	while (!lru.empty())
+		if (evict_block(event) == FAILURE)
+			return FAILURE;
+
+	return SUCCESS;
+}
+
+void WriteBuffer::print_statistics()
+{
+	printf("Write buffer:\n");
+	printf(" Hits: %lu Evicted blocks: %lu Padded pages: %lu Buffered pages: %lu\n", numHits, numEvictions, numPadded, (ulong)(WRITE_BUFFER_SIZE - free_frames.size()));
+}
+
+/*
+ * Save or load the buffered blocks in LRU order with their page frames,
+ * and the frame data with page data enabled.
+ */
+void WriteBuffer::checkpoint(Checkpoint &cp)
+{
+	cp.section("write_buffer");
+
+	ulong count = lru.size();
+	cp.value(count);
+
+	if (cp.is_loading())
+	{
+		for (std::unordered_map<long, BufferedBlock>::iterator it = blocks.begin(); it != blocks.end(); ++it)
+			delete [] (*it).second.frames;
+		blocks.clear();
+		lru.clear();
+
+		for (ulong i=0;i<count;i++)
+		{
+			long lbn;
+			BufferedBlock block;
+			cp.value(lbn);
+			cp.value(block.pages);
+			block.frames = new int[BLOCK_SIZE];
+			cp.array(block.frames, BLOCK_SIZE);
+			block.position = lru.insert(lru.end(), lbn);
+			blocks.insert(std::make_pair(lbn, block));
+		}
+	}
+	else
+	{
+		for (std::list<long>::iterator it = lru.begin(); it != lru.end(); ++it)
+		{
+			long lbn = *it;
+			BufferedBlock &block = blocks[lbn];
+			cp.value(lbn);
+			cp.value(block.pages);
+			cp.array(block.frames, BLOCK_SIZE);
+		}
+	}
+
+	cp.vector(free_frames);
+	if (data != NULL)
+		cp.array(data, (ulong)WRITE_BUFFER_SIZE * PAGE_SIZE);
+
+	cp.bits(written);
+	cp.value(numHits);
+	cp.value(numEvictions);
+	cp.value(numPadded);
+}